@@ -2,8 +2,12 @@
 #include "types.hpp"
 #include "cartridge.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <gameboy.hpp>
+#include <render-thread.hpp>
+#include <timer-controller.hpp>
+#include <save-state.hpp>
 #include <stdexcept>
 
 namespace gb {
@@ -20,7 +24,7 @@ AddressBus::AddressBus(Gameboy* gameboy) : gameboy{gameboy} {
 // Methods /////////////////////////////////////////////////////////////////////
 bool AddressBus::isBootRomEnabled() const {
   // 1 = disabled, 0 = enabled
-  return !(memory[BOOT_ROM_LOCK] & 1);
+  return !(memory[offsetOf(BOOT_ROM_LOCK)] & 1);
 }
 
 bool AddressBus::isCartridgeInserted() const {
@@ -35,9 +39,51 @@ void AddressBus::loadCart(Cartridge* newCart) {
   cart = newCart;
 };
 
+void AddressBus::attachTimer(TimerController* newTimer) {
+  timer = newTimer;
+}
+
+bool AddressBus::refersToTimer(const dword address) {
+  return address >= REG_DIV && address <= REG_TAC;
+}
+
+// States only hold the memory owned by the bus, as it is laid out in memory
+// (see offsetOf()).
+void AddressBus::saveState(state::Writer& writer) const {
+  writer.beginSection("BUS ");
+  writer.putBytes(memory.data(), memory.size());
+  writer.endSection();
+}
+
+void AddressBus::loadState(state::Reader& reader) {
+  reader.requireSection("BUS ");
+  const word* data = reader.viewBytes(memory.size());
+#ifdef GB_STATE_HASH
+  memoryHash = state::updateMemoryHash(memoryHash, memory.data(), data, memory.size(), 0);
+#endif
+  std::copy(data, data + memory.size(), memory.begin());
+}
+
+std::uint64_t AddressBus::stateHash() const {
+#ifdef GB_STATE_HASH
+  return memoryHash;
+#else
+  return state::memoryHash(memory.data(), memory.size(), 0);
+#endif
+}
+
+const word* AddressBus::getVRAM() const {
+  return &memory[VRAM_OFFSET];
+}
+
+const word* AddressBus::view(const dword address) const {
+  assert(!refersToCartridge(address) && !refersToTimer(address) && "Memory is not owned by the bus.");
+  return &memory[offsetOf(address)];
+}
+
 word AddressBus::getJoypad() const {
   const word joypadStatus = gameboy->joypadStatus;
-  const word JOIP = memory[REG_JOIP];
+  const word JOIP = memory[offsetOf(REG_JOIP)];
   const std::bitset<6> joypadSelect = JOIP;
   constexpr word bitmaskHigh = 0b11110000;
   constexpr word bitmaskLow  = 0b00001111;
@@ -68,6 +114,11 @@ word AddressBus::read(const dword address) const {
     return getJoypad();
   }
 
+  // Timer registers are computed by the timer when they are read.
+  if (timer != nullptr && refersToTimer(address)) {
+    return timer->read(address);
+  }
+
   // TAC Register.
   // From docs, only the lowest three bits of this register matter.
   // It does not say if the output should be masked or not.
@@ -77,7 +128,7 @@ word AddressBus::read(const dword address) const {
   //}
 
   if (!refersToCartridge(address)) {
-    return memory[address];
+    return memory[offsetOf(address)];
   }
 
   if (!isCartridgeInserted()) {
@@ -93,7 +144,16 @@ void AddressBus::write(const dword address, const word value, Component whois) {
   // example, or to set "hardware" registers.
   if (whois == GB) {
     assert(!refersToCartridge(address));
-    memory[address] = value;
+    if (timer != nullptr && refersToTimer(address)) {
+      timer->write(address, value, true);
+      return;
+    }
+    store(address, value);
+    return;
+  }
+
+  if (timer != nullptr && refersToTimer(address)) {
+    timer->write(address, value);
     return;
   }
 
@@ -114,8 +174,7 @@ void AddressBus::write(const dword address, const word value, Component whois) {
   if (address == REG_STAT) {
     // The three lower bits are only writable by PPU!
     const word mask = (whois == PPU ? 0b00000111 : 0b11111000);
-    memory[address] &= ~mask;
-    memory[address] |= value & mask;
+    store(address, (memory[offsetOf(address)] & ~mask) | (value & mask));
     return;
   }
 
@@ -124,11 +183,23 @@ void AddressBus::write(const dword address, const word value, Component whois) {
   }
 
   if (address == REG_DIV && whois != TC) {
-    memory[address] = 0;
+    store(address, 0);
     return;
   }
 
-  memory[address] = value;
+  store(address, value);
+
+  // Render thread keeps its own copy of VRAM, and the PPU log records
+  // every change to it.
+  if (address >= VRAM_LOWER_BOUND && address < VRAM_UPPER_BOUND) {
+    if (gameboy->renderThread) {
+      gameboy->renderThread->pushVRAMWrite(address, value);
+    }
+    if (gameboy->ppuLog) {
+      gameboy->ppuLog->writeVRAM(address, value);
+    }
+    return;
+  }
 
   // Placeholder for serial communication.
   // Todo implement proper serial stuff
@@ -150,22 +221,11 @@ void AddressBus::write(const dword address, const word value, Component whois) {
     // ^^ doesn't work. Leaving it here for the future.
     // 0xA0 = 160, number of addresses to copy
     for (int i = 0; i !=  0xA0; ++i) {
-      memory[OAM_MEMORY_LOWER_BOUND + i] = read(value * 0x100 + i);
+      store(OAM_MEMORY_LOWER_BOUND + i, read(value * 0x100 + i));
     }
   }
 
-  // Some edge cases in the book:
-  if (address >= ECHO_RAM_LOWER_BOUND_0 && address < ECHO_RAM_UPPER_BOUND_0) {
-    memory[address - 0x2000] = value;
-    memory[address] = value;
-    return;
-  }
-
-  if (address >= ECHO_RAM_LOWER_BOUND_1 && address < ECHO_RAM_UPPER_BOUND_1) {
-    memory[address + 0x2000] = value;
-    memory[address] = value;
-    return;
-  }
+  // Echo RAM needs no special case: it is stored with work RAM (see offsetOf).
 
   // Todo add FEA0–FEFF range edge case, see pandocs
 }
@@ -1,14 +1,22 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
+#include "state-hash.hpp"
 #include "types.hpp"
 
 namespace gb {
 
 class Gameboy;
 class Cartridge;
+class TimerController;
+namespace state {
+class Writer;
+class Reader;
+}
 
 // From the docs:
 /*
@@ -47,10 +55,45 @@ private:
  // We can access anything from 0 to 0xFFFF (INCLUDED!)
  static constexpr int ADDRESS_BUS_SIZE = 0xFFFF + 1;
 
+ // Only memory owned by the bus is kept here, packed: VRAM, work RAM, and
+ // everything from OAM up. Cartridge ROM and RAM live inside Cartridge, and
+ // echo RAM is work RAM seen at another address.
+ static constexpr std::size_t VRAM_OFFSET{ 0x0000 };
+ static constexpr std::size_t WRAM_OFFSET{ 0x2000 };
+ static constexpr std::size_t HIGH_OFFSET{ 0x4000 };
+ static constexpr std::size_t MEMORY_SIZE{ 0x4200 };
+
  // Bare pointers are not ideal; see Gameboy
   Gameboy* gameboy;
   Cartridge* cart{ nullptr };
-  std::array<word, ADDRESS_BUS_SIZE> memory{};
+  // Timer registers live inside TimerController, if there is one.
+  TimerController* timer{ nullptr };
+  // Hash of memory (see state-hash.hpp), if GB_STATE_HASH is defined.
+  std::uint64_t memoryHash{ 0 };
+  std::array<word, MEMORY_SIZE> memory{};
+
+  // Position of an address owned by the bus inside memory.
+  static inline std::size_t offsetOf(const dword address) {
+    if (address >= OAM_MEMORY_LOWER_BOUND) {
+      return address - OAM_MEMORY_LOWER_BOUND + HIGH_OFFSET;
+    }
+    if (address >= ECHO_RAM_LOWER_BOUND_1) {
+      // Echo RAM ($E000-$FDFF) wraps around to $C000-$DDFF.
+      return ((address - ECHO_RAM_LOWER_BOUND_1) & 0x1FFF) + WRAM_OFFSET;
+    }
+    return address - VRAM_LOWER_BOUND + VRAM_OFFSET;
+  }
+
+  // All writes to memory go through here.
+  inline void store(const dword address, const word value) {
+    const std::size_t offset = offsetOf(address);
+#ifdef GB_STATE_HASH
+    if (memory[offset] != value) {
+      memoryHash ^= state::byteHash(offset, memory[offset]) ^ state::byteHash(offset, value);
+    }
+#endif
+    memory[offset] = value;
+  }
 
  public:
   // Different agents can read/write to different parts of memory.
@@ -78,11 +121,28 @@ private:
   word read(dword address) const;
 
   void loadCart(Cartridge* cart);
+  // Forward timer registers ($FF04-$FF07) to timer.
+  void attachTimer(TimerController* timer);
+
+  // Direct read-only access to VRAM ($8000-$9FFF), used to draw lines.
+  const word* getVRAM() const;
+  // Direct read-only access to memory owned by the bus, starting at address
+  // (e.g. work RAM at $C000). Cartridge and timer addresses are not owned
+  // by the bus.
+  const word* view(dword address) const;
 
   // Correctly read Joypad address from memory. Needs to be used when reading joypad address.
   word getJoypad() const;
 
+  // Save state section (see save-state.hpp). Only memory owned by the bus
+  // is saved: cartridge and timer have their own sections.
+  void saveState(state::Writer& writer) const;
+  void loadState(state::Reader& reader);
+  // Hash of memory owned by the bus (see Gameboy::stateHash).
+  std::uint64_t stateHash() const;
+
   static bool refersToCartridge(dword address);
+  static bool refersToTimer(dword address);
 };
 
 }
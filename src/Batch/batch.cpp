@@ -0,0 +1,535 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define GB_BATCH_USE_PROCESSES
+#endif
+
+#include "gameboy.hpp"
+#include "movie.hpp"
+#include "save-state.hpp"
+
+namespace gb {
+namespace batch {
+namespace {
+
+// Jobs are dealt to workers up front. Each worker takes jobs from the back
+// of its own queue, and steals from the front of the others' once it runs
+// out, so that workers left with long jobs get helped by idle ones.
+class JobPool {
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::size_t> jobs;
+  };
+  std::vector<Queue> queues;
+
+ public:
+  JobPool(const std::size_t jobs, const unsigned workers) : queues(workers) {
+    for (std::size_t i = 0; i != jobs; ++i) {
+      queues[i % workers].jobs.push_back(i);
+    }
+  }
+
+  // @return false once there are no jobs left anywhere.
+  bool next(const unsigned worker, std::size_t& job) {
+    {
+      Queue& own = queues[worker];
+      std::lock_guard<std::mutex> lock{ own.mutex };
+      if (!own.jobs.empty()) {
+        job = own.jobs.back();
+        own.jobs.pop_back();
+        return true;
+      }
+    }
+    // No new jobs get queued while running, so an empty pass means the
+    // pool is done.
+    for (unsigned i = 1; i != queues.size(); ++i) {
+      Queue& victim = queues[(worker + i) % queues.size()];
+      std::lock_guard<std::mutex> lock{ victim.mutex };
+      if (!victim.jobs.empty()) {
+        job = victim.jobs.front();
+        victim.jobs.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+constexpr std::size_t SCREEN_SIZE{ PPU::HEIGHT * PPU::WIDTH };
+constexpr dword WORK_RAM_ADDRESS{ 0xC000 };
+constexpr std::size_t WORK_RAM_SIZE{ 0x2000 };
+
+// Hash of the screen, two bits per pixel.
+std::uint64_t frameHash(const PPU::color* screen) {
+  std::array<word, SCREEN_SIZE / 4> packed{};
+  for (std::size_t i = 0; i != SCREEN_SIZE; ++i) {
+    packed[i / 4] |= screen[i] << (2 * (i % 4));
+  }
+  return state::hash(packed.data(), packed.size());
+}
+
+// Write the last frame of a job as a PGM image, and its RAM (work RAM, then
+// cartridge RAM) as is.
+void dumpJob(const std::string& directory, const std::size_t index, const PPU::color* screen,
+             const word* workRam, const word* cartRam, const std::size_t cartRamSize) {
+  const std::string path = directory + "/job-" + std::to_string(index);
+  std::ofstream image{ path + ".pgm", std::ios_base::binary };
+  image << "P5\n" << PPU::WIDTH << ' ' << PPU::HEIGHT << "\n3\n";
+  for (std::size_t i = 0; i != SCREEN_SIZE; ++i) {
+    // Shades go from white to black, gray levels the other way around.
+    image.put(static_cast<char>(3 - screen[i]));
+  }
+  std::ofstream ram{ path + ".ram", std::ios_base::binary };
+  ram.write(reinterpret_cast<const char*>(workRam), WORK_RAM_SIZE);
+  ram.write(reinterpret_cast<const char*>(cartRam), cartRamSize);
+  if (!image || !ram) {
+    throw std::runtime_error("Can not write results to " + directory);
+  }
+}
+
+// Run a job on a new machine. Its output (screen, serial, RAM) is left in
+// the machine, and only clocks and time go to result. The screen holds the
+// last frame that was drawn whole, or the screen as it is if there is none
+// (e.g. the screen is off).
+void runJob(Gameboy& gameboy, const Job& job, unsigned long long clocks, Result& result) {
+  gameboy.setRenderingEnabled(false);
+  std::unique_ptr<MoviePlayer> player;
+  if (job.moviePath.empty()) {
+    gameboy.boot();
+  } else {
+    player.reset(new MoviePlayer{ job.moviePath });
+    player->start(gameboy);
+    // Movies are not played past their end.
+    const unsigned long long movieClocks = (player->getFrameCount() - player->getFrame(gameboy)) * CLOCKS_PER_FRAME;
+    clocks = std::min(clocks, movieClocks);
+  }
+
+  // Only the last two frames are drawn. When the job ends, the screen is
+  // usually in the middle of a frame: the last frame drawn whole is kept
+  // aside. The first frame drawn is not whole, as rendering started in its
+  // middle (or boot skipped its first lines).
+  const unsigned long long drawFrom = clocks > 2 * CLOCKS_PER_FRAME ? clocks - 2 * CLOCKS_PER_FRAME : 0;
+  Gameboy::ScreenBuffer lastFrame;
+  unsigned long long framesDrawn = gameboy.getFramesDrawn();
+  int framesSeen{ 0 };
+
+  const auto start = std::chrono::steady_clock::now();
+  for (; result.clocks != clocks; ++result.clocks) {
+    if (result.clocks == drawFrom) {
+      gameboy.setRenderingEnabled(true);
+      framesDrawn = gameboy.getFramesDrawn();
+    }
+    if (player) {
+      player->apply(gameboy);
+    }
+    gameboy.machineClock();
+    if (gameboy.getFramesDrawn() != framesDrawn) {
+      framesDrawn = gameboy.getFramesDrawn();
+      if (++framesSeen > 1) {
+        lastFrame = gameboy.screenBuffer;
+      }
+    }
+  }
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (framesSeen > 1) {
+    gameboy.screenBuffer = lastFrame;
+  }
+}
+
+// Load each ROM once, so that jobs running the same one share it.
+// @param errors why ROMs that could not be loaded were not.
+std::map<std::string, std::shared_ptr<const ROMImage>> loadImages(const std::vector<Job>& jobs,
+                                                                     std::map<std::string, std::string>& errors) {
+  std::map<std::string, std::shared_ptr<const ROMImage>> images;
+  for (const auto& job : jobs) {
+    if (images.count(job.romPath) != 0 || errors.count(job.romPath) != 0) {
+      continue;
+    }
+    try {
+      images[job.romPath] = ROMImage::fromFile(job.romPath);
+    } catch (const std::exception& error) {
+      errors[job.romPath] = error.what();
+    }
+  }
+  return images;
+}
+
+#ifdef GB_BATCH_USE_PROCESSES
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Atomics in shared memory must be lock free.");
+
+// Memory shared by the supervisor and its worker processes. It is mapped
+// before workers get forked, so they all see it at the same address.
+//
+// ROMs are copied once to a segment of their own, which is then made
+// read-only: workers use it in place (see ROMImage::fromMemory).
+//
+// Each worker slot has a ring of results. The worker fills the entry at
+// written, then publishes it by incrementing written; the supervisor reads
+// entries in place up to written, then frees them by incrementing read.
+// The supervisor writes files and hashes straight from the ring.
+class SharedBatch {
+ public:
+  static constexpr std::size_t RING_SIZE{ 2 };
+  static constexpr std::size_t MAX_CART_RAM_SIZE{ 0x20000 };
+  static constexpr std::size_t MAX_ERROR_SIZE{ 256 };
+
+  struct Entry {
+    std::uint64_t job;
+    std::uint64_t clocks;
+    double seconds;
+    std::uint32_t serialSize;
+    std::uint32_t errorSize;
+    std::uint32_t cartRamSize;
+    char serial[Gameboy::SERIAL_BUFFER_CAPACITY];
+    char error[MAX_ERROR_SIZE];
+    PPU::color screen[SCREEN_SIZE];
+    word workRam[WORK_RAM_SIZE];
+    word cartRam[MAX_CART_RAM_SIZE];
+  };
+
+  struct Slot {
+    // Job being run (or about to be), -1 if none. If the worker dies, this
+    // one failed.
+    std::atomic<std::int64_t> job;
+    std::atomic<std::uint64_t> written;
+    std::atomic<std::uint64_t> read;
+    Entry entries[RING_SIZE];
+  };
+
+ private:
+  struct Header {
+    std::atomic<std::uint64_t> nextJob;
+  };
+
+  void* memory{ nullptr };
+  std::size_t memorySize{ 0 };
+  void* roms{ nullptr };
+  std::size_t romsSize{ 0 };
+  unsigned slotCount;
+
+  static void* map(const std::size_t size) {
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      throw std::runtime_error("Can not map shared memory!");
+    }
+    return mapping;
+  }
+
+ public:
+  // ROMs get copied to shared memory, and replace the ones in images.
+  SharedBatch(const unsigned slots, std::map<std::string, std::shared_ptr<const ROMImage>>& images)
+    : slotCount{ slots } {
+    memorySize = sizeof(Header) + slots * sizeof(Slot);
+    memory = map(memorySize);
+    // Anonymous mappings are zeroed: atomics only need to be constructed.
+    new (header()) Header{};
+    header()->nextJob = 0;
+    for (unsigned i = 0; i != slots; ++i) {
+      new (&slot(i)->job) std::atomic<std::int64_t>{ -1 };
+      new (&slot(i)->written) std::atomic<std::uint64_t>{ 0 };
+      new (&slot(i)->read) std::atomic<std::uint64_t>{ 0 };
+    }
+
+    for (const auto& image : images) {
+      romsSize += image.second->size();
+    }
+    if (romsSize == 0) {
+      return;
+    }
+    roms = map(romsSize);
+    auto* position = static_cast<word*>(roms);
+    for (auto& image : images) {
+      const std::size_t size = image.second->size();
+      std::memcpy(position, image.second->data(), size);
+      image.second = ROMImage::fromMemory(position, size);
+      position += size;
+    }
+    mprotect(roms, romsSize, PROT_READ);
+  }
+
+  ~SharedBatch() {
+    munmap(memory, memorySize);
+    if (roms != nullptr) {
+      munmap(roms, romsSize);
+    }
+  }
+
+  SharedBatch(const SharedBatch&) = delete;
+  SharedBatch& operator=(const SharedBatch&) = delete;
+
+  Header* header() {
+    return static_cast<Header*>(memory);
+  }
+
+  Slot* slot(const unsigned index) {
+    return reinterpret_cast<Slot*>(static_cast<char*>(memory) + sizeof(Header)) + index;
+  }
+
+  unsigned size() const {
+    return slotCount;
+  }
+};
+
+// Body of a worker process: take jobs until there are none left.
+void runWorker(SharedBatch& batch, SharedBatch::Slot& slot, const std::vector<Job>& jobs,
+               const unsigned long long clocks,
+               const std::map<std::string, std::shared_ptr<const ROMImage>>& images,
+               const std::map<std::string, std::string>& imageErrors) {
+  while (true) {
+    // Publish the job before taking it, so that a worker never dies with a
+    // job nobody knows about. If it dies before taking it, the supervisor
+    // fails the job, and whoever runs it next reports it again.
+    std::uint64_t i = batch.header()->nextJob;
+    do {
+      if (i >= jobs.size()) {
+        return;
+      }
+      slot.job = static_cast<std::int64_t>(i);
+    } while (!batch.header()->nextJob.compare_exchange_weak(i, i + 1));
+
+    // Wait for the supervisor to free an entry.
+    const std::uint64_t written = slot.written;
+    while (written - slot.read >= SharedBatch::RING_SIZE) {
+      std::this_thread::sleep_for(std::chrono::microseconds{ 100 });
+    }
+    SharedBatch::Entry& entry = slot.entries[written % SharedBatch::RING_SIZE];
+    entry.job = i;
+    entry.serialSize = 0;
+    entry.cartRamSize = 0;
+
+    std::string error;
+    Result result;
+    const auto image = images.find(jobs[i].romPath);
+    if (image == images.end()) {
+      error = imageErrors.at(jobs[i].romPath);
+    } else {
+      try {
+        Gameboy gameboy{ image->second };
+        runJob(gameboy, jobs[i], clocks, result);
+
+        std::size_t cartRamSize;
+        const word* cartRam = gameboy.viewSave(cartRamSize);
+        if (cartRamSize > SharedBatch::MAX_CART_RAM_SIZE) {
+          throw std::runtime_error("Cartridge RAM is too large!");
+        }
+        std::copy(gameboy.screenBuffer.begin(), gameboy.screenBuffer.end(), entry.screen);
+        std::copy(gameboy.viewMemory(WORK_RAM_ADDRESS), gameboy.viewMemory(WORK_RAM_ADDRESS) + WORK_RAM_SIZE,
+                  entry.workRam);
+        std::copy(cartRam, cartRam + cartRamSize, entry.cartRam);
+        entry.cartRamSize = cartRamSize;
+        // Longer serial output gets cut (see Gameboy::SERIAL_BUFFER_CAPACITY).
+        entry.serialSize = std::min(gameboy.serialBuffer.size(), sizeof(entry.serial));
+        std::memcpy(entry.serial, gameboy.serialBuffer.data(), entry.serialSize);
+      } catch (const std::exception& exception) {
+        error = exception.what();
+      }
+    }
+    entry.clocks = result.clocks;
+    entry.seconds = result.seconds;
+    entry.errorSize = std::min(error.size(), sizeof(entry.error));
+    std::memcpy(entry.error, error.data(), entry.errorSize);
+
+    slot.written = written + 1;
+    slot.job = -1;
+  }
+}
+
+#endif
+
+}  // namespace
+
+std::vector<Result> runOnThreads(const std::vector<Job>& jobs, const unsigned long long clocks, const unsigned workers,
+                                 const std::string& dumpDirectory) {
+  std::map<std::string, std::string> imageErrors;
+  const auto images = loadImages(jobs, imageErrors);
+
+  std::vector<Result> results(jobs.size());
+  JobPool pool{ jobs.size(), workers };
+
+  const auto worker = [&](const unsigned index) {
+    std::size_t i;
+    while (pool.next(index, i)) {
+      const auto image = images.find(jobs[i].romPath);
+      if (image == images.end()) {
+        results[i].error = imageErrors.at(jobs[i].romPath);
+        continue;
+      }
+      // A bad job should not take the whole batch down with it.
+      try {
+        Gameboy gameboy{ image->second };
+        runJob(gameboy, jobs[i], clocks, results[i]);
+        results[i].frameHash = frameHash(gameboy.screenBuffer.data());
+        results[i].serial = std::move(gameboy.serialBuffer);
+        if (!dumpDirectory.empty()) {
+          std::size_t cartRamSize;
+          const word* cartRam = gameboy.viewSave(cartRamSize);
+          dumpJob(dumpDirectory, i, gameboy.screenBuffer.data(), gameboy.viewMemory(WORK_RAM_ADDRESS), cartRam,
+                  cartRamSize);
+        }
+      } catch (const std::exception& error) {
+        results[i].error = error.what();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i != workers; ++i) {
+    threads.emplace_back(worker, i);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+#ifdef GB_BATCH_USE_PROCESSES
+
+std::vector<Result> runInProcesses(const std::vector<Job>& jobs, const unsigned long long clocks,
+                                   const unsigned workers, const std::string& dumpDirectory) {
+  std::map<std::string, std::string> imageErrors;
+  auto images = loadImages(jobs, imageErrors);
+  SharedBatch batch{ workers, images };
+
+  // Boot states are cached per process (see Gameboy::boot): boot each ROM
+  // once here, so that workers inherit the cache instead of each of them
+  // running the boot ROM again.
+  for (const auto& image : images) {
+    try {
+      Gameboy{ image.second }.boot();
+    } catch (const std::exception&) {
+      // Jobs running this ROM fail in their worker, with the same error.
+    }
+  }
+
+  std::vector<Result> results(jobs.size());
+  std::vector<bool> done(jobs.size(), false);
+  std::vector<pid_t> pids(workers, -1);
+
+  // Nothing else runs in this process: forking is safe.
+  const auto spawn = [&](const unsigned index) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+      throw std::runtime_error("Can not start worker process!");
+    }
+    if (pid == 0) {
+      int status{ EXIT_SUCCESS };
+      try {
+        runWorker(batch, *batch.slot(index), jobs, clocks, images, imageErrors);
+      } catch (...) {
+        status = EXIT_FAILURE;
+      }
+      // Skip destructors and buffered output inherited from the supervisor.
+      _exit(status);
+    }
+    pids[index] = pid;
+  };
+
+  // Read the results a worker published, in place.
+  const auto drain = [&](SharedBatch::Slot& slot) {
+    bool any{ false };
+    const std::uint64_t written = slot.written;
+    for (std::uint64_t read = slot.read; read != written; ++read) {
+      const SharedBatch::Entry& entry = slot.entries[read % SharedBatch::RING_SIZE];
+      Result& result = results[entry.job];
+      result.clocks = entry.clocks;
+      result.seconds = entry.seconds;
+      result.serial.assign(entry.serial, entry.serialSize);
+      result.error.assign(entry.error, entry.errorSize);
+      if (result.error.empty()) {
+        result.frameHash = frameHash(entry.screen);
+        if (!dumpDirectory.empty()) {
+          try {
+            dumpJob(dumpDirectory, entry.job, entry.screen, entry.workRam, entry.cartRam, entry.cartRamSize);
+          } catch (const std::exception& error) {
+            result.error = error.what();
+          }
+        }
+      }
+      done[entry.job] = true;
+      slot.read = read + 1;
+      any = true;
+    }
+    return any;
+  };
+
+  unsigned running{ 0 };
+  for (unsigned i = 0; i != workers; ++i) {
+    spawn(i);
+    ++running;
+  }
+  while (running != 0) {
+    bool progress{ false };
+    for (unsigned i = 0; i != workers; ++i) {
+      progress = drain(*batch.slot(i)) || progress;
+    }
+
+    int status;
+    const pid_t pid = waitpid(-1, &status, WNOHANG);
+    if (pid > 0) {
+      const auto index = static_cast<unsigned>(std::find(pids.begin(), pids.end(), pid) - pids.begin());
+      if (index == workers) {
+        continue;
+      }
+      SharedBatch::Slot& slot = *batch.slot(index);
+      drain(slot);
+      // A job the worker published but did not take gets run by another
+      // one, whose result replaces this failure.
+      const std::int64_t job = slot.job;
+      if (job >= 0 && !done[job]) {
+        results[job].error = WIFSIGNALED(status)
+                               ? "Worker process was killed by signal " + std::to_string(WTERMSIG(status)) + "."
+                               : "Worker process exited while running the job.";
+        done[job] = true;
+      }
+      slot.job = -1;
+      --running;
+      if (batch.header()->nextJob < jobs.size()) {
+        spawn(index);
+        ++running;
+      }
+      progress = true;
+    }
+    if (!progress) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+  }
+
+  // Jobs that no worker reported did not run.
+  for (std::size_t i = 0; i != jobs.size(); ++i) {
+    if (!done[i]) {
+      results[i].error = "No worker process reported the job.";
+    }
+  }
+  return results;
+}
+
+#else
+
+std::vector<Result> runInProcesses(const std::vector<Job>&, unsigned long long, unsigned, const std::string&) {
+  throw std::runtime_error("Worker processes are not supported on this system.");
+}
+
+#endif
+
+}  // namespace batch
+}  // namespace gb
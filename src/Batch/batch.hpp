@@ -0,0 +1,56 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gb {
+
+// Many ROMs run headless, as fast as possible, on all cores (see gb-batch).
+// Each job is a ROM, optionally played with the inputs of a movie (see
+// MovieRecorder), and runs for a fixed number of machine clocks, counted
+// after the boot ROM (see Gameboy::boot). Movies are not played past their
+// end.
+//
+// A job that fails (e.g. its ROM can not be loaded) only fails its own
+// result. With dumpDirectory, the last frame (job-N.pgm) and RAM (job-N.ram:
+// work RAM, then cartridge RAM) of each job are written there.
+namespace batch {
+
+constexpr unsigned long long CLOCKS_PER_FRAME{ 17556 };
+
+struct Job {
+  std::string romPath;
+  std::string moviePath;
+};
+
+struct Result {
+  unsigned long long clocks{ 0 };
+  double seconds{ 0 };
+  // Hash of the last complete frame, which ended at most a frame before the
+  // job did.
+  std::uint64_t frameHash{ 0 };
+  std::string serial;
+  // Empty if the job succeeded.
+  std::string error;
+};
+
+// Run jobs on threads. Threads that run out of jobs take some from the
+// others.
+std::vector<Result> runOnThreads(const std::vector<Job>& jobs, unsigned long long clocks, unsigned threads,
+                                 const std::string& dumpDirectory = "");
+
+// Run jobs in worker processes instead, so that a job that crashes does not
+// take the others down: the worker running it gets replaced, and the job
+// fails. Workers share the ROMs, and hand results back through shared
+// memory. Processes get forked: no other thread may be running.
+// @throws if worker processes are not supported on this system, or can not
+// be started.
+std::vector<Result> runInProcesses(const std::vector<Job>& jobs, unsigned long long clocks, unsigned processes,
+                                   const std::string& dumpDirectory = "");
+
+}  // namespace batch
+}  // namespace gb
+
+#endif  // BATCH_H
@@ -0,0 +1,152 @@
+#include "libgameboy.h"
+#include <exception>
+#include <string>
+
+#include "gameboy.hpp"
+
+struct gb_machine {
+  gb::Gameboy gameboy;
+
+  explicit gb_machine(const gb::Binary& rom) : gameboy{ rom } {
+  }
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+// Exceptions must not cross the C interface: they are turned into an error
+// status, and their message is kept for gb_last_error.
+template <typename Function>
+int guard(Function function) {
+  try {
+    function();
+    lastError.clear();
+    return 0;
+  } catch (const std::exception& error) {
+    lastError = error.what();
+  } catch (...) {
+    lastError = "Unknown error.";
+  }
+  return -1;
+}
+
+}  // namespace
+
+static_assert(sizeof(gb::PPU::color) == 1, "Screen is shared as one byte per pixel.");
+static_assert(GB_SCREEN_WIDTH == gb::PPU::WIDTH && GB_SCREEN_HEIGHT == gb::PPU::HEIGHT, "Screen size mismatch.");
+
+unsigned gb_api_version(void) {
+  return GB_API_VERSION;
+}
+
+const char* gb_last_error(void) {
+  return lastError.c_str();
+}
+
+gb_machine* gb_create(const uint8_t* rom, const size_t size) {
+  gb_machine* machine{ nullptr };
+  if (rom == nullptr) {
+    lastError = "ROM is null.";
+    return nullptr;
+  }
+  guard([&]() { machine = new gb_machine{ gb::Binary(rom, rom + size) }; });
+  return machine;
+}
+
+void gb_destroy(gb_machine* machine) {
+  delete machine;
+}
+
+int gb_boot(gb_machine* machine) {
+  return guard([&]() { machine->gameboy.boot(); });
+}
+
+int gb_run_clocks(gb_machine* machine, const uint64_t clocks) {
+  return guard([&]() {
+    for (uint64_t i = 0; i != clocks; ++i) {
+      machine->gameboy.machineClock();
+    }
+  });
+}
+
+int gb_run_frames(gb_machine* machine, const uint32_t frames) {
+  return gb_run_clocks(machine, static_cast<uint64_t>(frames) * GB_CLOCKS_PER_FRAME);
+}
+
+uint64_t gb_clock_count(const gb_machine* machine) {
+  return machine->gameboy.getClockCount();
+}
+
+void gb_set_buttons(gb_machine* machine, const uint8_t buttons) {
+  // Button bits are in the same order, but the emulator expects 0 for
+  // pressed buttons.
+  machine->gameboy.setJoypad(~buttons & 0xFF);
+}
+
+const uint8_t* gb_screen(const gb_machine* machine) {
+  return machine->gameboy.screenBuffer.data();
+}
+
+void gb_set_rendering(gb_machine* machine, const int enabled) {
+  machine->gameboy.setRenderingEnabled(enabled != 0);
+}
+
+uint64_t gb_frames_drawn(const gb_machine* machine) {
+  return machine->gameboy.getFramesDrawn();
+}
+
+const uint8_t* gb_memory(const gb_machine* machine, const gb_memory_area area, size_t* size) {
+  const gb::Gameboy& gameboy = machine->gameboy;
+  std::size_t areaSize{ 0 };
+  const uint8_t* data{ nullptr };
+  switch (area) {
+    case GB_MEMORY_VRAM:
+      areaSize = 0x2000;
+      data = gameboy.viewMemory(0x8000);
+      break;
+    case GB_MEMORY_WRAM:
+      areaSize = 0x2000;
+      data = gameboy.viewMemory(0xC000);
+      break;
+    case GB_MEMORY_OAM:
+      areaSize = 0xA0;
+      data = gameboy.viewMemory(0xFE00);
+      break;
+    case GB_MEMORY_HRAM:
+      areaSize = 0x7F;
+      data = gameboy.viewMemory(0xFF80);
+      break;
+    case GB_MEMORY_CART:
+      data = gameboy.viewSave(areaSize);
+      break;
+    default:
+      lastError = "Unknown memory area.";
+  }
+  if (size != nullptr) {
+    *size = areaSize;
+  }
+  return data;
+}
+
+uint8_t gb_read(const gb_machine* machine, const uint16_t address) {
+  return machine->gameboy.readMemory(address);
+}
+
+size_t gb_state_size(const gb_machine* machine) {
+  return machine->gameboy.stateSize();
+}
+
+size_t gb_save_state(const gb_machine* machine, uint8_t* buffer, const size_t capacity) {
+  size_t size{ 0 };
+  guard([&]() { size = machine->gameboy.saveState(buffer, capacity); });
+  return size;
+}
+
+int gb_load_state(gb_machine* machine, const uint8_t* state, const size_t size) {
+  return guard([&]() { machine->gameboy.loadState(state, size); });
+}
+
+uint64_t gb_state_hash(const gb_machine* machine) {
+  return machine->gameboy.stateHash();
+}
@@ -0,0 +1,106 @@
+#ifndef LIBGAMEBOY_H
+#define LIBGAMEBOY_H
+
+/*
+ * C interface to the emulator, built as a shared library (libgameboy).
+ *
+ * Machines are handled through opaque pointers, which must not be NULL
+ * (except for gb_destroy). Functions that can fail return 0 on success and
+ * -1 on error (or NULL, for pointers); the reason can then be read with
+ * gb_last_error().
+ *
+ * Screen, memory and save states are shared without copying: screen and
+ * memory are read in place, through pointers that stay valid for the lifetime
+ * of the machine, and states are written to caller-provided buffers.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define GB_API __attribute__((visibility("default")))
+#else
+#define GB_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever the interface changes in an incompatible way. */
+#define GB_API_VERSION 1
+
+#define GB_SCREEN_WIDTH 160
+#define GB_SCREEN_HEIGHT 144
+#define GB_CLOCKS_PER_FRAME 17556
+
+/* Buttons, for gb_set_buttons. */
+enum {
+  GB_BUTTON_RIGHT = 1 << 0,
+  GB_BUTTON_LEFT = 1 << 1,
+  GB_BUTTON_UP = 1 << 2,
+  GB_BUTTON_DOWN = 1 << 3,
+  GB_BUTTON_A = 1 << 4,
+  GB_BUTTON_B = 1 << 5,
+  GB_BUTTON_SELECT = 1 << 6,
+  GB_BUTTON_START = 1 << 7
+};
+
+/* Memory areas, for gb_memory. */
+typedef enum {
+  GB_MEMORY_VRAM, /* $8000-$9FFF */
+  GB_MEMORY_WRAM, /* $C000-$DFFF */
+  GB_MEMORY_OAM,  /* $FE00-$FE9F */
+  GB_MEMORY_HRAM, /* $FF80-$FFFE */
+  GB_MEMORY_CART  /* Cartridge RAM, may be empty. */
+} gb_memory_area;
+
+typedef struct gb_machine gb_machine;
+
+GB_API unsigned gb_api_version(void);
+
+/* Message of the last error on this thread (empty if none). */
+GB_API const char* gb_last_error(void);
+
+/* Create a machine from a ROM in memory. The ROM is copied. The machine
+ * starts at power on, with the boot ROM (see gb_boot). */
+GB_API gb_machine* gb_create(const uint8_t* rom, size_t size);
+GB_API void gb_destroy(gb_machine* machine);
+
+/* Run the boot ROM to its end, or restore its end state if this ROM was
+ * booted before in this process. */
+GB_API int gb_boot(gb_machine* machine);
+
+GB_API int gb_run_clocks(gb_machine* machine, uint64_t clocks);
+GB_API int gb_run_frames(gb_machine* machine, uint32_t frames);
+/* Machine clocks since power on. */
+GB_API uint64_t gb_clock_count(const gb_machine* machine);
+
+/* Pressed buttons, as GB_BUTTON_* flags. */
+GB_API void gb_set_buttons(gb_machine* machine, uint8_t buttons);
+
+/* Screen, one byte per pixel holding its shade, from 0 (white) to 3
+ * (black), line by line. Lines are updated as they are drawn. */
+GB_API const uint8_t* gb_screen(const gb_machine* machine);
+/* Skip drawing lines, which does not change emulation. */
+GB_API void gb_set_rendering(gb_machine* machine, int enabled);
+GB_API uint64_t gb_frames_drawn(const gb_machine* machine);
+
+/* Memory area, read in place. size gets set to its size in bytes. */
+GB_API const uint8_t* gb_memory(const gb_machine* machine, gb_memory_area area, size_t* size);
+/* Read memory as the CPU would, without side effects. */
+GB_API uint8_t gb_read(const gb_machine* machine, uint16_t address);
+
+/* Save states, to a buffer of at least gb_state_size bytes.
+ * gb_save_state returns the size of the state, or 0 on error. */
+GB_API size_t gb_state_size(const gb_machine* machine);
+GB_API size_t gb_save_state(const gb_machine* machine, uint8_t* buffer, size_t capacity);
+GB_API int gb_load_state(gb_machine* machine, const uint8_t* state, size_t size);
+/* Hash of the whole machine state: equal states hash the same. */
+GB_API uint64_t gb_state_hash(const gb_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBGAMEBOY_H */
@@ -1,10 +1,12 @@
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <cassert>
 
 #include "cpu.hpp"
 #include "gameboy.hpp"
 #include "opcodes.hpp"
+#include "save-state.hpp"
 #include "timings.hpp"
 
 namespace gb {
@@ -237,14 +239,19 @@ void CPU::pushPCToStack() {
 CPU::CPU(Gameboy* gameboy, AddressBus* bus)
   : bus{ bus }
   , gameboy{ gameboy } {
-  initTimings();
-  initTimingsCB();
+  // Tables are shared by all CPUs, which can be created on many threads at
+  // once: fill them only the first time.
+  static std::once_flag tablesInitialized;
+  std::call_once(tablesInitialized, []() {
+    initTimings();
+    initTimingsCB();
 
-  INTERRUPT_JUMP_ADDRESSES[INTERRUPT_VBLANK] = 0x40;
-  INTERRUPT_JUMP_ADDRESSES[INTERRUPT_STAT]   = 0x48;
-  INTERRUPT_JUMP_ADDRESSES[INTERRUPT_TIMER]  = 0x50;
-  INTERRUPT_JUMP_ADDRESSES[INTERRUPT_SERIAL] = 0X58;
-  INTERRUPT_JUMP_ADDRESSES[INTERRUPT_JOYPAD] = 0x60;
+    INTERRUPT_JUMP_ADDRESSES[INTERRUPT_VBLANK] = 0x40;
+    INTERRUPT_JUMP_ADDRESSES[INTERRUPT_STAT]   = 0x48;
+    INTERRUPT_JUMP_ADDRESSES[INTERRUPT_TIMER]  = 0x50;
+    INTERRUPT_JUMP_ADDRESSES[INTERRUPT_SERIAL] = 0X58;
+    INTERRUPT_JUMP_ADDRESSES[INTERRUPT_JOYPAD] = 0x60;
+  });
 }
 
 void CPU::executeCurrentInstruction() {
@@ -462,4 +469,42 @@ bool CPU::getHalfCarryFlag(const dword a, const dword b) {
   return (((a & 0xFFF) + (b & 0xFFF)) & 0x1000) == 0x1000;
 }
 
+// Save states /////////////////////////////////////////////////////////////////
+void CPU::saveState(state::Writer& writer) const {
+  writer.beginSection("CPU ");
+  writer.put8(A);
+  writer.put8(F.to_ulong());
+  writer.put8(B);
+  writer.put8(C);
+  writer.put8(D);
+  writer.put8(E);
+  writer.put8(H);
+  writer.put8(L);
+  writer.put16(SP);
+  writer.put16(PC);
+  writer.putBool(IME);
+  writer.putBool(halted);
+  writer.putBool(crashed);
+  writer.put32(busyCycles);
+  writer.endSection();
+}
+
+void CPU::loadState(state::Reader& reader) {
+  reader.requireSection("CPU ");
+  A = reader.get8();
+  F = reader.get8();
+  B = reader.get8();
+  C = reader.get8();
+  D = reader.get8();
+  E = reader.get8();
+  H = reader.get8();
+  L = reader.get8();
+  SP = reader.get16();
+  PC = reader.get16();
+  IME = reader.getBool();
+  halted = reader.getBool();
+  crashed = reader.getBool();
+  busyCycles = static_cast<int>(reader.get32());
+}
+
 }
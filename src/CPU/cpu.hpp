@@ -10,6 +10,10 @@ namespace gb {
 
 class Gameboy;
 class AddressBus;
+namespace state {
+class Writer;
+class Reader;
+}
 
 class CPU {
   // Gameboy needs to be called the private IF method (used to request interrupts).
@@ -22,13 +26,13 @@ class CPU {
   Gameboy* gameboy;
 
   // Instruction timings in machine cycles.
-  // For clarity's sake, the values are populated in the constructor.
+  // For clarity's sake, the values are populated in the (first) constructor.
   // All the timing constants are defined in the "timings.hpp" file.
   static std::array<int, 256> INSTRUCTION_TIMINGS;
   static std::array<int, 256> CB_INSTRUCTION_TIMINGS;
   static void initTimings();
   static void initTimingsCB();
-  // Interrupts make execution jump to specific addresses. This array is populated in constructor.
+  // Interrupts make execution jump to specific addresses. This array is populated in the first constructor.
   static std::array<dword, 5> INTERRUPT_JUMP_ADDRESSES;
 
   // "Special" conditions that stop CPU execution.
@@ -153,6 +157,10 @@ class CPU {
   // To be called once every machine clock.
   void machineClock();
 
+  // Save state section (see save-state.hpp).
+  void saveState(state::Writer& writer) const;
+  void loadState(state::Reader& reader);
+
   // Static methods ////////////////////////////////////////////////////////////
   // Convert back and from word<->dword
   static dword twoWordToDword(word msb, word lsb);
@@ -0,0 +1,75 @@
+#ifndef CARTRIDGE_MBC2
+#define CARTRIDGE_MBC2
+
+namespace gb {
+
+class MBC2 : public Cartridge {
+  // MBC2 has 512 half-bytes of RAM built in.
+  static constexpr unsigned int INTERNAL_RAM_SIZE{0x200u};
+
+  unsigned int romBank{1};
+  bool externalRamEnabled{false};
+
+  inline void writeRegister(const dword address, const word value) override {
+    // Only the lower half of ROM area has registers. Bit 8 of address
+    // selects which one gets written.
+    if (address >= 0x4000u) {
+      return;
+    }
+
+    if (!(address & 0x100)) {
+      externalRamEnabled = (value & 0b1111) == 0xA;
+      return;
+    }
+
+    const unsigned int bank = value & 0b1111;
+    romBank = bank != 0 ? bank : 1;
+  }
+
+  inline void updateMapping() override {
+    mapLowROMBank(0);
+    mapHighROMBank(romBank);
+    // RAM is only four bits wide, so it can not be mapped directly.
+    // See readUnmapped/writeUnmapped.
+    unmapRAM();
+  }
+
+  inline word readUnmapped(const dword address) const override {
+    if (!externalRamEnabled) {
+      return 0xFF;
+    }
+
+    // RAM is mirrored across the whole region. Upper four bits are not
+    // connected and read as 1.
+    return ramData[(address - CART_RAM_LOWER_BOUND) % INTERNAL_RAM_SIZE] | 0xF0;
+  }
+
+  inline void writeUnmapped(const dword address, const word value) override {
+    if (!externalRamEnabled) {
+      return;
+    }
+
+    writeRAM((address - CART_RAM_LOWER_BOUND) % INTERNAL_RAM_SIZE, value & 0x0F);
+  }
+
+  inline void saveRegisters(state::Writer& writer) const override {
+    writer.put8(romBank);
+    writer.putBool(externalRamEnabled);
+  }
+
+  inline void loadRegisters(state::Reader& reader) override {
+    romBank = reader.get8();
+    externalRamEnabled = reader.getBool();
+  }
+
+ public:
+  explicit inline MBC2(std::shared_ptr<const ROMImage> rom) : Cartridge{std::move(rom)} {
+    // Header always says there is no RAM.
+    allocateRAM(INTERNAL_RAM_SIZE);
+    updateMapping();
+  };
+};
+
+}
+
+#endif
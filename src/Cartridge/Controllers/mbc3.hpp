@@ -7,50 +7,16 @@ namespace gb {
 
 class MBC3 : public Cartridge {
 
-  unsigned int romBank{};
-  unsigned int ramBank{};
+  unsigned int romBank{1};
+  // Values 0-3 select a RAM bank, values 8-C select an RTC register.
+  unsigned int ramBank{0};
   bool externalRamEnabled{false};
 
-  // Todo Add proper implementation of RTC.
-  // RTC timer{};
-  // bool readyForLatch{false};
-
- public:
-  explicit inline MBC3(const Binary& rom) : Cartridge{rom} {};
-
-  inline word read(const dword address) override {
-    if (address < 0x4000u) {
-      return rom[address];
-    }
-
-    if (address < 0x8000u) {
-      return rom[0x4000 * romBank + (address - 0x4000)];
-    }
-
-    assert(address >= CART_RAM_LOWER_BOUND && "Cartridge controller was asked to read outside of its memory!");
-    assert(address < CART_RAM_UPPER_BOUND && "Cartridge controller was asked to read outside of its memory!");
-
-    // IF These addresses are mapped to RAM...
-    if (ramBank < 0x04 && externalRamEnabled) {
-      const dword ramAddress = 0x2000 * ramBank + (address - 0xA000);
-      return ram[ramAddress];
-    }
-
-    // IF instead they are mapped to RTC...
-    // (This is a placeholder for the actual RTC code).
-    if (0x08 <= ramBank && ramBank < 0x0D) {
-      assert(false && "RTC Timer not implemented yet.");
-      // return timer.getLatchedRegister(ramBank);
-    }
-
-    // If external RAM is not enabled
-    // (Or if we are in a different case: ROM's fault)
-    return 0xFF;
-  }
-
-  // Todo add battery-backed writes
-  inline void write(const dword address, const word value) override {
+  // Only present on MBC3_TIMER cartridges.
+  bool hasTimer{false};
+  RTC timer{};
 
+  inline void writeRegister(const dword address, const word value) override {
     if (address < 0x2000u) {
       externalRamEnabled = (value & 0b1111) == 0xA;
       return;
@@ -67,43 +33,75 @@ class MBC3 : public Cartridge {
       return;
     }
 
-    // Todo timer implementation
-    if (address < 0x8000u) {
-      // // Docs do not say if the two writes for the latch have to be consecutive.
-      // if (value == 0x00) {
-      //   readyForLatch = true;
-      //   return;
-      // }
-      //
-      // if (value == 0x01 && readyForLatch) {
-      //   timer.latch();
-      //   readyForLatch = false;
-      //   return;
-      // }
-
-      return;
+    if (hasTimer) {
+      timer.writeLatch(value);
     }
+  }
 
-    assert(address >= CART_RAM_LOWER_BOUND && "Cartridge controller was asked to write outside of its memory!");
-    assert(address < CART_RAM_UPPER_BOUND && "Cartridge controller was asked to write outside of its memory!");
+  inline void updateMapping() override {
+    mapLowROMBank(0);
+    mapHighROMBank(romBank);
 
+    // IF These addresses are mapped to RAM...
     if (externalRamEnabled && ramBank < 0x04) {
-      const dword ramAddress = 0x2000 * ramBank + (address - CART_RAM_LOWER_BOUND);
-      ram[ramAddress] = value;
+      mapRAMBank(ramBank);
       return;
     }
 
+    // IF instead they are mapped to RTC (or to nothing), they are
+    // handled by readUnmapped/writeUnmapped.
+    unmapRAM();
+  }
+
+  inline word readUnmapped(const dword) const override {
+    if (hasTimer && externalRamEnabled && RTC::isRegister(ramBank)) {
+      return timer.read(ramBank);
+    }
+
+    // If external RAM is not enabled
+    // (Or if we are in a different case: ROM's fault)
+    return 0xFF;
+  }
 
-    if (0x08 <= ramBank && ramBank < 0x0D) {
-      // Todo timer implementation
-      // timer.writeRegister(ramBank, value);
+  inline void writeUnmapped(const dword, const word value) override {
+    if (hasTimer && externalRamEnabled && RTC::isRegister(ramBank)) {
+      timer.write(ramBank, value);
       return;
     }
 
     // Otherwise, ignore the write.
   }
+
+  inline void saveRegisters(state::Writer& writer) const override {
+    writer.put8(romBank);
+    writer.put8(ramBank);
+    writer.putBool(externalRamEnabled);
+    if (hasTimer) {
+      timer.saveState(writer);
+    }
+  }
+
+  inline void loadRegisters(state::Reader& reader) override {
+    romBank = reader.get8();
+    ramBank = reader.get8();
+    externalRamEnabled = reader.getBool();
+    if (hasTimer) {
+      timer.loadState(reader);
+    }
+  }
+
+ public:
+  explicit inline MBC3(std::shared_ptr<const ROMImage> rom) : Cartridge{std::move(rom)} {
+    const auto type = getHeader().cartridgeType;
+    hasTimer = type == MBC3_TIMER_BATTERY || type == MBC3_TIMER_RAM_BATTERY;
+    updateMapping();
+  };
+
+  inline RTC* getRTC() override {
+    return hasTimer ? &timer : nullptr;
+  }
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,74 @@
+#ifndef CARTRIDGE_MBC5
+#define CARTRIDGE_MBC5
+
+namespace gb {
+
+class MBC5 : public Cartridge {
+  // 9-bit ROM bank number. Unlike other MBCs, bank 0 can be mapped too.
+  unsigned int romBank{1};
+  unsigned int ramBank{0};
+  bool externalRamEnabled{false};
+
+  // On rumble cartridges, bit 3 of RAM bank register drives the motor
+  // instead of selecting the bank.
+  bool hasRumble;
+
+  inline void writeRegister(const dword address, const word value) override {
+    if (address < 0x2000u) {
+      externalRamEnabled = (value & 0b1111) == 0xA;
+      return;
+    }
+
+    if (address < 0x3000u) {
+      romBank = (romBank & 0x100) | value;
+      return;
+    }
+
+    if (address < 0x4000u) {
+      romBank = (romBank & 0xFF) | (value & 0b1) << 8;
+      return;
+    }
+
+    if (address < 0x6000u) {
+      ramBank = value & (hasRumble ? 0b0111 : 0b1111);
+      return;
+    }
+
+    // $6000-$7FFF does nothing.
+  }
+
+  inline void updateMapping() override {
+    mapLowROMBank(0);
+    mapHighROMBank(romBank);
+
+    if (!externalRamEnabled) {
+      unmapRAM();
+      return;
+    }
+    mapRAMBank(ramBank);
+  }
+
+  inline void saveRegisters(state::Writer& writer) const override {
+    writer.put16(romBank);
+    writer.put8(ramBank);
+    writer.putBool(externalRamEnabled);
+  }
+
+  inline void loadRegisters(state::Reader& reader) override {
+    romBank = reader.get16();
+    ramBank = reader.get8();
+    externalRamEnabled = reader.getBool();
+  }
+
+ public:
+  explicit inline MBC5(std::shared_ptr<const ROMImage> rom)
+    : Cartridge{std::move(rom)}
+    , hasRumble{getHeader().cartridgeType >= MBC5_RUMBLE
+             && getHeader().cartridgeType <= MBC5_RUMBLE_RAM_BATTERY} {
+    updateMapping();
+  };
+};
+
+}
+
+#endif
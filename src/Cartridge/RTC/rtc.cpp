@@ -1 +1,274 @@
-#include "rtc.hpp"
\ No newline at end of file
+#include "rtc.hpp"
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include "save-state.hpp"
+
+namespace gb {
+
+namespace {
+
+constexpr unsigned long long SECONDS_PER_DAY{ 24 * 60 * 60 };
+constexpr unsigned int DAY_COUNTER_WRAP{ 512 };
+
+// Bits of the days high register.
+constexpr word DAY_BIT_8{ 0b00000001 };
+constexpr word HALT_BIT{ 0b01000000 };
+constexpr word CARRY_BIT{ 0b10000000 };
+
+void put32(word* output, const std::uint32_t value) {
+  for (int i = 0; i != 4; ++i) {
+    output[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+std::uint32_t get32(const word* input) {
+  std::uint32_t value{ 0 };
+  for (int i = 0; i != 4; ++i) {
+    value |= static_cast<std::uint32_t>(input[i]) << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+// Methods /////////////////////////////////////////////////////////////////////
+void RTC::attachClock(const unsigned long long* clockCount) {
+  clock = clockCount;
+  lastClock = clock != nullptr ? *clock : 0;
+}
+
+word RTC::read(const word reg) const {
+  assert(isRegister(reg));
+  return latched[reg - SECONDS];
+}
+
+void RTC::write(const word reg, const word value) {
+  assert(isRegister(reg));
+  // Whatever time passed until now counts with the old values.
+  sync();
+
+  switch (reg) {
+    case SECONDS:
+      seconds = value & 0b111111;
+      // Writing seconds also resets the prescaler.
+      subsecondClocks = 0;
+      break;
+
+    case MINUTES:
+      minutes = value & 0b111111;
+      break;
+
+    case HOURS:
+      hours = value & 0b11111;
+      break;
+
+    case DAYS_LOW:
+      days = (days & 0x100) | value;
+      break;
+
+    case DAYS_HIGH:
+    default:
+      days = (days & 0xFF) | ((value & DAY_BIT_8) << 8);
+      halt = value & HALT_BIT;
+      carry = value & CARRY_BIT;
+      break;
+  }
+
+  // Writes show up in latched registers too.
+  latched[reg - SECONDS] = liveRegister(reg);
+}
+
+void RTC::writeLatch(const word value) {
+  if (value == 0x00) {
+    latchArmed = true;
+    return;
+  }
+
+  if (value == 0x01 && latchArmed) {
+    sync();
+    for (word reg = SECONDS; reg <= DAYS_HIGH; ++reg) {
+      latched[reg - SECONDS] = liveRegister(reg);
+    }
+  }
+  latchArmed = false;
+}
+
+std::array<word, RTC::SAVE_SIZE> RTC::save(const std::time_t now) const {
+  // Saving must not change emulation, so live registers are brought up to
+  // date on a copy.
+  RTC current{ *this };
+  current.sync();
+
+  std::array<word, SAVE_SIZE> data{};
+  for (word reg = SECONDS; reg <= DAYS_HIGH; ++reg) {
+    put32(&data[4 * (reg - SECONDS)], current.liveRegister(reg));
+    put32(&data[20 + 4 * (reg - SECONDS)], latched[reg - SECONDS]);
+  }
+
+  const auto timestamp = static_cast<std::uint64_t>(now);
+  put32(&data[40], timestamp & 0xFFFFFFFF);
+  put32(&data[44], timestamp >> 32);
+  return data;
+}
+
+void RTC::load(const word* data, const std::size_t size, const std::time_t now, const bool wallClockSync) {
+  if (size != SAVE_SIZE && size != SHORT_SAVE_SIZE) {
+    throw std::runtime_error("Trying to load RTC data of invalid size!");
+  }
+
+  seconds = get32(&data[0]) & 0b111111;
+  minutes = get32(&data[4]) & 0b111111;
+  hours = get32(&data[8]) & 0b11111;
+  days = get32(&data[12]) & 0xFF;
+  const word daysHigh = get32(&data[16]) & 0xFF;
+  days |= (daysHigh & DAY_BIT_8) << 8;
+  halt = daysHigh & HALT_BIT;
+  carry = daysHigh & CARRY_BIT;
+
+  for (std::size_t i = 0; i != latched.size(); ++i) {
+    latched[i] = get32(&data[20 + 4 * i]) & 0xFF;
+  }
+
+  lastClock = clock != nullptr ? *clock : 0;
+  subsecondClocks = 0;
+  latchArmed = false;
+
+  if (!wallClockSync || halt) {
+    return;
+  }
+
+  std::uint64_t timestamp = get32(&data[40]);
+  if (size == SAVE_SIZE) {
+    timestamp |= static_cast<std::uint64_t>(get32(&data[44])) << 32;
+  }
+
+  // Clock never goes backwards.
+  const auto current = static_cast<std::int64_t>(now);
+  if (current > static_cast<std::int64_t>(timestamp)) {
+    advance(static_cast<unsigned long long>(current - static_cast<std::int64_t>(timestamp)));
+  }
+}
+
+void RTC::saveState(state::Writer& writer) const {
+  writer.put64(lastClock);
+  writer.put32(subsecondClocks);
+  writer.put8(seconds);
+  writer.put8(minutes);
+  writer.put8(hours);
+  writer.put16(days);
+  writer.putBool(halt);
+  writer.putBool(carry);
+  writer.putBytes(latched.data(), latched.size());
+  writer.putBool(latchArmed);
+}
+
+void RTC::loadState(state::Reader& reader) {
+  lastClock = reader.get64();
+  subsecondClocks = reader.get32();
+  seconds = reader.get8() & 0b111111;
+  minutes = reader.get8() & 0b111111;
+  hours = reader.get8() & 0b11111;
+  days = reader.get16() % DAY_COUNTER_WRAP;
+  halt = reader.getBool();
+  carry = reader.getBool();
+  reader.getBytes(latched.data(), latched.size());
+  latchArmed = reader.getBool();
+}
+
+void RTC::sync() {
+  if (clock == nullptr) {
+    return;
+  }
+
+  const unsigned long long now = *clock;
+  // Clock could have been replaced by an earlier one.
+  const unsigned long long elapsed = now > lastClock ? now - lastClock : 0;
+  lastClock = now;
+  if (halt) {
+    return;
+  }
+
+  subsecondClocks += elapsed;
+  const unsigned long long elapsedSeconds = subsecondClocks / CLOCKS_PER_SECOND;
+  subsecondClocks %= CLOCKS_PER_SECOND;
+  advance(elapsedSeconds);
+}
+
+void RTC::advance(unsigned long long elapsedSeconds) {
+  // Out of range values have to be counted one second at a time, until they
+  // wrap around their bit width. Seconds take at most 4 seconds, minutes at
+  // most about 4 minutes, but hours can take up to 8 hours (24 to 32): about
+  // 29000 ticks in the worst case, and never more than elapsedSeconds.
+  while (elapsedSeconds != 0 && (seconds >= 60 || minutes >= 60 || hours >= 24)) {
+    tick();
+    --elapsedSeconds;
+  }
+  if (elapsedSeconds == 0) {
+    return;
+  }
+
+  const unsigned long long secondOfDay = seconds + 60u * minutes + 60u * 60u * hours;
+  const unsigned long long total = days * SECONDS_PER_DAY + secondOfDay + elapsedSeconds;
+
+  const unsigned long long totalDays = total / SECONDS_PER_DAY;
+  if (totalDays >= DAY_COUNTER_WRAP) {
+    carry = true;
+  }
+  days = totalDays % DAY_COUNTER_WRAP;
+
+  const unsigned long long remainder = total % SECONDS_PER_DAY;
+  hours = remainder / (60 * 60);
+  minutes = remainder / 60 % 60;
+  seconds = remainder % 60;
+}
+
+void RTC::tick() {
+  // Each counter only carries into the next one when it reaches its exact
+  // limit, otherwise it wraps around its bit width.
+  seconds = (seconds + 1) & 0b111111;
+  if (seconds != 60) {
+    return;
+  }
+  seconds = 0;
+
+  minutes = (minutes + 1) & 0b111111;
+  if (minutes != 60) {
+    return;
+  }
+  minutes = 0;
+
+  hours = (hours + 1) & 0b11111;
+  if (hours != 24) {
+    return;
+  }
+  hours = 0;
+
+  ++days;
+  if (days == DAY_COUNTER_WRAP) {
+    days = 0;
+    carry = true;
+  }
+}
+
+word RTC::liveRegister(const word reg) const {
+  switch (reg) {
+    case SECONDS:
+      return seconds;
+
+    case MINUTES:
+      return minutes;
+
+    case HOURS:
+      return hours;
+
+    case DAYS_LOW:
+      return days & 0xFF;
+
+    case DAYS_HIGH:
+    default:
+      return ((days >> 8) & DAY_BIT_8) | (halt ? HALT_BIT : 0) | (carry ? CARRY_BIT : 0);
+  }
+}
+
+}  // namespace gb
@@ -2,92 +2,104 @@
 #define RTC_H
 
 #include <array>
-#include <chrono>
-#include <cassert>
+#include <cstddef>
+#include <ctime>
 
 #include "types.hpp"
 
 namespace gb {
 
-using namespace std::chrono;
-
-// Todo RTC implementation does not work properly yet. All of this code should
-//  be taken out of main and moved to its own branch. RTC saves should be
-//  handled as well in some way.
-// Right now this is all taken straight from documentation.
-struct RTC {
-  inline RTC() {
-    assert(false && "RTC Implementation is not ready and it should not be used.");
-  }
-
-  // TODO add proper implementation of halt and carry bit
-  bool haltBit{false};
-  bool carryBit{false};
-
-  // TODO implement save and load of latched registers
-  std::array<word, 5> regs;
-
-  inline word rtS() const {
-    const auto clock = system_clock::now();
-    return duration_cast<seconds>(clock.time_since_epoch()).count() % 60;
-  }
-
-  inline word rtM() const {
-    const auto clock = system_clock::now();
-    return duration_cast<minutes>(clock.time_since_epoch()).count() % 60;
-  }
-
-  inline word rtH() const {
-    const auto clock = system_clock::now();
-    return duration_cast<hours>(clock.time_since_epoch()).count() % 24;
-  }
-
-  // Day register is 9-bit
-  inline word rtDL() const {
-    const auto clock = system_clock::now();
-    const auto hoursPassed = duration_cast<hours>(clock.time_since_epoch()).count();
-    const auto daysPassed = hoursPassed / 24;
-    return (daysPassed % 0b111111111) & 0xFF;
-  }
-  inline word rtDH() const {
-    const auto clock = system_clock::now();
-    const auto hoursPassed = duration_cast<hours>(clock.time_since_epoch()).count();
-    const auto daysPassed = hoursPassed / 24;
-    const unsigned int result = (daysPassed % 0b111111111) & 0b100000000;
-    return result & (haltBit << 6) & (carryBit << 7);
-  }
-
-  inline void latch() {
-    regs[0] = rtS();
-    regs[1] = rtM();
-    regs[2] = rtH();
-    regs[3] = rtDL();
-    regs[4] = rtDH();
-  }
+namespace state {
+class Writer;
+class Reader;
+}
 
-  inline word getLatchedRegister(word reg) const {
-    assert(reg >= 0x08 && reg < 0x0D);
-    return regs[reg - 0x08];
+// MBC3 real time clock.
+//
+// Time is not taken from the host: the clock advances with the emulator's
+// own machine clock count (see attachClock), so it runs faster when the
+// emulator runs faster and it is fully deterministic. Nothing is computed
+// while the game runs: registers are brought up to date (see sync) only
+// when they are latched or written.
+//
+// Host time only matters when saving and loading (see save/load): the save
+// format stores a UNIX timestamp, and loading can optionally advance the
+// clock by the real time that passed in between (wall-clock sync).
+class RTC {
+ public:
+  // Machine clocks per second (see Gameboy::machineClock).
+  static constexpr unsigned long long CLOCKS_PER_SECOND{ 1048576 };
+  // Size of saved data. The format is the one used by most other emulators:
+  // current and latched registers as ten little endian 32-bit values,
+  // followed by a 64-bit UNIX timestamp.
+  static constexpr std::size_t SAVE_SIZE{ 48 };
+  // Some emulators use a 32-bit timestamp. This can be loaded, but not saved.
+  static constexpr std::size_t SHORT_SAVE_SIZE{ 44 };
+
+  // Register numbers, as selected by MBC3 RAM bank register.
+  static constexpr word SECONDS{ 0x08 };
+  static constexpr word MINUTES{ 0x09 };
+  static constexpr word HOURS{ 0x0A };
+  static constexpr word DAYS_LOW{ 0x0B };
+  static constexpr word DAYS_HIGH{ 0x0C };
+
+  static inline bool isRegister(const unsigned int reg) {
+    return SECONDS <= reg && reg <= DAYS_HIGH;
   }
 
-  // Todo this should also write to realtime registers.
-  inline void writeRegister(word reg, word value) {
-    const int map = reg - 0x08;
-
-    if (map == 4) {
-      regs[map] = value & 0b11000001;
-      return;
-    }
-
-    if (map == 3) {
-      regs[map] = value & 0b11111111;
-      return;
-    }
-
-    regs[map] = value & 0b00111111;
-  }
+  // Time does not advance until a clock is attached. clockCount has to
+  // outlive the RTC (or another clock has to be attached).
+  void attachClock(const unsigned long long* clockCount);
+
+  // Register access. Reads return latched values.
+  word read(word reg) const;
+  void write(word reg, word value);
+  // Latch happens when 0x00 and then 0x01 are written to $6000-$7FFF.
+  void writeLatch(word value);
+
+  std::array<word, SAVE_SIZE> save(std::time_t now) const;
+  // If wallClockSync is enabled, the time passed between the saved timestamp
+  // and now gets added to the clock (unless it is halted).
+  // @throws if data is not SAVE_SIZE or SHORT_SAVE_SIZE bytes long.
+  void load(const word* data, std::size_t size, std::time_t now, bool wallClockSync);
+
+  // Full clock state, for save states (see save-state.hpp). Unlike save(),
+  // this is exact and does not depend on host time.
+  void saveState(state::Writer& writer) const;
+  void loadState(state::Reader& reader);
+
+  // Add some seconds to the clock, as if they passed while not halted.
+  void advance(unsigned long long seconds);
+
+ private:
+  const unsigned long long* clock{ nullptr };
+  // Registers are up to date as of machine clock lastClock. Clocks that
+  // did not make a full second yet are kept in subsecondClocks.
+  unsigned long long lastClock{ 0 };
+  unsigned long long subsecondClocks{ 0 };
+
+  // Live registers. Values are not wrapped to valid ranges: games can write
+  // e.g. 62 seconds, which then count up to 63 and wrap to 0 without
+  // carrying into minutes, as on real hardware.
+  word seconds{ 0 };
+  word minutes{ 0 };
+  word hours{ 0 };
+  unsigned int days{ 0 };
+  bool halt{ false };
+  bool carry{ false };
+
+  // Latched registers, in register order.
+  std::array<word, 5> latched{};
+  bool latchArmed{ false };
+
+  // Bring live registers up to date with the attached clock.
+  void sync();
+  // Advance one second, the way the hardware counters do.
+  void tick();
+  // Register value as seen by the game.
+  word liveRegister(word reg) const;
 };
 
-}
+}  // namespace gb
 
 #endif  // RTC_H
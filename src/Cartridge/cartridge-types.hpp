@@ -2,8 +2,11 @@
 #define CARTRIDGE_TYPES_H
 
 #include "cartridge.hpp"
+#include "save-state.hpp"
 #include "Controllers/mbc0.hpp"
 #include "Controllers/mbc1.hpp"
+#include "Controllers/mbc2.hpp"
 #include "Controllers/mbc3.hpp"
+#include "Controllers/mbc5.hpp"
 
 #endif  // CARTRIDGE_TYPES_H
@@ -1,19 +1,27 @@
+#include <algorithm>
+#include <cassert>
 #include <stdexcept>
+#include <utility>
 #include "cartridge.hpp"
 #include "types.hpp"
 #include "cartridge-types.hpp"
+#include "save-state.hpp"
 
 namespace gb {
 
 // Header stuff/////////////////////////////////////////////////////////////////
 // This parses the header without checking if it's valid.
 // Original DMG did not check validity and so the emulator should neither.
-Cartridge::Header::Header(const std::vector<word>& rom)  {
-  if (rom.size() < MIN_ROM_BANKS * ROM_BANK_SIZE) {
+Cartridge::Header::Header(const Binary& rom) : Header{ rom.data(), rom.size() } {}
+
+Cartridge::Header::Header(const ROMImage& rom) : Header{ rom.data(), rom.size() } {}
+
+Cartridge::Header::Header(const word* rom, const std::size_t size) {
+  if (size < MIN_ROM_BANKS * ROM_BANK_SIZE) {
     throw std::runtime_error("Tried to parse an empty or invalid ROM header.");
   }
 
-  std::copy(rom.begin() + CARTHEADER_LOWER_BOUND , rom.begin() + CARTHEADER_UPPER_BOUND, title.begin());
+  std::copy(rom + CARTHEADER_LOWER_BOUND , rom + CARTHEADER_UPPER_BOUND, title.begin());
   license[0]        = rom[CARTHEADER_LICENSE_0];
   license[1]        = rom[CARTHEADER_LICENSE_1];
   sgbFlag           = rom[CARTHEADER_SGBFLAG];
@@ -62,22 +70,32 @@ Cartridge::MBCType Cartridge::getMBC(const Binary& rom) {
   return static_cast<MBCType>(rom[CARTHEADER_TYPE]);
 }
 
+Cartridge::MBCType Cartridge::getMBC(const ROMImage& rom) {
+  if (rom.size() < MIN_ROM_BANKS * ROM_BANK_SIZE) {
+    throw std::runtime_error("Tried to parse an empty or invalid ROM.");
+  }
+
+  return static_cast<MBCType>(rom[CARTHEADER_TYPE]);
+}
+
 // Constructor /////////////////////////////////////////////////////////////////
-// Instantiate cartridge from binary data
-Cartridge::Cartridge(const Binary& data) : header{data} {
+// Instantiate cartridge from ROM image. Only the header is read here, the
+// rest of the ROM is left untouched until the game reads it.
+Cartridge::Cartridge(std::shared_ptr<const ROMImage> data)
+  : header{ *data }
+  , image{ std::move(data) }
+  , rom{ image->data() }
+  , romSize{ image->size() } {
   // Check that ROM is valid by having an integer number of banks
-  if (data.size() % ROM_BANK_SIZE != 0) {
+  if (romSize % ROM_BANK_SIZE != 0) {
     throw std::runtime_error("Invalid ROM file: blocks must be multiples of 16KiB!");
   }
 
-  // Store ROM data in memory
-  // Binary is a vector of words; using it with call syntax instantiates a vector
-  // of n elements se to zero.
-  rom = Binary(data.size());
-  std::copy(data.begin(), data.end(), rom.begin());
-  assert(rom.size() == data.size());
-
   setRAMSize();
+
+  // Default mapping, controllers set their own.
+  mapLowROMBank(0);
+  mapHighROMBank(1);
 }
 
 // Methods /////////////////////////////////////////////////////////////////////
@@ -85,40 +103,209 @@ const Cartridge::Header& Cartridge::getHeader() const {
   return header;
 }
 
-const Binary& Cartridge::getRom() {
-  return rom;
+const ROMImage& Cartridge::getRom() const {
+  return *image;
+}
+
+const std::shared_ptr<const ROMImage>& Cartridge::getRomImage() const {
+  return image;
 }
 
 void Cartridge::setRAMSize() {
   switch (header.RAMSize) {
     case 1:
-      ram = std::vector<word>(0x800);
+      allocateRAM(0x800);
       break;
 
     case 2:
-      ram = std::vector<word>(0x2000);
+      allocateRAM(0x2000);
       break;
 
     case 3:
-      ram = std::vector<word>(0x8000);
+      allocateRAM(0x8000);
+      break;
+
+    case 4:
+      allocateRAM(0x20000);
+      break;
+
+    case 5:
+      allocateRAM(0x10000);
       break;
 
     default:
-      ram = std::vector<word>(0);
+      allocateRAM(0);
       break;
   }
 }
 
+void Cartridge::allocateRAM(const std::size_t size) {
+  assert(!saveFile && "RAM can not be resized once it is in a save file!");
+  ramStorage = Binary(size);
+  ramData = ramStorage.data();
+  ramSize = size;
+  ramHash = 0;
+}
+
+void Cartridge::rehashRAM() {
+#ifdef GB_STATE_HASH
+  ramHash = state::memoryHash(ramData, ramSize, state::CARTRIDGE_RAM_POSITION);
+#endif
+}
+
 void Cartridge::loadBatteryBackedRAM(Binary newRam) {
-  if (newRam.size() != ram.size()) {
+  if (newRam.size() != ramSize) {
     throw std::runtime_error("Trying to load a save game of invalid size for this cartridge!");
   }
 
-  std::copy(newRam.begin(), newRam.end(), ram.begin());
+  std::copy(newRam.begin(), newRam.end(), ramData);
+  rehashRAM();
+  if (saveFile) {
+    saveFile->markDirty();
+  }
+}
+
+Binary Cartridge::getRam() const {
+  return Binary(ramData, ramData + ramSize);
+}
+
+const word* Cartridge::getRamData() const {
+  return ramData;
+}
+
+std::size_t Cartridge::getRamSize() const {
+  return ramSize;
+}
+
+bool Cartridge::attachSaveFile(const std::string& path, const std::chrono::milliseconds flushInterval) {
+  // Any previous save file is closed (and flushed) first.
+  if (saveFile) {
+    ramStorage = getRam();
+    ramData = ramStorage.data();
+    saveFile.reset();
+  }
+
+  saveFile = std::make_unique<SaveFile>(path, ramSize, ramData, flushInterval);
+  ramData = saveFile->getData();
+  // In-memory copy is not needed anymore.
+  Binary{}.swap(ramStorage);
+  rehashRAM();
+
+  // Bank pointers still point to the old memory.
+  updateMapping();
+  return !saveFile->wasCreated();
+}
+
+void Cartridge::flushSaveFile() {
+  if (saveFile) {
+    saveFile->requestFlush();
+  }
+}
+
+bool Cartridge::hasSaveFile() const {
+  return saveFile != nullptr;
+}
+
+RTC* Cartridge::getRTC() {
+  return nullptr;
+}
+
+void Cartridge::saveState(state::Writer& writer) const {
+  writer.beginSection("CART");
+  writer.put32(ramSize);
+  writer.putBytes(ramData, ramSize);
+  saveRegisters(writer);
+  writer.endSection();
+}
+
+void Cartridge::loadState(state::Reader& reader) {
+  reader.requireSection("CART");
+  if (reader.get32() != ramSize) {
+    throw std::runtime_error("Save state has a different cartridge RAM size!");
+  }
+  const word* data = reader.viewBytes(ramSize);
+#ifdef GB_STATE_HASH
+  ramHash = state::updateMemoryHash(ramHash, ramData, data, ramSize, state::CARTRIDGE_RAM_POSITION);
+#endif
+  // Only banks that changed are copied, so that loading a state (e.g. on
+  // each run-ahead) does not make a save file write RAM to disk for nothing.
+  for (std::size_t offset = 0; offset < ramSize; offset += RAM_BANK_SIZE) {
+    const std::size_t length = std::min<std::size_t>(RAM_BANK_SIZE, ramSize - offset);
+    if (std::equal(data + offset, data + offset + length, ramData + offset)) {
+      continue;
+    }
+    std::copy(data + offset, data + offset + length, ramData + offset);
+    if (saveFile) {
+      saveFile->markDirty();
+    }
+  }
+
+  loadRegisters(reader);
+  updateMapping();
+}
+
+std::uint64_t Cartridge::stateHash() const {
+  // Registers take a few bytes, they are hashed right away.
+  std::array<word, 256> registers;
+  state::Writer writer{ registers.data(), registers.size() };
+  saveRegisters(writer);
+  const std::uint64_t registerHash = state::hash(registers.data(), writer.size());
+
+#ifdef GB_STATE_HASH
+  return ramHash ^ registerHash;
+#else
+  return state::memoryHash(ramData, ramSize, state::CARTRIDGE_RAM_POSITION) ^ registerHash;
+#endif
+}
+
+// Controller interface ////////////////////////////////////////////////////////
+word Cartridge::readUnmapped(const dword) const {
+  // Invalid read, returns 0xFF.
+  return 0xFF;
+}
+
+void Cartridge::writeUnmapped(const dword, const word) {
+  // Ignore write
+}
+
+void Cartridge::saveRegisters(state::Writer&) const {
+  // No registers
+}
+
+void Cartridge::loadRegisters(state::Reader&) {
+  // No registers
+}
+
+unsigned int Cartridge::getROMBankCount() const {
+  return romSize / ROM_BANK_SIZE;
+}
+
+unsigned int Cartridge::getRAMBankCount() const {
+  // RAM smaller than a full bank (2KiB) still counts as one bank.
+  return (ramSize + RAM_BANK_SIZE - 1) / RAM_BANK_SIZE;
+}
+
+void Cartridge::mapLowROMBank(const unsigned int bank) {
+  lowROMBank = rom + (bank % getROMBankCount()) * ROM_BANK_SIZE;
+}
+
+void Cartridge::mapHighROMBank(const unsigned int bank) {
+  highROMBank = rom + (bank % getROMBankCount()) * ROM_BANK_SIZE;
+}
+
+void Cartridge::mapRAMBank(const unsigned int bank) {
+  if (ramSize == 0) {
+    unmapRAM();
+    return;
+  }
+
+  // Smaller RAM gets mirrored across the whole region.
+  RAMAddressMask = ramSize < RAM_BANK_SIZE ? ramSize - 1 : RAM_BANK_SIZE - 1;
+  RAMBank = ramData + (bank % getRAMBankCount()) * RAM_BANK_SIZE;
 }
 
-const Binary& Cartridge::getRam() {
-  return ram;
+void Cartridge::unmapRAM() {
+  RAMBank = nullptr;
 }
 
 } // namespace gb
\ No newline at end of file
@@ -1,4 +1,12 @@
 #include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "rom-image.hpp"
+#include "save-file.hpp"
+#include "state-hash.hpp"
 #include "types.hpp"
 
 #ifndef CARTRIDGE_H
@@ -6,16 +14,25 @@
 
 namespace gb {
 
+class RTC;
+namespace state {
+class Writer;
+class Reader;
+}
 
-// Todo this code should be refactored.
-//  Cartridge should just be a normal class,
-//  and I should add the abstract class "Controller", with all its derivatives MBC0, MBC1...
-//  Since I am supporting only a few cartridges, this is fine for now.
-
+// Cartridge holds ROM and RAM data, and the current bank mapping: which
+// ROM bank is visible at $0000-$3FFF and $4000-$7FFF, and which RAM bank
+// (if any) is visible at $A000-$BFFF. All data reads and writes are served
+// straight from these bank pointers, without any virtual call.
+//
 // To implement new cartridge types, one must create the respective hpp file in
 // the Controllers folder. Then, include it in cartridge-types.hpp (so that
-// it gets compiled properly). Then, implement all the pure virtual methods
-// and it's done.
+// it gets compiled properly). Controllers only need to describe how their
+// registers work: writeRegister() gets called for each write to $0000-$7FFF,
+// and updateMapping() has to map banks (see mapLowROMBank and the others)
+// according to the registers. Anything that is not plain RAM (e.g. MBC2
+// internal RAM or MBC3 RTC registers) can be handled by overriding
+// readUnmapped()/writeUnmapped(), which get called when no RAM bank is mapped.
 // Expect to find a few hardcoded values in the various mbc implementations
 // (mostly for special addresses). These are all taken stright out of
 // the documentation and I believe they make it easier to read and write
@@ -24,6 +41,8 @@ class Cartridge {
  public:
   // Size in bytes of a single rom bank
   static constexpr unsigned int ROM_BANK_SIZE{0x4000u};
+  // Size in bytes of a single (full) ram bank
+  static constexpr unsigned int RAM_BANK_SIZE{0x2000u};
   // A cartridge needs to be at least 2 rom banks long
   static constexpr unsigned int MIN_ROM_BANKS{2};
 
@@ -44,6 +63,10 @@ class Cartridge {
 
     Header() = delete;
     explicit Header(const Binary& rom);
+    explicit Header(const ROMImage& rom);
+
+   private:
+    Header(const word* rom, std::size_t size);
   };
 
   // MCB Type is defined by a number in cartridge header. These are all known types.
@@ -81,40 +104,163 @@ class Cartridge {
   } MBCType;
 
   static MBCType getMBC(const Binary& rom);
+  static MBCType getMBC(const ROMImage& rom);
 
   // Constructors //////////////////////////////////////////////////////////////
   Cartridge() = delete;
-  explicit Cartridge(const Binary& rom);
+  // ROM data is not copied: it is shared with everyone else holding it.
+  explicit Cartridge(std::shared_ptr<const ROMImage> rom);
 
   // This prevents some possible undefined behavior when using smart pointers and inheritance.
   // (This happens when we call the destructor of the base class on an element that is of a derived class).
   virtual ~Cartridge() = default;
 
-  // And since we are manually defining a destructor, we need to respect the
-  // rule of five and also manually define the others...
-  Cartridge(const Cartridge& copyFrom) = default;
-  Cartridge& operator=(const Cartridge& copyFrom) = default;
-  Cartridge(Cartridge &&) = default;
-  Cartridge& operator=(Cartridge &&) = default;
+  // Bank pointers point inside this object, so it can not be copied
+  // or moved around.
+  Cartridge(const Cartridge& copyFrom) = delete;
+  Cartridge& operator=(const Cartridge& copyFrom) = delete;
   //////////////////////////////////////////////////////////////////////////////
 
-  // These methods get called by addressBus whenever a read/write occurs in ROM region.
-  const Binary& getRom();
-  virtual word read(dword address) = 0;
-  virtual void write(dword address, word value) = 0;
+  // These methods get called by addressBus whenever a read/write occurs in
+  // ROM or cartridge RAM region.
+  inline word read(const dword address) const {
+    assert((address < CART_ROM_UPPER_BOUND || (CART_RAM_UPPER_BOUND > address && address >= CART_RAM_LOWER_BOUND))
+           && "Cartridge was asked to read outside of its memory!");
+
+    if (address < ROM_BANK_SIZE) {
+      return lowROMBank[address];
+    }
+
+    if (address < CART_ROM_UPPER_BOUND) {
+      return highROMBank[address - ROM_BANK_SIZE];
+    }
+
+    if (RAMBank != nullptr) {
+      return RAMBank[(address - CART_RAM_LOWER_BOUND) & RAMAddressMask];
+    }
+
+    return readUnmapped(address);
+  }
+
+  inline void write(const dword address, const word value) {
+    assert((address < CART_ROM_UPPER_BOUND || (CART_RAM_UPPER_BOUND > address && address >= CART_RAM_LOWER_BOUND))
+           && "Cartridge was asked to write outside of its memory!");
+
+    // Writes to ROM are sent to controller registers.
+    if (address < CART_ROM_UPPER_BOUND) {
+      writeRegister(address, value);
+      updateMapping();
+      return;
+    }
+
+    if (RAMBank != nullptr) {
+      writeRAM(static_cast<std::size_t>(RAMBank - ramData) + ((address - CART_RAM_LOWER_BOUND) & RAMAddressMask), value);
+      return;
+    }
+
+    writeUnmapped(address, value);
+  }
 
+  const ROMImage& getRom() const;
+  // Shared handle to ROM, to create more cartridges without copying it.
+  const std::shared_ptr<const ROMImage>& getRomImage() const;
   const Header& getHeader() const;
   void loadBatteryBackedRAM(Binary newRam);
-  const Binary& getRam();
+  // Copy of current RAM content.
+  Binary getRam() const;
+  // Current RAM content, without copying. The pointer changes when RAM
+  // moves to a save file.
+  const word* getRamData() const;
+  std::size_t getRamSize() const;
+
+  // Move RAM inside a save file (see SaveFile). Current RAM
+  // content is used to create the file if it does not exist, otherwise it
+  // gets replaced by the file content.
+  // @return true if an existing save file was loaded.
+  // @throws if the file can not be used (e.g. it has the wrong size).
+  bool attachSaveFile(const std::string& path, std::chrono::milliseconds flushInterval);
+  // Have RAM written to disk in background now, if it lives in a save file.
+  void flushSaveFile();
+  bool hasSaveFile() const;
+
+  // Real time clock, if the cartridge has one.
+  virtual RTC* getRTC();
+
+  // Save state section (see save-state.hpp): RAM and controller registers.
+  // @throws if the state was saved with a different RAM size.
+  void saveState(state::Writer& writer) const;
+  void loadState(state::Reader& reader);
+  // Hash of RAM and controller registers (see Gameboy::stateHash).
+  std::uint64_t stateHash() const;
 
  private:
   Header header;
 
+  // Current mapping. RAMBank is nullptr when RAM is not mapped.
+  const word* lowROMBank{ nullptr };
+  const word* highROMBank{ nullptr };
+  word* RAMBank{ nullptr };
+  dword RAMAddressMask{ RAM_BANK_SIZE - 1 };
+
+  // RAM lives here, unless it has been moved inside a save file.
+  Binary ramStorage;
+  std::unique_ptr<SaveFile> saveFile;
+  // Hash of RAM (see state-hash.hpp), if GB_STATE_HASH is defined.
+  std::uint64_t ramHash{ 0 };
+
+  // After RAM content gets replaced as a whole.
+  void rehashRAM();
+
  protected:
-  Binary rom;
-  std::vector<word> ram;
+  // ROM is kept alive by image; rom points to its data.
+  std::shared_ptr<const ROMImage> image;
+  const word* rom;
+  std::size_t romSize;
+  // Points either to ramStorage or to the save file mapping.
+  word* ramData{ nullptr };
+  std::size_t ramSize{ 0 };
 
   void setRAMSize();
+  // Replace RAM with size bytes of zeroed memory.
+  void allocateRAM(std::size_t size);
+  // For RAM writes not going through a mapped bank.
+  inline void writeRAM(const std::size_t offset, const word value) {
+#ifdef GB_STATE_HASH
+    const std::uint64_t position = state::CARTRIDGE_RAM_POSITION + offset;
+    ramHash ^= state::byteHash(position, ramData[offset]) ^ state::byteHash(position, value);
+#endif
+    ramData[offset] = value;
+    if (saveFile) {
+      saveFile->markDirty();
+    }
+  }
+
+  // Controller interface //////////////////////////////////////////////////////
+  // Update controller registers. Called for each write to $0000-$7FFF.
+  virtual void writeRegister(dword address, word value) = 0;
+  // Map banks according to registers. Called after each register write;
+  // controllers also have to call this once in their constructor.
+  virtual void updateMapping() = 0;
+  // Called when $A000-$BFFF is accessed and no RAM bank is mapped.
+  // By default, reads return $FF and writes are ignored.
+  virtual word readUnmapped(dword address) const;
+  virtual void writeUnmapped(dword address, word value);
+  // Save and load controller registers, for save states. Mapping gets
+  // updated after loading. Controllers with no registers do not need these.
+  virtual void saveRegisters(state::Writer& writer) const;
+  virtual void loadRegisters(state::Reader& reader);
+
+  // Mapping helpers. Bank numbers wrap around the number of banks that
+  // are actually present (as if unused upper bank bits were not connected).
+  void mapLowROMBank(unsigned int bank);
+  void mapHighROMBank(unsigned int bank);
+  // Does nothing but unmap RAM if the cartridge has none.
+  void mapRAMBank(unsigned int bank);
+  void unmapRAM();
+
+  unsigned int getROMBankCount() const;
+  unsigned int getRAMBankCount() const;
+  //////////////////////////////////////////////////////////////////////////////
 };
 
 }
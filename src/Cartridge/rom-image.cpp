@@ -0,0 +1,83 @@
+#include "rom-image.hpp"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ROM_IMAGE_USE_MMAP
+#endif
+
+namespace gb {
+
+// Constructor /////////////////////////////////////////////////////////////////
+std::shared_ptr<const ROMImage> ROMImage::fromFile(const std::string& path) {
+#ifdef ROM_IMAGE_USE_MMAP
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Error reading ROM file!");
+  }
+
+  struct stat info{};
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    close(fd);
+    throw std::runtime_error("Error reading ROM file!");
+  }
+
+  const auto length = static_cast<std::size_t>(info.st_size);
+  void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  // Mapping stays valid after the file is closed.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Error mapping ROM file to memory!");
+  }
+
+  std::shared_ptr<ROMImage> image{ new ROMImage{} };
+  image->mapping = mapping;
+  image->mappingLength = length;
+  image->bytes = static_cast<const word*>(mapping);
+  image->length = length;
+  return image;
+#else
+  // No mmap available: just read the whole file.
+  std::ifstream input(path, std::ios_base::binary);
+  if (input.fail()) {
+    throw std::runtime_error("Error reading ROM file!");
+  }
+
+  return fromBinary(Binary{std::istreambuf_iterator<char>(input), {}});
+#endif
+}
+
+std::shared_ptr<const ROMImage> ROMImage::fromBinary(const Binary& rom) {
+  std::shared_ptr<ROMImage> image{ new ROMImage{} };
+  image->copy = rom;
+  image->bytes = image->copy.data();
+  image->length = image->copy.size();
+  return image;
+}
+
+std::shared_ptr<const ROMImage> ROMImage::fromMemory(const word* data, const std::size_t size) {
+  std::shared_ptr<ROMImage> image{ new ROMImage{} };
+  image->bytes = data;
+  image->length = size;
+  return image;
+}
+
+ROMImage::~ROMImage() {
+#ifdef ROM_IMAGE_USE_MMAP
+  if (mapping != nullptr) {
+    munmap(mapping, mappingLength);
+  }
+#endif
+}
+
+// Methods /////////////////////////////////////////////////////////////////////
+bool ROMImage::isMapped() const {
+  return mapping != nullptr;
+}
+
+}  // namespace gb
@@ -0,0 +1,63 @@
+#ifndef ROM_IMAGE_H
+#define ROM_IMAGE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "types.hpp"
+
+namespace gb {
+
+// Immutable ROM data, shared between all the cartridges (and so, all the
+// Gameboy instances) that run the same game.
+// When loaded from file, the ROM is memory-mapped (read-only, private):
+// pages are only read from disk when they are first accessed, and all the
+// instances share the same physical memory.
+class ROMImage {
+  const word* bytes{ nullptr };
+  std::size_t length{ 0 };
+
+  // File mapping or private copy of the data, if the image owns its data.
+  void* mapping{ nullptr };
+  std::size_t mappingLength{ 0 };
+  Binary copy;
+
+  ROMImage() = default;
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // Map ROM file to memory.
+  // @throws if the file can not be opened or mapped, or if it is empty.
+  static std::shared_ptr<const ROMImage> fromFile(const std::string& path);
+  // Copy ROM data.
+  static std::shared_ptr<const ROMImage> fromBinary(const Binary& rom);
+  // Use ROM data in place, e.g. in memory shared between processes. Data is
+  // not copied, and must outlive the image.
+  static std::shared_ptr<const ROMImage> fromMemory(const word* data, std::size_t size);
+
+  ~ROMImage();
+
+  ROMImage(const ROMImage&) = delete;
+  ROMImage& operator=(const ROMImage&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline const word* data() const {
+    return bytes;
+  }
+
+  inline std::size_t size() const {
+    return length;
+  }
+
+  inline word operator[](const std::size_t address) const {
+    return bytes[address];
+  }
+
+  // Whether data is memory-mapped from a file (by fromFile()).
+  bool isMapped() const;
+};
+
+}  // namespace gb
+
+#endif  // ROM_IMAGE_H
@@ -0,0 +1,233 @@
+#include "save-file.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SAVE_FILE_USE_MMAP
+#endif
+
+namespace gb {
+
+#ifdef SAVE_FILE_USE_MMAP
+namespace {
+
+// Write all of data to a new file, and only then give it the name of the
+// file at path, which is replaced. The file at path is always whole: either
+// the old one, or the new one.
+// @return false if the file could not be written (the old one is kept).
+bool replaceFile(const std::string& path, const word* data, const std::size_t size) {
+  const std::string temporaryPath = path + ".tmp";
+  const int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  std::size_t written{ 0 };
+  while (written != size) {
+    const auto result = write(fd, data + written, size - written);
+    if (result <= 0) {
+      close(fd);
+      std::remove(temporaryPath.c_str());
+      return false;
+    }
+    written += static_cast<std::size_t>(result);
+  }
+
+  const bool synced = fsync(fd) == 0;
+  close(fd);
+  if (!synced || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    std::remove(temporaryPath.c_str());
+    return false;
+  }
+
+  // The new name only reaches the disk with its directory. Not all file
+  // systems support this: the file itself is whole anyway.
+  const auto separator = path.rfind('/');
+  const std::string directory = separator == std::string::npos ? "." : path.substr(0, separator + 1);
+  const int directoryFd = open(directory.c_str(), O_RDONLY);
+  if (directoryFd >= 0) {
+    fsync(directoryFd);
+    close(directoryFd);
+  }
+  return true;
+}
+
+bool readFile(const std::string& path, word* data, const std::size_t size) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  std::size_t done{ 0 };
+  while (done != size) {
+    const auto result = read(fd, data + done, size - done);
+    if (result <= 0) {
+      close(fd);
+      return false;
+    }
+    done += static_cast<std::size_t>(result);
+  }
+  close(fd);
+  return true;
+}
+
+// Name of the shared memory holding RAM of the save file at path. The same
+// file gets the same name, however its path is written. Names are kept
+// short, as some systems only allow 31 characters.
+std::string memoryNameOf(const std::string& path) {
+  char* resolved = realpath(path.c_str(), nullptr);
+  const std::string absolutePath = resolved != nullptr ? resolved : path;
+  std::free(resolved);
+
+  // FNV-1a
+  std::uint64_t hash{ 0xCBF29CE484222325 };
+  for (const char c : absolutePath) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3;
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "/gb-save-%016llx", static_cast<unsigned long long>(hash));
+  return name;
+}
+
+}  // namespace
+#endif
+
+// Constructor /////////////////////////////////////////////////////////////////
+SaveFile::SaveFile(const std::string& path, const std::size_t size, const word* initialData,
+                   const std::chrono::milliseconds flushInterval)
+  : size{ size }
+  , path{ path }
+  , interval{ flushInterval } {
+#ifdef SAVE_FILE_USE_MMAP
+  if (size == 0) {
+    throw std::runtime_error("Cartridge has no RAM to save.");
+  }
+
+  struct stat info{};
+  if (stat(path.c_str(), &info) != 0) {
+    if (!replaceFile(path, initialData, size)) {
+      throw std::runtime_error("Error creating save file!");
+    }
+    created = true;
+  } else if (static_cast<std::size_t>(info.st_size) != size) {
+    throw std::runtime_error("Trying to load a save game of invalid size for this cartridge!");
+  }
+
+  // Memory left behind for a file that was deleted since does not belong to
+  // the new one.
+  memoryName = memoryNameOf(path);
+  if (created) {
+    shm_unlink(memoryName.c_str());
+  }
+  fd = shm_open(memoryName.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("Error creating save file memory!");
+  }
+  struct stat memoryInfo{};
+  const bool recovered = fstat(fd, &memoryInfo) == 0 && static_cast<std::size_t>(memoryInfo.st_size) == size;
+  if (!recovered && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    shm_unlink(memoryName.c_str());
+    throw std::runtime_error("Error creating save file memory!");
+  }
+
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    close(fd);
+    shm_unlink(memoryName.c_str());
+    throw std::runtime_error("Error mapping save file to memory!");
+  }
+  data = static_cast<word*>(mapping);
+
+  // RAM recovered from an emulator that did not close is newer than the
+  // file, and has to reach the disk.
+  if (recovered) {
+    dirty = true;
+  } else if (!readFile(path, data, size)) {
+    munmap(data, size);
+    close(fd);
+    shm_unlink(memoryName.c_str());
+    throw std::runtime_error("Error reading save file!");
+  }
+
+  // Thread is started last, so that everything else is initialized
+  flusher = std::thread{ &SaveFile::run, this };
+#else
+  (void)initialData;
+  throw std::runtime_error("Save files in shared memory are not supported on this platform.");
+#endif
+}
+
+SaveFile::~SaveFile() {
+#ifdef SAVE_FILE_USE_MMAP
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    stopping = true;
+  }
+  wakeUp.notify_one();
+  flusher.join();
+
+  // If RAM can not be written, it is kept in memory for the next run.
+  flush();
+  munmap(data, size);
+  close(fd);
+  if (!dirty) {
+    shm_unlink(memoryName.c_str());
+  }
+#endif
+}
+
+// Methods /////////////////////////////////////////////////////////////////////
+bool SaveFile::wasCreated() const {
+  return created;
+}
+
+void SaveFile::flush() {
+#ifdef SAVE_FILE_USE_MMAP
+  std::lock_guard<std::mutex> lock{ flushMutex };
+  if (!dirty.exchange(false, std::memory_order_acquire)) {
+    return;
+  }
+
+  // RAM written from here on goes to the next flush.
+  if (!replaceFile(path, data, size)) {
+    dirty = true;
+    return;
+  }
+  ++flushCount;
+#endif
+}
+
+void SaveFile::requestFlush() {
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    flushRequested = true;
+  }
+  wakeUp.notify_one();
+}
+
+unsigned long long SaveFile::getFlushCount() const {
+  return flushCount.load();
+}
+
+void SaveFile::run() {
+  std::unique_lock<std::mutex> lock{ mutex };
+  while (!stopping) {
+    wakeUp.wait_for(lock, interval, [this]() { return stopping || flushRequested; });
+    if (stopping) {
+      break;
+    }
+    flushRequested = false;
+
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+}  // namespace gb
@@ -0,0 +1,99 @@
+#ifndef SAVE_FILE_H
+#define SAVE_FILE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "types.hpp"
+
+namespace gb {
+
+// Battery-backed cartridge RAM, kept in a save file. RAM itself lives in
+// shared memory named after the file, which outlives the emulator but not
+// the system: if the emulator crashes, the next one to open the file picks
+// RAM up from there, and nothing is lost.
+//
+// A background thread writes RAM to disk at a fixed interval, if it
+// changed. The whole file gets replaced at once: RAM is written to a
+// temporary file, which then takes the place of the save file. After a
+// system crash, the file holds RAM as it was at one flush, never a mix of
+// two. New save files are created the same way.
+class SaveFile {
+  word* data{ nullptr };
+  std::size_t size;
+  std::string path;
+  std::string memoryName;
+  int fd{ -1 };
+  bool created{ false };
+
+  // Whether RAM was written since the last flush.
+  std::atomic<bool> dirty{ false };
+  // Flushes from different threads must not share the temporary file.
+  std::mutex flushMutex;
+
+  std::chrono::milliseconds interval;
+  std::atomic<unsigned long long> flushCount{ 0 };
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool stopping{ false };
+  bool flushRequested{ false };
+  std::thread flusher;
+
+  // Background thread main loop.
+  void run();
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // Open save file at path, which has to be exactly size bytes long. If it
+  // does not exist, it gets created with initialData as content. RAM left in
+  // memory by an emulator that did not close takes the place of the file
+  // content.
+  // @throws if the file or its memory can not be created, read or mapped, if
+  // it has a different size or if shared memory is not supported on this
+  // platform.
+  SaveFile(const std::string& path, std::size_t size, const word* initialData,
+           std::chrono::milliseconds flushInterval);
+  // Flushes everything before closing. RAM is dropped from memory once it
+  // is safely on disk.
+  ~SaveFile();
+
+  SaveFile(const SaveFile&) = delete;
+  SaveFile& operator=(const SaveFile&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline word* getData() const {
+    return data;
+  }
+
+  inline std::size_t getSize() const {
+    return size;
+  }
+
+  // Whether the file did not exist and was created.
+  bool wasCreated() const;
+
+  // To be called after writing to data.
+  inline void markDirty() {
+    // A plain store: unlike checking first, it can not be lost to a flush
+    // that is clearing the flag at the same time.
+    dirty.store(true, std::memory_order_release);
+  }
+
+  // Write RAM to disk now, if it changed. Safe to call from any thread.
+  // If writing fails, RAM stays dirty, and the next flush tries again.
+  void flush();
+  // Have the background thread write RAM to disk as soon as possible,
+  // without waiting for it.
+  void requestFlush();
+  // Number of times RAM has been written to disk.
+  unsigned long long getFlushCount() const;
+};
+
+}  // namespace gb
+
+#endif  // SAVE_FILE_H
@@ -17,16 +17,18 @@ constexpr int Frontend::width;
 constexpr int Frontend::height;
 constexpr int Frontend::colorChannels;
 constexpr int Frontend::maxColorDepth;
+constexpr int Frontend::runAheadReportInterval;
 
 // Constructor /////////////////////////////////////////////////////////////////
 Frontend::Frontend(const std::string& romPath)
-  : gameboy{ getROM(romPath)}
+  : gameboy{ ROMImage::fromFile(romPath) }
+  , rewind{ gameboy.stateSize(), rewindMemory }
 {
   texture.create(160, 144);
   sprite.setTexture(texture);
 
   savePath = romPath + ".sav";
-  loadSave();
+  clockPath = romPath + ".rtc";
 }
 
 // Methods /////////////////////////////////////////////////////////////////////
@@ -34,6 +36,9 @@ void Frontend::handleEvent(const sf::Event& event) {
   if (event.type == sf::Event::Closed) {
     // Close window. This will end the loop and close simulation.
     window.close();
+    if (recorder) {
+      recorder->finish(gameboy);
+    }
     saveGame();
     exit(EXIT_SUCCESS);
   }
@@ -45,6 +50,14 @@ void Frontend::handleEvent(const sf::Event& event) {
     return;
   }
 
+  // Playback controls the joypad.
+  if (player) {
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::K)) {
+      capSpeed = !capSpeed;
+    }
+    return;
+  }
+
   if (sf::Keyboard::isKeyPressed(sf::Keyboard::L)) {
     saveGame();
     return;
@@ -74,20 +87,11 @@ void Frontend::handleEvent(const sf::Event& event) {
   joypad[1] = lArrowUp;
   joypad[0] = rArrowUp;
 
-  gameboy.setJoypad(joypad.to_ulong());
-}
-
-Binary Frontend::getROM(const std::string& romPath) {
-  std::ifstream input(romPath, std::ios_base::binary);
-
-  if (input.fail()) {
-    throw std::runtime_error("Error reading ROM file!");
+  if (recorder) {
+    recorder->setJoypad(gameboy, joypad.to_ulong());
+  } else {
+    gameboy.setJoypad(joypad.to_ulong());
   }
-
-  // Copy all data to ROM, it's faster than reading from file each time.
-  const auto rom = Binary{std::istreambuf_iterator<char>(input), {}};
-
-  return rom;
 }
 
 void Frontend::loadSave() {
@@ -95,6 +99,30 @@ void Frontend::loadSave() {
     return;
   }
 
+  loadClock();
+  // Some cartridges only have a battery for their clock.
+  std::size_t ramSize{ 0 };
+  gameboy.viewSave(ramSize);
+  if (ramSize == 0) {
+    return;
+  }
+
+  // Prefer keeping RAM directly inside the save file, so that progress is
+  // not lost even if the emulator does not get to close properly.
+  try {
+    usingSaveFile = true;
+    if (gameboy.useSaveFile(savePath)) {
+      std::cout << "Save file loaded!" << std::endl;
+      gameboy.skipBoot();
+    } else {
+      std::cout << "No save file to load." << std::endl;
+    }
+    return;
+  } catch (const std::exception& error) {
+    usingSaveFile = false;
+    std::cerr << "Save file can not be mapped (" << error.what() << "), falling back to copies." << std::endl;
+  }
+
   std::ifstream input(savePath, std::ios_base::binary);
 
   if (input.fail()) {
@@ -110,21 +138,44 @@ void Frontend::loadSave() {
 }
 
 void Frontend::updateTexture() {
-  // We need to copy this data to RGB format.
-  const auto buffer = gameboy.screenBuffer;
+  // If lines are being drawn on a separate thread, wait for them.
+  gameboy.waitForRenderer();
+
+  // Static screens are very common, there is no need to do anything if
+  // nothing changed since last time the texture was updated.
+  const auto framesDrawn = gameboy.getFramesDrawn();
+  const bool changed = gameboy.getLastChangedFrame() > presentedFrame;
+  // If exactly one frame was drawn in between, only its dirty lines need
+  // to be converted. Otherwise, convert everything.
+  const bool onlyDirtyLines = textureInitialized && framesDrawn == presentedFrame + 1;
+  presentedFrame = framesDrawn;
+  if (textureInitialized && !changed) {
+    return;
+  }
+  textureInitialized = true;
+
+  const auto& buffer = gameboy.screenBuffer;
+  const auto& dirtyLines = gameboy.getDirtyLines();
 
+  // We need to copy this data to RGB format.
   // This is an arbitrary conversion. It looks nice this way.
-  for (int bufferPosition = 0; bufferPosition != (width * height); ++bufferPosition) {
-    const int pixelPosition = bufferPosition * colorChannels;
-    const auto currentColor = buffer[bufferPosition].to_ulong();
+  for (int y = 0; y != height; ++y) {
+    if (onlyDirtyLines && !dirtyLines[y]) {
+      continue;
+    }
 
-    // Each different color is a shade of gray
-    pixels[pixelPosition + 0] = (maxColorDepth - currentColor) * shadeWidth;
-    pixels[pixelPosition + 1] = (maxColorDepth - currentColor) * shadeWidth;
-    pixels[pixelPosition + 2] = (maxColorDepth - currentColor) * shadeWidth;
+    for (int bufferPosition = y * width; bufferPosition != (y + 1) * width; ++bufferPosition) {
+      const int pixelPosition = bufferPosition * colorChannels;
+      const auto currentColor = buffer[bufferPosition];
 
-    // We set opacity to max (NO opacity)
-    pixels[pixelPosition + 3] = 255;
+      // Each different color is a shade of gray
+      pixels[pixelPosition + 0] = (maxColorDepth - currentColor) * shadeWidth;
+      pixels[pixelPosition + 1] = (maxColorDepth - currentColor) * shadeWidth;
+      pixels[pixelPosition + 2] = (maxColorDepth - currentColor) * shadeWidth;
+
+      // We set opacity to max (NO opacity)
+      pixels[pixelPosition + 3] = 255;
+    }
   }
   texture.update(pixels);
 }
@@ -141,20 +192,120 @@ void Frontend::drawScreen() {
   window.display();
 }
 
+void Frontend::drawRunAhead() {
+  const auto startTime = std::chrono::steady_clock::now();
+  gameboy.saveState(runAheadState.data(), runAheadState.size());
+  // Serial output is not part of the state: what hidden frames send would
+  // be printed twice.
+  const std::size_t serialSize = gameboy.serialBuffer.size();
+
+  // Only the last frame is shown, there is no need to draw the others.
+  for (int frame = 0; frame != runAheadFrames; ++frame) {
+    gameboy.setRenderingEnabled(frame == runAheadFrames - 1);
+    for (int i = 0; i != displayInterval; ++i) {
+      gameboy.machineClock();
+    }
+  }
+  gameboy.setRenderingEnabled(false);
+  drawScreen();
+
+  gameboy.loadState(runAheadState.data(), runAheadState.size());
+  gameboy.serialBuffer.resize(serialSize);
+
+  // Drawing is not counted, as it happens anyway.
+  runAheadTime += std::chrono::steady_clock::now() - startTime;
+  if (++runAheadSamples != runAheadReportInterval) {
+    return;
+  }
+
+  using namespace std::chrono;
+  const auto average = duration_cast<duration<double, std::milli>>(runAheadTime) / runAheadSamples;
+  const auto frameTime = duration_cast<duration<double, std::milli>>(machineClockInterval * displayInterval);
+  std::cout << "Run-ahead: " << average.count() << " ms per frame (" << 100 * average / frameTime
+            << "% of a frame)." << std::endl;
+  runAheadTime = steady_clock::duration{0};
+  runAheadSamples = 0;
+}
+
+void Frontend::startMovie() {
+  if (!playPath.empty()) {
+    player = std::make_unique<MoviePlayer>(playPath);
+    player->start(gameboy);
+    std::cout << "Playing movie (" << player->getFrameCount() << " frames)." << std::endl;
+    // Hidden frames would not get the movie inputs.
+    if (runAheadFrames != 0) {
+      std::cout << "Run-ahead is disabled while playing a movie." << std::endl;
+      setRunAhead(0);
+    }
+    return;
+  }
+
+  if (!recordPath.empty()) {
+    recorder = std::make_unique<MovieRecorder>(recordPath, gameboy);
+    std::cout << "Recording movie." << std::endl;
+  }
+}
+
 void Frontend::saveGame() {
-  if (!gameboy.shouldSave()) {
+  // Progress belongs to the movie being played, not to the save file.
+  if (player || !gameboy.shouldSave()) {
+    return;
+  }
+
+  saveClock();
+  std::size_t ramSize{ 0 };
+  const word* ram = gameboy.viewSave(ramSize);
+  if (ramSize == 0) {
+    return;
+  }
+
+  // Save file is already up-to-date, it only needs to reach the disk.
+  if (usingSaveFile) {
+    gameboy.flushSave();
     return;
   }
 
-  const auto ram = gameboy.getSave();
   std::ofstream output(savePath, std::ios_base::binary);
   if (output.fail()) {
     std::cerr << "Error writing save file!" << std::endl;
     return;
   }
 
-  // Copy all data to ROM, it's faster than reading from file.
-  output.write((char*)&ram[0], static_cast<int>(ram.size()));
+  output.write(reinterpret_cast<const char*>(ram), static_cast<std::streamsize>(ramSize));
+}
+
+void Frontend::loadClock() {
+  if (!gameboy.hasRTC()) {
+    return;
+  }
+
+  std::ifstream input(clockPath, std::ios_base::binary);
+  if (input.fail()) {
+    return;
+  }
+
+  // Clock keeps running while the emulator is closed.
+  const auto data = Binary{std::istreambuf_iterator<char>(input), {}};
+  try {
+    gameboy.loadRTC(data, true);
+  } catch (const std::exception& error) {
+    std::cerr << "Error loading clock file: " << error.what() << std::endl;
+  }
+}
+
+void Frontend::saveClock() {
+  if (!gameboy.hasRTC()) {
+    return;
+  }
+
+  const auto data = gameboy.getRTC();
+  std::ofstream output(clockPath, std::ios_base::binary);
+  if (output.fail()) {
+    std::cerr << "Error writing clock file!" << std::endl;
+    return;
+  }
+
+  output.write((char*)&data[0], static_cast<int>(data.size()));
 }
 
 void Frontend::mainLoop() {
@@ -170,6 +321,9 @@ void Frontend::mainLoop() {
       continue;
     }
 
+    if (player) {
+      player->apply(gameboy);
+    }
     gameboy.machineClock();
     ++cyclesSinceLastDraw;
     lastClockTime = currentTime;
@@ -184,12 +338,47 @@ void Frontend::mainLoop() {
       handleEvent(event);
     }
 
-    drawScreen();
+    // Draws happen once per frame, so this is also where frames are
+    // stored or, while backspace is held, played backwards. Movies can not
+    // go back in time.
+    if (recorder) {
+      recorder->update(gameboy);
+    } else if (player) {
+      if (player->isFinished(gameboy)) {
+        std::cout << "Movie finished." << std::endl;
+        player.reset();
+      }
+    } else if (sf::Keyboard::isKeyPressed(sf::Keyboard::BackSpace)) {
+      rewind.stepBack(gameboy);
+    } else {
+      rewind.push(gameboy);
+    }
+
+    if (runAheadFrames != 0) {
+      drawRunAhead();
+    } else {
+      drawScreen();
+    }
     gameboy.printSerialBuffer();
     cyclesSinceLastDraw = 0;
   }
 }
 
+void Frontend::setThreadedRendering(bool enabled) {
+  gameboy.setThreadedRendering(enabled);
+}
+
+void Frontend::setRunAhead(const int frames) {
+  if (frames < 0) {
+    throw std::runtime_error("Run-ahead frames can not be negative!");
+  }
+
+  runAheadFrames = frames;
+  runAheadState.resize(frames != 0 ? gameboy.stateSize() : 0);
+  // Frames that are actually shown are drawn while running ahead.
+  gameboy.setRenderingEnabled(frames == 0);
+}
+
 void Frontend::start() {
   const sf::VideoMode videoMode{ width,
                                  height };
@@ -197,8 +386,27 @@ void Frontend::start() {
 
   using namespace std::chrono;
 
+  // Movie playback starts from its own state, which includes cartridge RAM.
+  if (playPath.empty()) {
+    loadSave();
+  }
+  startMovie();
   mainLoop();
 }
 
+void Frontend::recordMovie(const std::string& path) {
+  if (!playPath.empty()) {
+    throw std::runtime_error("Can not record and play a movie at the same time!");
+  }
+  recordPath = path;
+}
+
+void Frontend::playMovie(const std::string& path) {
+  if (!recordPath.empty()) {
+    throw std::runtime_error("Can not record and play a movie at the same time!");
+  }
+  playPath = path;
+}
+
 
 }  // namespace pandemic
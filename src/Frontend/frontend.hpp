@@ -5,8 +5,11 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <memory>
 
 #include "gameboy.hpp"
+#include "movie.hpp"
+#include "rewind-buffer.hpp"
 #include "ppu.hpp"
 #include "types.hpp"
 
@@ -27,9 +30,36 @@ class Frontend {
   static constexpr int maxColorDepth{3};
   static constexpr int shadeWidth{50};
 
+  // Memory used to keep past frames (see RewindBuffer).
+  static constexpr std::size_t rewindMemory{32u << 20};
+
+  // Frames between two reports of the time spent running ahead.
+  static constexpr int runAheadReportInterval{600};
+
   // Emulator library. Gets initialized in constructor.
   Gameboy gameboy;
   std::string savePath{};
+  // MBC3 real time clock state is kept apart from RAM.
+  std::string clockPath{};
+  // Cartridge RAM lives inside the save file (see Gameboy::useSaveFile).
+  bool usingSaveFile{false};
+  // A frame is pushed on each draw, and popped while rewinding.
+  RewindBuffer rewind;
+
+  // Movie recording or playback, set up when emulation starts. Rewinding is
+  // disabled while either of them is active.
+  std::string recordPath{};
+  std::string playPath{};
+  std::unique_ptr<MovieRecorder> recorder;
+  std::unique_ptr<MoviePlayer> player;
+
+  // Run-ahead: frames emulated past the current one on each draw (so that
+  // inputs show up earlier), and the state they get rolled back to.
+  int runAheadFrames{0};
+  Binary runAheadState;
+  // Host time spent running ahead since the last report.
+  std::chrono::steady_clock::duration runAheadTime{0};
+  int runAheadSamples{0};
 
   // SFML-related members
   sf::RenderWindow window;
@@ -46,14 +76,23 @@ class Frontend {
 
   bool capSpeed{true};
 
+  // Last frame that was converted to texture (see Gameboy::getFramesDrawn).
+  unsigned long long presentedFrame{0};
+  bool textureInitialized{false};
+
   // Handle all SFML window events.
   void handleEvent(const sf::Event& event);
 
   // Update texture, sprite and screen each frame.
   void updateTexture();
   void drawScreen();
+  // Draw the frame runAheadFrames from now, then go back to the present.
+  void drawRunAhead();
 
   void loadSave();
+  void startMovie();
+  void loadClock();
+  void saveClock();
   void mainLoop();
 
  public:
@@ -64,8 +103,18 @@ class Frontend {
   // Start emulation loop
   void start();
 
-  // Load ROM data from file.
-  static Binary getROM(const std::string& romPath);
+  // Record inputs to a movie, or play them back (see Movie). Only one of
+  // them can be used, and it must be chosen before start().
+  void recordMovie(const std::string& path);
+  void playMovie(const std::string& path);
+
+  // Draw lines on a separate thread (see Gameboy::setThreadedRendering).
+  void setThreadedRendering(bool enabled);
+
+  // Show frames this far in the future, as if inputs had been pressed
+  // earlier. This hides input lag built into games, at the cost of
+  // emulating the extra frames again on each draw. 0 disables it.
+  void setRunAhead(int frames);
 
   void saveGame();
 };
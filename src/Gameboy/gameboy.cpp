@@ -1,14 +1,61 @@
 #include "gameboy.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <ctime>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include "address-bus.hpp"
 #include "cartridge.hpp"
 #include "cartridge-types.hpp"
+#include "save-state.hpp"
 
 namespace gb {
 
+namespace {
+
+// The boot ROM reads the logo and the header ($0104-$014D), nothing else.
+// Global checksum ($014E-$014F) is part of the key as well, as save states
+// check it (see loadState()).
+constexpr dword BOOT_KEY_START{ 0x0104 };
+constexpr dword BOOT_KEY_END{ 0x0150 };
+typedef std::array<word, BOOT_KEY_END - BOOT_KEY_START> BootKey;
+
+// The boot ROM takes about 7.4M clocks. Invalid headers make it hang.
+constexpr unsigned long long BOOT_CLOCK_LIMIT{ 1ull << 24 };
+
+// Machine states at power on (see Gameboy::hardReset) and at the end of the
+// boot ROM (see Gameboy::boot), shared by all machines of the process.
+typedef std::map<BootKey, std::shared_ptr<const Binary>> SnapshotCache;
+std::mutex snapshotMutex;
+SnapshotCache powerOnSnapshots;
+SnapshotCache bootSnapshots;
+
+BootKey bootKey(const Cartridge& cart) {
+  BootKey key;
+  const word* rom = cart.getRom().data();
+  std::copy(rom + BOOT_KEY_START, rom + BOOT_KEY_END, key.begin());
+  return key;
+}
+
+std::shared_ptr<const Binary> findSnapshot(const SnapshotCache& cache, const BootKey& key) {
+  std::lock_guard<std::mutex> lock{ snapshotMutex };
+  const auto found = cache.find(key);
+  return found != cache.end() ? found->second : nullptr;
+}
+
+void storeSnapshot(SnapshotCache& cache, const BootKey& key, std::shared_ptr<const Binary> snapshot) {
+  std::lock_guard<std::mutex> lock{ snapshotMutex };
+  cache.emplace(key, std::move(snapshot));
+}
+
+}  // namespace
+
+constexpr std::size_t Gameboy::SERIAL_BUFFER_CAPACITY;
+
 /**
  * Requests an interrupt to the CPU by enabling its corresponding flag to true.
  * @param interrupt ID (Interrupt flag bit) of the interrupt to request.
@@ -22,13 +69,22 @@ void Gameboy::requestInterrupt(INTERRUPT_ID interrupt) {
  * Instantiate the emulator with given ROM inserted. Emulation will start at
  * $0000 and go through the boot rom; then, it will load the game
  * (exactly as the original hardware did).
- * @param rom Binary ROM of a gameboy game. Has to be one of MBC0, MBC1 or MBC3
- * types. It has to be a valid gameboy ROM (only some basic checks are
+ * @param rom Binary ROM of a gameboy game. Has to be one of MBC0, MBC1, MBC2,
+ * MBC3 or MBC5 types. It has to be a valid gameboy ROM (only some basic checks are
  * performed).
  * @throws ROM binary is either invalid data or of a unsupported MBC type.
  */
-Gameboy::Gameboy(const Binary& rom) {
-  const auto mbc = Cartridge::getMBC(rom);
+Gameboy::Gameboy(const Binary& rom) : Gameboy{ ROMImage::fromBinary(rom) } {}
+
+/**
+ * Instantiate the emulator with given ROM inserted, without copying it.
+ * ROM data is shared with every other instance that is running the same
+ * image (see ROMImage::fromFile() to map a ROM file to memory).
+ * @param rom ROM image of a gameboy game (see Gameboy(const Binary&)).
+ * @throws ROM image is either invalid data or of a unsupported MBC type.
+ */
+Gameboy::Gameboy(std::shared_ptr<const ROMImage> rom) {
+  const auto mbc = Cartridge::getMBC(*rom);
 
   switch (mbc) {
     case Cartridge::MBC0:
@@ -41,16 +97,28 @@ Gameboy::Gameboy(const Binary& rom) {
       cart = std::make_unique<MBC1>(rom);
       break;
 
+    case Cartridge::MBC2:
+    case Cartridge::MBC2_BATTERY:
+      cart = std::make_unique<MBC2>(rom);
+      break;
+
     case Cartridge::MBC3:
+    case Cartridge::MBC3_RAM:
     case Cartridge::MBC3_RAM_BATTERY:
+    case Cartridge::MBC3_TIMER_BATTERY:
+    case Cartridge::MBC3_TIMER_RAM_BATTERY:
       cart = std::make_unique<MBC3>(rom);
       break;
 
-    // These are unsupported for now
-    // (Even if a timer implementation exists, it is unclear how
-    //  some writes should be handled by the cartridge).
-    case Cartridge::MBC3_TIMER_BATTERY:
-    case Cartridge::MBC3_TIMER_RAM_BATTERY:
+    case Cartridge::MBC5:
+    case Cartridge::MBC5_RAM:
+    case Cartridge::MBC5_RAM_BATTERY:
+    case Cartridge::MBC5_RUMBLE:
+    case Cartridge::MBC5_RUMBLE_RAM:
+    case Cartridge::MBC5_RUMBLE_RAM_BATTERY:
+      cart = std::make_unique<MBC5>(rom);
+      break;
+
     default:
       throw std::runtime_error("Unsupported or invalid MBC type. "
         "Check that the ROM you are using is valid and supported.");
@@ -61,6 +129,19 @@ Gameboy::Gameboy(const Binary& rom) {
   // I do not use a shared ptr here as when Gameboy dies then AddressBus dies as well.
   bus.loadCart(cart.get());
   isCartridgeBatteryBacked = cart->getHeader().isBatteryBacked;
+
+  // Real time clock follows emulated time.
+  if (cart->getRTC() != nullptr) {
+    cart->getRTC()->attachClock(&tcu.getClockCount());
+  }
+
+  serialBuffer.reserve(SERIAL_BUFFER_CAPACITY);
+}
+
+Gameboy::~Gameboy() {
+  // Render thread writes to screenBuffer, so it has to be stopped
+  // before anything else gets destroyed.
+  renderThread.reset();
 }
 
 // Methods /////////////////////////////////////////////////////////////////////
@@ -78,6 +159,111 @@ void Gameboy::machineClock() {
   ppu.machineClock();
 }
 
+/**
+ * Get the number of machine clocks since power on. This is part of save
+ * states, so it goes back when an earlier state is loaded.
+ * @return machine clock count.
+ */
+unsigned long long Gameboy::getClockCount() const {
+  return tcu.getClockCount();
+}
+
+/**
+ * Run the boot ROM until it unmaps itself, exactly as if machineClock() was
+ * called until then. The boot ROM only reads the cartridge logo and header,
+ * so the state it ends in is the same for every cartridge with the same
+ * header: that state is cached (for the whole process) the first time, and
+ * restored directly on later boots. Unlike skipBoot(), this is exact.
+ * Cartridge state (RAM, real time clock) is left as it is, as the boot ROM
+ * does not change it: save data can be loaded before booting. So are buttons
+ * set before booting (see setJoypad()). Lines drawn by the boot ROM are not
+ * drawn, nor logged, when restoring.
+ * Nothing happens if the boot ROM is not running. If the machine was already
+ * clocked, the boot ROM runs to its end without using the cache.
+ * @return true if the state was restored from cache.
+ * @throws if the boot ROM does not end (e.g. because the header is invalid).
+ */
+bool Gameboy::boot() {
+  if (!bus.isBootRomEnabled()) {
+    return false;
+  }
+
+  const bool atPowerOn = getClockCount() == 0;
+  const BootKey key = bootKey(*cart);
+
+  if (atPowerOn) {
+    const auto snapshot = findSnapshot(bootSnapshots, key);
+    if (snapshot) {
+      // Input set before booting (see setJoypad()) belongs to this machine,
+      // not to the one that filled the cache. The boot ROM neither reads nor
+      // changes it: it is carried over as it is.
+      const word joypad = joypadStatus;
+      const word joypadRegister = *bus.view(REG_JOIP);
+      const word joypadFlag = *bus.view(REG_IF) & (1 << INTERRUPT_JOYPAD);
+
+      state::Reader reader{ snapshot->data(), snapshot->size() };
+      loadState(reader, false);
+
+      joypadStatus = joypad;
+      bus.write(REG_JOIP, joypadRegister, AddressBus::GB);
+      bus.write(REG_IF, (*bus.view(REG_IF) & ~(1 << INTERRUPT_JOYPAD)) | joypadFlag, AddressBus::GB);
+      return true;
+    }
+  }
+
+  // Boot ROM unmaps itself during a clock: the state is taken when that
+  // clock is complete.
+  while (bus.isBootRomEnabled()) {
+    if (getClockCount() >= BOOT_CLOCK_LIMIT) {
+      throw std::runtime_error("Boot ROM did not finish. Is the cartridge header valid?");
+    }
+    machineClock();
+  }
+
+  if (atPowerOn) {
+    auto snapshot = std::make_shared<Binary>(stateSize());
+    saveState(snapshot->data(), snapshot->size());
+    storeSnapshot(bootSnapshots, key, std::move(snapshot));
+  }
+  return false;
+}
+
+/**
+ * Bring the machine back to power on, in place. Afterwards, it is in the
+ * same state as a new machine running the same ROM: screen and serial output
+ * are cleared, and so are cartridge RAM and real time clock. Settings
+ * (rendering, threaded rendering, PPU log) are kept.
+ * The power-on state is cached for the whole process the first time, as it
+ * only depends on the cartridge header: after that, resetting allocates
+ * nothing. Calling boot() right after restores the end of the boot ROM from
+ * its own cache.
+ * @throws if cartridge RAM lives in a save file (see useSaveFile()), as it
+ * would be cleared.
+ */
+void Gameboy::hardReset() {
+  if (cart->hasSaveFile()) {
+    throw std::runtime_error("Can not reset a machine that uses a save file!");
+  }
+
+  const BootKey key = bootKey(*cart);
+  auto snapshot = findSnapshot(powerOnSnapshots, key);
+  if (!snapshot) {
+    const Gameboy fresh{ cart->getRomImage() };
+    auto state = std::make_shared<Binary>(fresh.stateSize());
+    fresh.saveState(state->data(), state->size());
+    storeSnapshot(powerOnSnapshots, key, state);
+    snapshot = std::move(state);
+  }
+
+  state::Reader reader{ snapshot->data(), snapshot->size() };
+  loadState(reader, true);
+
+  // Render thread is idle once the state is loaded.
+  screenBuffer.fill(0);
+  screenChanges = PPU::ScreenChanges{};
+  serialBuffer.clear();
+}
+
 /**
  * Skips execution to the end of boot ROM and disables it. Tries to
  * initialize all registers and address bus addresses to their correct values.
@@ -161,6 +347,41 @@ void Gameboy::setJoypad(word value) {
   requestInterrupt(INTERRUPT_JOYPAD);
 }
 
+/**
+ * Read a byte from memory, as seen by the CPU. Reading has no side effects,
+ * so this can be used to inspect game variables while running.
+ * @param address Address to read.
+ * @return Value at address.
+ */
+word Gameboy::readMemory(const dword address) const {
+  return bus.read(address);
+}
+
+/**
+ * Direct read-only pointer to internal memory, e.g. work RAM ($C000-$DFFF) or
+ * high RAM ($FF80-$FFFE). The pointer stays valid, and follows memory as it
+ * changes, for the lifetime of this object. Only memory owned by the address
+ * bus can be viewed: cartridge and timer addresses can not. Registers that
+ * are computed when read (e.g. joypad) may not be up-to-date here.
+ * @param address First address to view.
+ * @return Pointer to the byte at address. Following bytes are the ones at
+ * the following addresses, up to the end of the memory area.
+ */
+const word* Gameboy::viewMemory(const dword address) const {
+  return bus.view(address);
+}
+
+/**
+ * Direct read-only pointer to cartridge RAM. The pointer changes when RAM is
+ * moved to a save file (see useSaveFile()).
+ * @param size Gets set to the size of RAM, which may be 0.
+ * @return Pointer to RAM (null if the cartridge has none).
+ */
+const word* Gameboy::viewSave(std::size_t& size) const {
+  size = cart->getRamSize();
+  return cart->getRamData();
+}
+
 /**
  * Check if the display is enabled or disabled.
  * @return Display status (true = 0n).
@@ -169,17 +390,264 @@ bool Gameboy::isScreenOn() const {
   return ppu.LCDC(PPU::LCD_DISPLAY_ENABLE);
 }
 
+/**
+ * Enable or disable threaded rendering. When enabled, lines are drawn by a
+ * separate thread, which keeps its own copy of VRAM. Emulation results are
+ * the same in both cases, but screenBuffer gets updated asynchronously
+ * (see waitForRenderer()).
+ * @param enabled Whether lines should be drawn on a separate thread.
+ */
+void Gameboy::setThreadedRendering(bool enabled) {
+  if (enabled == isRenderingThreaded()) {
+    return;
+  }
+
+  if (enabled) {
+    renderThread = std::make_unique<RenderThread>(bus.getVRAM(), screenBuffer.data(), &screenChanges);
+    return;
+  }
+
+  // Make sure every line that was already emulated gets drawn.
+  renderThread->waitUntilIdle();
+  renderThread.reset();
+}
+
+/**
+ * Check if threaded rendering is enabled.
+ * @return true if lines are drawn on a separate thread.
+ */
+bool Gameboy::isRenderingThreaded() const {
+  return renderThread != nullptr;
+}
+
+/**
+ * Wait for the render thread to draw all the lines that have been emulated
+ * so far. This has to be called before reading screenBuffer when threaded
+ * rendering is enabled. If it is not, this does nothing.
+ */
+void Gameboy::waitForRenderer() const {
+  if (renderThread) {
+    renderThread->waitUntilIdle();
+  }
+}
+
+/**
+ * Get which lines of the screen buffer changed during the last complete
+ * frame. Lines that get drawn exactly as they were are not marked.
+ * This can be used to skip work on lines (or frames) that did not change.
+ * @return Bitmap with one bit per line (bit n is line n).
+ */
+const std::bitset<PPU::HEIGHT>& Gameboy::getDirtyLines() const {
+  return screenChanges.lastFrame;
+}
+
+/**
+ * Check if any line changed during the last complete frame.
+ * @return true if the last frame is different from the one before.
+ */
+bool Gameboy::hasFrameChanged() const {
+  return screenChanges.lastFrame.any();
+}
+
+/**
+ * Get the number of complete frames that have been drawn to screenBuffer.
+ * Frames are not counted while rendering is disabled.
+ * @return Number of frames drawn.
+ */
+unsigned long long Gameboy::getFramesDrawn() const {
+  return screenChanges.framesDrawn;
+}
+
+/**
+ * Get the number of the last frame that was different from the one before.
+ * Consumers that do not look at every single frame can compare this to the
+ * last frame they have seen (see getFramesDrawn()) to know if anything
+ * changed in between.
+ * @return Frame number (counting from 1), or 0 if nothing ever changed.
+ */
+unsigned long long Gameboy::getLastChangedFrame() const {
+  return screenChanges.lastChangedFrame;
+}
+
+/**
+ * Get the size of a save state of the current machine. This only depends on
+ * the cartridge, so it can be computed once and reused.
+ * @return save state size in bytes.
+ */
+std::size_t Gameboy::stateSize() const {
+  return saveState(nullptr, 0);
+}
+
+/**
+ * Save the whole machine state to buffer. Nothing gets allocated, and
+ * emulation is not affected. Screen buffer, serial buffer and PPU log are not
+ * part of the state. Battery-backed RAM is.
+ * @param buffer Where to write the state. If nullptr, nothing is written.
+ * @param capacity Size of buffer.
+ * @return number of bytes written (see stateSize()).
+ * @throws if capacity is smaller than the state size.
+ */
+std::size_t Gameboy::saveState(word* buffer, const std::size_t capacity) const {
+  state::Writer writer{ buffer, capacity };
+
+  // Identifies the cartridge, so that states are not loaded on the wrong game.
+  const auto& header = cart->getHeader();
+  writer.beginSection("GB  ");
+  writer.put8(header.cartridgeType);
+  writer.put8(header.headerChecksum);
+  writer.put8(header.globalChecksum[0]);
+  writer.put8(header.globalChecksum[1]);
+  writer.put8(joypadStatus);
+  writer.endSection();
+
+  cart->saveState(writer);
+  cpu.saveState(writer);
+  ppu.saveState(writer);
+  tcu.saveState(writer);
+  bus.saveState(writer);
+  return writer.finish();
+}
+
+/**
+ * Restore the machine state from a save state (see saveState()). If threaded
+ * rendering is enabled, this waits for the render thread to be idle.
+ * @param data Save state data.
+ * @param size Size of data.
+ * @throws if data is not a valid save state, or if it was saved with a
+ * different cartridge. States are checked before anything gets loaded, but
+ * a corrupted state with a valid layout can still leave the machine in an
+ * unspecified (but safe to destroy) condition.
+ */
+void Gameboy::loadState(const word* data, const std::size_t size) {
+  state::Reader reader{ data, size };
+  loadState(reader, true);
+}
+
+void Gameboy::loadState(state::Reader& reader, const bool loadCartridge) {
+  const auto& header = cart->getHeader();
+  reader.requireSection("GB  ");
+  if (reader.get8() != header.cartridgeType
+      || reader.get8() != header.headerChecksum
+      || reader.get8() != header.globalChecksum[0]
+      || reader.get8() != header.globalChecksum[1]) {
+    throw std::runtime_error("Save state was saved with a different cartridge!");
+  }
+  joypadStatus = reader.get8();
+
+  if (loadCartridge) {
+    cart->loadState(reader);
+  }
+  cpu.loadState(reader);
+  ppu.loadState(reader);
+  tcu.loadState(reader);
+  bus.loadState(reader);
+
+  // Render thread has its own copy of VRAM.
+  if (renderThread) {
+    renderThread->resyncVRAM(bus.getVRAM());
+  }
+}
+
+/**
+ * Get a 64-bit hash of the machine state. Machines in the same state (see
+ * saveState()) have the same hash, whatever happened before. Memory is not
+ * read here: its hash is kept up to date on each write, unless the emulator
+ * was built without GB_STATE_HASH. Other components only have a few hundred
+ * bytes of state, which get hashed on each call.
+ * @return state hash.
+ */
+std::uint64_t Gameboy::stateHash() const {
+  std::array<word, 1024> buffer;
+  state::Writer writer{ buffer.data(), buffer.size() };
+  writer.put8(joypadStatus);
+  cpu.saveState(writer);
+  ppu.saveState(writer);
+  tcu.saveState(writer);
+
+  return state::hash(buffer.data(), writer.size()) ^ cart->stateHash() ^ bus.stateHash();
+}
+
+/**
+ * Create an independent copy of this machine, in the exact same state. ROM
+ * is shared (see ROMImage), everything else is copied: the copy can be run
+ * and changed without affecting the original.
+ * Only emulation state and screen output are copied. The copy does not use
+ * threaded rendering, a PPU log or a save file (its cartridge RAM lives in
+ * memory, so that it never writes to the save file of the original).
+ * @return the new machine.
+ */
+std::unique_ptr<Gameboy> Gameboy::clone() const {
+  std::unique_ptr<Gameboy> copy{ new Gameboy{ cart->getRomImage() } };
+
+  // State goes through a save state: it already knows what has to be copied
+  // for each component. The buffer is reused, so this allocates nothing
+  // after the first clone on each thread.
+  thread_local Binary buffer;
+  buffer.resize(stateSize());
+  saveState(buffer.data(), buffer.size());
+  copy->loadState(buffer.data(), buffer.size());
+
+  waitForRenderer();
+  copy->screenBuffer = screenBuffer;
+  copy->screenChanges = screenChanges;
+  copy->renderingEnabled = renderingEnabled;
+  copy->serialBuffer = serialBuffer;
+  return copy;
+}
+
+/**
+ * Enable or disable rendering. When disabled, the PPU still runs (with the
+ * same timing and interrupts), but lines are not drawn to screenBuffer.
+ * This is useful when frames are not needed, or when they are going to be
+ * rendered later from a PPU log (see startPPULog()).
+ * @param enabled Whether lines should be drawn.
+ */
+void Gameboy::setRenderingEnabled(bool enabled) {
+  renderingEnabled = enabled;
+}
+
+/**
+ * Check if rendering is enabled.
+ * @return true if lines are drawn to screenBuffer.
+ */
+bool Gameboy::isRenderingEnabled() const {
+  return renderingEnabled;
+}
+
+/**
+ * Start recording everything the PPU needs to draw frames (VRAM writes and
+ * the latched state of each line) to a file. Recording actually starts
+ * at the beginning of the next frame. Any log that was already being
+ * recorded gets closed first.
+ * @param path Log file path.
+ * @param keyframeInterval A full copy of VRAM is stored every this many
+ * frames. Logs get split at keyframes to be rendered in parallel.
+ * @throws std::runtime_error if the file can not be opened.
+ */
+void Gameboy::startPPULog(const std::string& path, int keyframeInterval) {
+  ppuLog.reset();
+  ppuLog = std::make_unique<PPULogWriter>(path, keyframeInterval);
+}
+
+/**
+ * Stop recording the PPU log, and flush it to file.
+ */
+void Gameboy::stopPPULog() {
+  ppuLog.reset();
+}
+
 /**
  * Print the screen buffer using ASCII characters. This is intended to be used
  * for debugging purposes.
  */
 void Gameboy::printScreenBuffer() const {
   static constexpr std::array<char, 4> ASCIIColors{'.', 'o', '#', '@'};
+  waitForRenderer();
 
   for (int y = 0; y != PPU::HEIGHT; ++y) {
     for (int x = 0; x != PPU::WIDTH; ++x) {
       const auto pixel =
-        ASCIIColors[screenBuffer[x + y * PPU::WIDTH].to_ulong()];
+        ASCIIColors[screenBuffer[x + y * PPU::WIDTH]];
       std::cout << pixel;
     }
 
@@ -210,11 +678,80 @@ void Gameboy::printSerialBuffer() {
  * saving (check shouldSave()).
  * @return battery-backed cartridge RAM (as an array of word(s)).
  */
-const Binary& Gameboy::getSave() {
+Binary Gameboy::getSave() const {
   assert(isCartridgeBatteryBacked);
   return cart->getRam();
 }
 
+/**
+ * Move battery-backed RAM inside a save file (see SaveFile). From now on,
+ * cartridge RAM survives a crash of the emulator, and gets written to disk
+ * in background every flushInterval if it changed, replacing the whole
+ * file. If the file does not exist, it gets created with the current RAM
+ * content.
+ * This funciton should only be called if the cartridge effectively supports
+ * saving (check shouldSave()).
+ * @param path Save file path.
+ * @param flushInterval How often RAM is written to disk.
+ * @return true if an existing save file was loaded.
+ * @throws if the cartridge is not battery-backed, the file has a different
+ * size than the cartridge RAM or the file can not be used.
+ */
+bool Gameboy::useSaveFile(const std::string& path, const std::chrono::milliseconds flushInterval) {
+  if (!isCartridgeBatteryBacked) {
+    throw std::runtime_error("Attempting to use a save file for a cartridge that is not battery-backed!");
+  }
+  return cart->attachSaveFile(path, flushInterval);
+}
+
+/**
+ * Check wether the cartridge has a real time clock (MBC3 with timer).
+ * Its state should be saved along with battery-backed RAM.
+ * @return true if the cartridge has a real time clock.
+ */
+bool Gameboy::hasRTC() const {
+  return cart->getRTC() != nullptr;
+}
+
+/**
+ * Get real time clock state, in the format used by most other emulators
+ * (see RTC::save). Current time is stored as well, so that the clock can
+ * catch up when loaded later (see loadRTC).
+ * @return RTC::SAVE_SIZE bytes of clock data.
+ * @throws if the cartridge has no real time clock.
+ */
+Binary Gameboy::getRTC() const {
+  if (!hasRTC()) {
+    throw std::runtime_error("Cartridge has no real time clock!");
+  }
+  const auto data = cart->getRTC()->save(std::time(nullptr));
+  return Binary(data.begin(), data.end());
+}
+
+/**
+ * Load real time clock state (see getRTC). The clock is otherwise driven
+ * by emulated machine clocks only, and never reads host time.
+ * @param data Clock data, as returned by getRTC.
+ * @param wallClockSync If true, the real time that passed since data was
+ * saved gets added to the clock, as if the cartridge kept running.
+ * @throws if the cartridge has no real time clock or data is invalid.
+ */
+void Gameboy::loadRTC(const Binary& data, const bool wallClockSync) {
+  if (!hasRTC()) {
+    throw std::runtime_error("Cartridge has no real time clock!");
+  }
+  cart->getRTC()->load(data.data(), data.size(), std::time(nullptr), wallClockSync);
+}
+
+/**
+ * Have battery-backed RAM written to disk now, without waiting for the next
+ * flush interval. Writing happens in background, so this does not block.
+ * Does nothing if no save file is in use (see useSaveFile()).
+ */
+void Gameboy::flushSave() {
+  cart->flushSaveFile();
+}
+
 /**
  * Check wether the cartridge supports save games or not.
  * @return should you care about save games?
@@ -1,12 +1,17 @@
 #ifndef GAMEBOY_H
 #define GAMEBOY_H
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include "address-bus.hpp"
 #include "cpu.hpp"
 #include "ppu.hpp"
+#include "render-thread.hpp"
+#include "ppu-log.hpp"
 #include "cartridge.hpp"
+#include "rom-image.hpp"
 #include "timer-controller.hpp"
 
 namespace gb {
@@ -25,12 +30,17 @@ private:
   // Internal components
   // Now, using raw pointers here is a bit ugly. Ideally, Gameboy should create a shared_ptr to itself
   // and pass a weak_ptr to all its children. However, this would not improve clarity by much.
+  // Members used on every clock come first and stay together; bus must come
+  // before the components that use it in their constructors.
   std::unique_ptr<Cartridge> cart;
   AddressBus bus{this};
   PPU ppu{this, &bus };
   CPU cpu{this, &bus };
   TimerController tcu{this, &bus };
 
+  // Which lines of screenBuffer changed. Updated by whoever draws lines.
+  PPU::ScreenChanges screenChanges;
+
   // Status of the joypad. Here, I use low nibble for DIRECTIONAL controls
   // and high nibble to store BUTTONS. This is different from how the data
   // is stored/read from real hardware.
@@ -39,9 +49,18 @@ private:
   // setJoypad calls).
   word joypadStatus{0b11111111};
 
+  // When rendering is disabled, lines are not drawn at all (but they
+  // still get logged if the PPU log is enabled).
+  bool renderingEnabled{true};
+
   // Depends on if the cartridge is battery backed.
   bool isCartridgeBatteryBacked;
 
+  // When threaded rendering is enabled, lines get drawn on a separate
+  // thread (see RenderThread). Otherwise, this is empty.
+  std::unique_ptr<RenderThread> renderThread;
+  std::unique_ptr<PPULogWriter> ppuLog;
+
   // "Asks" the CPU for an interrupt. Actually, most of the interrupt related
   // code could be moved inside Gameboy but, in hardware, interrupts are handled
   // by the CPU. So, it makes sense to keep all the code inside CPU and
@@ -51,28 +70,103 @@ private:
   // that connects all components inside the physical Game Boy.
   void requestInterrupt(INTERRUPT_ID interrupt);
 
+  // Load a save state. Cartridge section can be left out (see boot()).
+  void loadState(state::Reader& reader, bool loadCartridge);
+
 public:
   // Constructor ///////////////////////////////////////////////////////////////
   explicit Gameboy(const Binary& rom);
+  explicit Gameboy(std::shared_ptr<const ROMImage> rom);
+  ~Gameboy();
+
+  // Components hold pointers to each other and to this; see clone().
+  Gameboy(const Gameboy&) = delete;
+  Gameboy& operator=(const Gameboy&) = delete;
   //////////////////////////////////////////////////////////////////////////////
 
   // These buffers could also be made read-only, but there is no effect in writing
   // to them.
   typedef std::array<PPU::color, PPU::HEIGHT * PPU::WIDTH> ScreenBuffer;
   ScreenBuffer screenBuffer{};
+  // Serial output. Room for SERIAL_BUFFER_CAPACITY characters is reserved up
+  // front, so that running does not allocate as long as it gets emptied.
+  static constexpr std::size_t SERIAL_BUFFER_CAPACITY{ 4096 };
   std::string serialBuffer;
 
   void machineClock();
+  // Machine clocks since power on. This is the time base of movies and of
+  // the real time clock.
+  unsigned long long getClockCount() const;
   void skipBoot();
+  // Run the boot ROM to its end, or restore its end state from a cache.
+  bool boot();
+  // Go back to power on without creating a new machine.
+  void hardReset();
   void setJoypad(word value);
 
+  // Read memory as the CPU would, without side effects.
+  word readMemory(dword address) const;
+  // Direct read-only access to memory, without copying (see viewMemory()).
+  const word* viewMemory(dword address) const;
+  const word* viewSave(std::size_t& size) const;
+
   void loadSave(const Binary& ram);
-  const Binary& getSave();
+  Binary getSave() const;
   bool shouldSave() const;
+  // Keep battery-backed RAM inside a save file instead of copying it around.
+  bool useSaveFile(const std::string& path,
+                   std::chrono::milliseconds flushInterval = std::chrono::seconds{ 1 });
+  void flushSave();
+
+  // MBC3 real time clock. It advances with emulated time.
+  bool hasRTC() const;
+  Binary getRTC() const;
+  void loadRTC(const Binary& data, bool wallClockSync = false);
 
   // Original hardware could turn off display.
   bool isScreenOn() const;
 
+  // Draw lines on a separate thread. This does not change emulation results.
+  void setThreadedRendering(bool enabled);
+  bool isRenderingThreaded() const;
+  // Frame fence: when threaded rendering is enabled, screenBuffer is only
+  // guaranteed to be up-to-date after calling this.
+  void waitForRenderer() const;
+
+  // Which lines of screenBuffer changed during the last complete frame. With
+  // threaded rendering, these are only up-to-date after waitForRenderer().
+  const std::bitset<PPU::HEIGHT>& getDirtyLines() const;
+  // Whether the last complete frame is different from the one before.
+  bool hasFrameChanged() const;
+  // Number of complete frames drawn so far.
+  unsigned long long getFramesDrawn() const;
+  // Number of the last frame that changed anything (0 if none did). Frames
+  // are counted from 1, as in getFramesDrawn().
+  unsigned long long getLastChangedFrame() const;
+
+  // Skip drawing lines. Screen buffer is left untouched while
+  // rendering is disabled.
+  void setRenderingEnabled(bool enabled);
+  bool isRenderingEnabled() const;
+
+  // Record PPU inputs to a file, so that frames can be rendered later
+  // (see PPULogReader and gb-render).
+  void startPPULog(const std::string& path, int keyframeInterval = 60);
+  void stopPPULog();
+
+  // Save states (see save-state.hpp). States are written to a caller
+  // provided buffer, which must be at least stateSize() bytes.
+  std::size_t stateSize() const;
+  std::size_t saveState(word* buffer, std::size_t capacity) const;
+  void loadState(const word* data, std::size_t size);
+  // Hash of the whole machine state, as saved by saveState(): equal states
+  // hash the same. Memory hashes are kept up to date as memory changes (see
+  // state-hash.hpp), so this costs the same regardless of memory size.
+  std::uint64_t stateHash() const;
+
+  // Independent copy of this machine, sharing the same ROM.
+  std::unique_ptr<Gameboy> clone() const;
+
   // Debug functions
   void printScreenBuffer() const;
   void printSerialBuffer();
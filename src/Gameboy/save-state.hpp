@@ -0,0 +1,246 @@
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "types.hpp"
+
+namespace gb {
+
+// Save states are made of a small header followed by tagged sections:
+//
+//   "GBSS" | version (16 bit) | section count (16 bit)
+//   tag (4 chars) | payload size (32 bit) | payload
+//   tag (4 chars) | payload size (32 bit) | payload
+//   ...
+//
+// All values are little endian. Each component writes its own section (see
+// the saveState/loadState methods of CPU, PPU, ...). Sections can be found
+// regardless of their order, and readers never read past the end of a
+// section: new fields can be appended to a section without breaking old
+// states, as long as readers handle the missing data.
+namespace state {
+
+constexpr char MAGIC[4]{ 'G', 'B', 'S', 'S' };
+constexpr dword VERSION{ 2 };
+constexpr std::size_t HEADER_SIZE{ 8 };
+constexpr std::size_t SECTION_HEADER_SIZE{ 8 };
+
+// Serializes values into a caller-provided buffer. With a null buffer,
+// nothing is written and the writer only counts bytes (see size()).
+class Writer {
+  word* buffer;
+  std::size_t capacity;
+  std::size_t position{ 0 };
+  std::size_t sectionStart{ 0 };
+  dword sectionCount{ 0 };
+
+  inline word* reserve(const std::size_t bytes) {
+    const std::size_t start = position;
+    position += bytes;
+    if (buffer == nullptr) {
+      return nullptr;
+    }
+    if (position > capacity) {
+      throw std::runtime_error("Save state buffer is too small!");
+    }
+    return buffer + start;
+  }
+
+  inline void putAt(word* target, const std::uint64_t value, const int bytes) {
+    for (int i = 0; i != bytes; ++i) {
+      target[i] = (value >> (8 * i)) & 0xFF;
+    }
+  }
+
+  inline void put(const std::uint64_t value, const int bytes) {
+    word* target = reserve(bytes);
+    if (target != nullptr) {
+      putAt(target, value, bytes);
+    }
+  }
+
+ public:
+  inline Writer(word* buffer, const std::size_t capacity) : buffer{ buffer }, capacity{ capacity } {
+    putBytes(reinterpret_cast<const word*>(MAGIC), sizeof(MAGIC));
+    put16(VERSION);
+    // Section count gets written by finish().
+    put16(0);
+  }
+
+  inline void beginSection(const char (&tag)[5]) {
+    putBytes(reinterpret_cast<const word*>(tag), 4);
+    // Size gets written by endSection().
+    put32(0);
+    sectionStart = position;
+  }
+
+  inline void endSection() {
+    if (buffer != nullptr) {
+      putAt(buffer + sectionStart - 4, position - sectionStart, 4);
+    }
+    ++sectionCount;
+  }
+
+  // Returns the total size of the state.
+  inline std::size_t finish() {
+    if (buffer != nullptr) {
+      putAt(buffer + 6, sectionCount, 2);
+    }
+    return position;
+  }
+
+  inline void put8(const word value) {
+    put(value, 1);
+  }
+  inline void putBool(const bool value) {
+    put(value ? 1 : 0, 1);
+  }
+  inline void put16(const dword value) {
+    put(value, 2);
+  }
+  inline void put32(const std::uint32_t value) {
+    put(value, 4);
+  }
+  inline void put64(const std::uint64_t value) {
+    put(value, 8);
+  }
+  inline void putBytes(const word* data, const std::size_t size) {
+    word* target = reserve(size);
+    if (target != nullptr) {
+      std::memcpy(target, data, size);
+    }
+  }
+
+  inline std::size_t size() const {
+    return position;
+  }
+};
+
+// Reads values back from a save state. Every read is bounds-checked
+// against the current section.
+class Reader {
+  const word* data;
+  std::size_t size;
+  std::size_t position{ 0 };
+  std::size_t sectionEnd{ 0 };
+
+  inline const word* consume(const std::size_t bytes) {
+    if (bytes > sectionEnd - position) {
+      throw std::runtime_error("Save state section is truncated!");
+    }
+    const word* start = data + position;
+    position += bytes;
+    return start;
+  }
+
+  inline std::uint64_t get(const int bytes) {
+    const word* source = consume(bytes);
+    std::uint64_t value{ 0 };
+    for (int i = 0; i != bytes; ++i) {
+      value |= static_cast<std::uint64_t>(source[i]) << (8 * i);
+    }
+    return value;
+  }
+
+ public:
+  // Checks header and the layout of all sections.
+  // @throws if data is not a valid save state.
+  inline Reader(const word* data, const std::size_t size) : data{ data }, size{ size } {
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+      throw std::runtime_error("Data is not a save state!");
+    }
+    if ((data[4] | data[5] << 8) != VERSION) {
+      throw std::runtime_error("Unsupported save state version!");
+    }
+
+    const unsigned int sections = data[6] | data[7] << 8;
+    std::size_t offset{ HEADER_SIZE };
+    for (unsigned int i = 0; i != sections; ++i) {
+      offset = skipSection(offset);
+    }
+    if (offset != size) {
+      throw std::runtime_error("Save state has an invalid size!");
+    }
+  }
+
+  // Move to the start of the section with the given tag.
+  // @return false if there is no such section.
+  inline bool openSection(const char (&tag)[5]) {
+    std::size_t offset{ HEADER_SIZE };
+    while (offset != size) {
+      const std::size_t next = skipSection(offset);
+      if (std::memcmp(data + offset, tag, 4) == 0) {
+        position = offset + SECTION_HEADER_SIZE;
+        sectionEnd = next;
+        return true;
+      }
+      offset = next;
+    }
+    return false;
+  }
+
+  // Same as openSection, but the section is mandatory.
+  inline void requireSection(const char (&tag)[5]) {
+    if (!openSection(tag)) {
+      throw std::runtime_error(std::string{ "Save state is missing section " } + tag + "!");
+    }
+  }
+
+  inline word get8() {
+    return get(1);
+  }
+  inline bool getBool() {
+    return get(1) != 0;
+  }
+  inline dword get16() {
+    return get(2);
+  }
+  inline std::uint32_t get32() {
+    return get(4);
+  }
+  inline std::uint64_t get64() {
+    return get(8);
+  }
+  inline void getBytes(word* output, const std::size_t bytes) {
+    std::memcpy(output, consume(bytes), bytes);
+  }
+  // Same as getBytes, but without copying: data stays in the save state.
+  inline const word* viewBytes(const std::size_t bytes) {
+    return consume(bytes);
+  }
+
+ private:
+  // Offset of the section after the one at offset.
+  inline std::size_t skipSection(const std::size_t offset) const {
+    if (size - offset < SECTION_HEADER_SIZE) {
+      throw std::runtime_error("Save state section is truncated!");
+    }
+    const std::size_t payload = data[offset + 4] | data[offset + 5] << 8 | data[offset + 6] << 16
+                                | static_cast<std::size_t>(data[offset + 7]) << 24;
+    if (payload > size - offset - SECTION_HEADER_SIZE) {
+      throw std::runtime_error("Save state section is truncated!");
+    }
+    return offset + SECTION_HEADER_SIZE + payload;
+  }
+};
+
+// Hash of a whole save state (64-bit FNV-1a), to compare states without
+// keeping copies of them around.
+inline std::uint64_t hash(const word* data, const std::size_t size) {
+  std::uint64_t value{ 0xCBF29CE484222325 };
+  for (std::size_t i = 0; i != size; ++i) {
+    value = (value ^ data[i]) * 0x100000001B3;
+  }
+  return value;
+}
+
+}  // namespace state
+
+}  // namespace gb
+
+#endif  // SAVE_STATE_H
@@ -0,0 +1,80 @@
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "types.hpp"
+
+namespace gb {
+
+// Memory is hashed Zobrist-style: each byte contributes a pseudo-random value
+// that depends on its position and its value, and the hash of a memory area
+// is the XOR of all contributions. When a byte changes, the hash is updated
+// by removing its old contribution and adding the new one (see
+// Gameboy::stateHash).
+//
+// Zero bytes contribute nothing, so zeroed memory hashes to 0. Positions of
+// different memory areas must not overlap.
+//
+// Keeping hashes up to date costs a little on every write. Building without
+// GB_STATE_HASH removes that cost: hashes are then computed from scratch
+// when asked for, with the same result.
+namespace state {
+
+// Position of cartridge RAM bytes, after the address bus ones.
+constexpr std::uint64_t CARTRIDGE_RAM_POSITION{ 0x10000 };
+
+inline std::uint64_t byteHash(const std::uint64_t position, const word value) {
+  if (value == 0) {
+    return 0;
+  }
+  std::uint64_t x = ((position << 8) | value) * 0x9E3779B97F4A7C15;
+  x ^= x >> 29;
+  x *= 0xBF58476D1CE4E5B9;
+  x ^= x >> 32;
+  return x;
+}
+
+inline std::uint64_t memoryHash(const word* data, const std::size_t size, const std::uint64_t position) {
+  std::uint64_t hash{ 0 };
+  for (std::size_t i = 0; i != size; ++i) {
+    hash ^= byteHash(position + i, data[i]);
+  }
+  return hash;
+}
+
+// Update the hash of a memory area going from oldData to newData. Only
+// bytes that differ cost anything, so this is cheap for similar memory.
+inline std::uint64_t updateMemoryHash(std::uint64_t hash, const word* oldData, const word* newData,
+                                      const std::size_t size, const std::uint64_t position) {
+  std::size_t i{ 0 };
+  while (i != size) {
+    // Skip equal bytes eight at a time.
+    if (size - i >= 8) {
+      std::uint64_t a;
+      std::uint64_t b;
+      std::memcpy(&a, oldData + i, 8);
+      std::memcpy(&b, newData + i, 8);
+      if (a == b) {
+        i += 8;
+        continue;
+      }
+    }
+
+    const std::size_t end = size - i >= 8 ? i + 8 : size;
+    for (; i != end; ++i) {
+      if (oldData[i] != newData[i]) {
+        hash ^= byteHash(position + i, oldData[i]) ^ byteHash(position + i, newData[i]);
+      }
+    }
+  }
+  return hash;
+}
+
+}  // namespace state
+
+}  // namespace gb
+
+#endif  // STATE_HASH_H
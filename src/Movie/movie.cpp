@@ -0,0 +1,346 @@
+#include "movie.hpp"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+
+#include "gameboy.hpp"
+#include "save-state.hpp"
+
+namespace gb {
+
+constexpr std::array<char, 4> Movie::MAGIC;
+constexpr dword Movie::VERSION;
+constexpr unsigned long long Movie::CLOCKS_PER_FRAME;
+
+namespace {
+
+void put8(std::ostream& output, const word value) {
+  output.put(static_cast<char>(value));
+}
+
+void putLittleEndian(std::ostream& output, unsigned long long value, const int bytes) {
+  for (int i = 0; i != bytes; ++i) {
+    put8(output, value & 0xFF);
+    value >>= 8;
+  }
+}
+
+void putVarint(std::ostream& output, unsigned long long value) {
+  while (value >= 0x80) {
+    put8(output, (value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  put8(output, value);
+}
+
+// Bounds-checked reads from a movie loaded in memory.
+class Cursor {
+  const Binary& data;
+  std::size_t position{ 0 };
+
+ public:
+  explicit Cursor(const Binary& data) : data{ data } {}
+
+  std::size_t getPosition() const {
+    return position;
+  }
+
+  bool atEnd() const {
+    return position == data.size();
+  }
+
+  void skip(const std::size_t size) {
+    if (data.size() - position < size) {
+      throw std::runtime_error("Unexpected end of movie.");
+    }
+    position += size;
+  }
+
+  word get8() {
+    skip(1);
+    return data[position - 1];
+  }
+
+  unsigned long long getLittleEndian(const int bytes) {
+    unsigned long long value{ 0 };
+    for (int i = 0; i != bytes; ++i) {
+      value |= static_cast<unsigned long long>(get8()) << (8 * i);
+    }
+    return value;
+  }
+
+  unsigned long long getVarint() {
+    unsigned long long value{ 0 };
+    word byte;
+    int shift{ 0 };
+    do {
+      if (shift > 63) {
+        throw std::runtime_error("Invalid record in movie.");
+      }
+      byte = get8();
+      value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    return value;
+  }
+};
+
+}  // namespace
+
+// Recorder ////////////////////////////////////////////////////////////////////
+MovieRecorder::MovieRecorder(const std::string& path, const Gameboy& gameboy, const int keyframeInterval)
+  : output{ path, std::ios_base::binary }
+  , keyframeInterval{ keyframeInterval }
+  , state(gameboy.stateSize())
+  , lastClock{ gameboy.getClockCount() }
+  , lastKeyframeClock{ lastClock } {
+  if (output.fail()) {
+    throw std::runtime_error("Error opening movie file for writing!");
+  }
+  if (keyframeInterval <= 0 || keyframeInterval > 0xFFFF) {
+    throw std::runtime_error("Movie keyframe interval must be between 1 and 65535.");
+  }
+
+  output.write(Movie::MAGIC.data(), Movie::MAGIC.size());
+  putLittleEndian(output, Movie::VERSION, 2);
+  putLittleEndian(output, keyframeInterval, 2);
+  putLittleEndian(output, state.size(), 4);
+  writeKeyframe(gameboy);
+}
+
+MovieRecorder::~MovieRecorder() {
+  if (finished) {
+    return;
+  }
+
+  put8(output, Movie::END);
+  putLittleEndian(output, lastClock, 8);
+}
+
+void MovieRecorder::writeKeyframe(const Gameboy& gameboy) {
+  gameboy.saveState(state.data(), state.size());
+
+  lastClock = gameboy.getClockCount();
+  lastKeyframeClock = lastClock;
+  put8(output, Movie::KEYFRAME);
+  putLittleEndian(output, lastClock, 8);
+  output.write(reinterpret_cast<const char*>(state.data()), static_cast<std::streamsize>(state.size()));
+}
+
+void MovieRecorder::setJoypad(Gameboy& gameboy, const word value) {
+  assert(!finished);
+  const unsigned long long clock = gameboy.getClockCount();
+  if (clock < lastClock) {
+    throw std::runtime_error("Machine clock went backwards while recording a movie!");
+  }
+
+  // Same as Gameboy::setJoypad, calls that change nothing are ignored.
+  if (value != joypad) {
+    put8(output, Movie::INPUT);
+    putVarint(output, clock - lastClock);
+    put8(output, value);
+    lastClock = clock;
+    joypad = value;
+  }
+
+  gameboy.setJoypad(value);
+}
+
+void MovieRecorder::update(const Gameboy& gameboy) {
+  assert(!finished);
+  const unsigned long long clock = gameboy.getClockCount();
+  if (clock < lastClock) {
+    throw std::runtime_error("Machine clock went backwards while recording a movie!");
+  }
+
+  if (clock - lastKeyframeClock >= keyframeInterval * Movie::CLOCKS_PER_FRAME) {
+    writeKeyframe(gameboy);
+  }
+}
+
+void MovieRecorder::finish(const Gameboy& gameboy) {
+  if (finished) {
+    return;
+  }
+
+  lastClock = std::max(lastClock, gameboy.getClockCount());
+  put8(output, Movie::END);
+  putLittleEndian(output, lastClock, 8);
+  output.flush();
+  finished = true;
+
+  if (output.fail()) {
+    throw std::runtime_error("Error writing movie file!");
+  }
+}
+
+// Player //////////////////////////////////////////////////////////////////////
+MoviePlayer::MoviePlayer(const std::string& path) {
+  std::ifstream input{ path, std::ios_base::binary };
+  if (input.fail()) {
+    throw std::runtime_error("Error opening movie file!");
+  }
+  data = Binary{ std::istreambuf_iterator<char>(input), {} };
+
+  Cursor cursor{ data };
+  std::array<char, 4> magic{};
+  for (auto& character : magic) {
+    character = static_cast<char>(cursor.get8());
+  }
+  if (magic != Movie::MAGIC) {
+    throw std::runtime_error("Invalid movie file.");
+  }
+  if (cursor.getLittleEndian(2) != Movie::VERSION) {
+    throw std::runtime_error("Unsupported movie version.");
+  }
+  keyframeInterval = static_cast<int>(cursor.getLittleEndian(2));
+  stateSize = cursor.getLittleEndian(4);
+
+  // Index the whole movie.
+  unsigned long long clock{ 0 };
+  bool ended{ false };
+  while (!ended && !cursor.atEnd()) {
+    const auto type = cursor.get8();
+    if (keyframes.empty() && type != Movie::KEYFRAME) {
+      throw std::runtime_error("Movies must start with a keyframe.");
+    }
+
+    switch (type) {
+      case Movie::KEYFRAME: {
+        const unsigned long long keyframeClock = cursor.getLittleEndian(8);
+        if (!keyframes.empty() && keyframeClock < clock) {
+          throw std::runtime_error("Invalid keyframe in movie.");
+        }
+        clock = keyframeClock;
+        keyframes.push_back(Keyframe{ clock, cursor.getPosition(), inputs.size() });
+        cursor.skip(stateSize);
+        break;
+      }
+
+      case Movie::INPUT:
+        clock += cursor.getVarint();
+        inputs.push_back(Input{ clock, cursor.get8() });
+        break;
+
+      case Movie::END:
+        clock = std::max(clock, cursor.getLittleEndian(8));
+        ended = true;
+        break;
+
+      default:
+        throw std::runtime_error("Invalid record in movie.");
+    }
+  }
+
+  if (keyframes.empty()) {
+    throw std::runtime_error("Movie does not contain any keyframe.");
+  }
+  endClock = clock;
+}
+
+std::size_t MoviePlayer::loadKeyframe(Gameboy& gameboy, const std::size_t index) const {
+  const Keyframe& keyframe = keyframes[index];
+  gameboy.loadState(&data[keyframe.offset], stateSize);
+  return keyframe.inputIndex;
+}
+
+void MoviePlayer::applyInputs(Gameboy& gameboy, std::size_t& next) const {
+  const unsigned long long clock = gameboy.getClockCount();
+  while (next != inputs.size() && inputs[next].clock <= clock) {
+    gameboy.setJoypad(inputs[next].value);
+    ++next;
+  }
+}
+
+void MoviePlayer::runUntil(Gameboy& gameboy, const unsigned long long target, std::size_t& next) const {
+  unsigned long long clock = gameboy.getClockCount();
+  while (clock < target) {
+    applyInputs(gameboy, next);
+
+    // Run until the next input is due, without checking at every clock.
+    unsigned long long stop = target;
+    if (next != inputs.size()) {
+      stop = std::min(stop, inputs[next].clock);
+    }
+    for (; clock < stop; ++clock) {
+      gameboy.machineClock();
+    }
+  }
+}
+
+void MoviePlayer::start(Gameboy& gameboy) {
+  nextInput = loadKeyframe(gameboy, 0);
+}
+
+void MoviePlayer::apply(Gameboy& gameboy) {
+  applyInputs(gameboy, nextInput);
+}
+
+void MoviePlayer::runFrames(Gameboy& gameboy, const unsigned long frames) {
+  runUntil(gameboy, gameboy.getClockCount() + frames * Movie::CLOCKS_PER_FRAME, nextInput);
+}
+
+void MoviePlayer::playSegment(Gameboy& gameboy, const std::size_t index) const {
+  assert(index < keyframes.size());
+  std::size_t next = loadKeyframe(gameboy, index);
+
+  if (index + 1 == keyframes.size()) {
+    runUntil(gameboy, endClock, next);
+    return;
+  }
+
+  // Inputs recorded at the same clock as the next keyframe, but before it,
+  // are part of its state.
+  const Keyframe& end = keyframes[index + 1];
+  runUntil(gameboy, end.clock, next);
+  while (next != end.inputIndex) {
+    gameboy.setJoypad(inputs[next].value);
+    ++next;
+  }
+}
+
+void MoviePlayer::seek(Gameboy& gameboy, unsigned long frame) {
+  frame = std::min(frame, getFrameCount());
+  const unsigned long long target = keyframes.front().clock + frame * Movie::CLOCKS_PER_FRAME;
+
+  // Closest keyframe at or before target.
+  const auto next = std::upper_bound(keyframes.begin(), keyframes.end(), target,
+    [](const unsigned long long clock, const Keyframe& keyframe) { return clock < keyframe.clock; });
+  nextInput = loadKeyframe(gameboy, static_cast<std::size_t>(next - keyframes.begin()) - 1);
+  runUntil(gameboy, target, nextInput);
+}
+
+std::size_t MoviePlayer::getKeyframeCount() const {
+  return keyframes.size();
+}
+
+unsigned long MoviePlayer::getKeyframeFrame(const std::size_t index) const {
+  assert(index < keyframes.size());
+  return (keyframes[index].clock - keyframes.front().clock) / Movie::CLOCKS_PER_FRAME;
+}
+
+std::uint64_t MoviePlayer::getKeyframeHash(const std::size_t index) const {
+  assert(index < keyframes.size());
+  return state::hash(&data[keyframes[index].offset], stateSize);
+}
+
+unsigned long MoviePlayer::getFrameCount() const {
+  return (endClock - keyframes.front().clock) / Movie::CLOCKS_PER_FRAME;
+}
+
+unsigned long MoviePlayer::getFrame(const Gameboy& gameboy) const {
+  const unsigned long long clock = gameboy.getClockCount();
+  const unsigned long long startClock = keyframes.front().clock;
+  return clock < startClock ? 0 : (clock - startClock) / Movie::CLOCKS_PER_FRAME;
+}
+
+int MoviePlayer::getKeyframeInterval() const {
+  return keyframeInterval;
+}
+
+bool MoviePlayer::isFinished(const Gameboy& gameboy) const {
+  return gameboy.getClockCount() >= endClock;
+}
+
+}  // namespace gb
@@ -0,0 +1,167 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace gb {
+
+class Gameboy;
+
+// A movie is a recording of every joypad change, stamped with the exact
+// machine clock it happened at (see Gameboy::getClockCount), plus save states
+// (keyframes) taken every few frames. Emulation is deterministic, so playing
+// the inputs back from the first keyframe gives the same run, bit for bit.
+// Any frame can be reached by loading the keyframe before it and running
+// from there.
+//
+// Frames are counted from the first keyframe, CLOCKS_PER_FRAME clocks each.
+// The run between two keyframes (a segment) does not depend on anything
+// before it, so segments can be played (and verified) independently.
+//
+// Format (multi-byte values are little-endian):
+//  header:   "GBMV" | u16 version | u16 keyframe interval | u32 state size
+//  records:  u8 record type | payload
+//    KEYFRAME: u64 clock | save state (state size bytes)
+//    INPUT:    varint clocks since previous record | u8 joypad value
+//    END:      u64 clock
+// The first record is always a keyframe. END is missing if the recording
+// did not stop properly: the movie then ends at its last record.
+struct Movie {
+  static constexpr std::array<char, 4> MAGIC{ { 'G', 'B', 'M', 'V' } };
+  static constexpr dword VERSION{ 1 };
+  static constexpr unsigned long long CLOCKS_PER_FRAME{ 17556 };
+
+  typedef enum : word {
+    KEYFRAME = 1,
+    INPUT    = 2,
+    END      = 3
+  } RecordType;
+};
+
+class MovieRecorder {
+  std::ofstream output;
+  int keyframeInterval;
+
+  Binary state;
+  // Clock of the last record, inputs are stored relative to it.
+  unsigned long long lastClock;
+  unsigned long long lastKeyframeClock;
+  // Last recorded joypad value (-1 before the first one).
+  int joypad{ -1 };
+  bool finished{ false };
+
+  void writeKeyframe(const Gameboy& gameboy);
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // Recording starts from the current state of gameboy.
+  // @throws if the output file can not be opened.
+  MovieRecorder(const std::string& path, const Gameboy& gameboy, int keyframeInterval = 600);
+  ~MovieRecorder();
+
+  MovieRecorder(const MovieRecorder&) = delete;
+  MovieRecorder& operator=(const MovieRecorder&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Use this instead of Gameboy::setJoypad, so that the change is recorded.
+  void setJoypad(Gameboy& gameboy, word value);
+
+  // Call this regularly (e.g. once per frame): keyframes get stored when
+  // keyframeInterval frames have passed since the last one.
+  void update(const Gameboy& gameboy);
+
+  // Mark the end of the movie and write everything to file. Nothing can be
+  // recorded after this. Called on destruction otherwise, with the clock of
+  // the last record.
+  void finish(const Gameboy& gameboy);
+};
+
+class MoviePlayer {
+  struct Keyframe {
+    unsigned long long clock;
+    // Position of the state in data.
+    std::size_t offset;
+    // Inputs recorded before this keyframe.
+    std::size_t inputIndex;
+  };
+
+  struct Input {
+    unsigned long long clock;
+    word value;
+  };
+
+  // The whole file is loaded in memory: inputs take very little space, and
+  // keyframes are only needed when seeking.
+  Binary data;
+  std::size_t stateSize{ 0 };
+  int keyframeInterval{ 0 };
+
+  std::vector<Keyframe> keyframes;
+  std::vector<Input> inputs;
+  unsigned long long endClock{ 0 };
+
+  // Next input to play.
+  std::size_t nextInput{ 0 };
+
+  // These only change gameboy and the given input index, so that segments
+  // can be played by many threads at once.
+  // @return index of the first input after the keyframe.
+  std::size_t loadKeyframe(Gameboy& gameboy, std::size_t index) const;
+  void applyInputs(Gameboy& gameboy, std::size_t& next) const;
+  // Run gameboy up to clock, playing inputs on the way. Inputs due at
+  // clock itself are left for later.
+  void runUntil(Gameboy& gameboy, unsigned long long clock, std::size_t& next) const;
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // @throws if the file can not be opened or is not a valid movie.
+  explicit MoviePlayer(const std::string& path);
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Load the first keyframe into gameboy.
+  // @throws if gameboy runs a different ROM.
+  void start(Gameboy& gameboy);
+
+  // Set inputs that are due at the current clock of gameboy. When driving
+  // the machine one clock at a time, call this before each machine clock.
+  void apply(Gameboy& gameboy);
+
+  // Run gameboy for some frames, playing inputs as they were recorded.
+  void runFrames(Gameboy& gameboy, unsigned long frames = 1);
+
+  // Bring gameboy to the start of frame, from the closest keyframe before
+  // it. Frames past the end of the movie are clamped to its last frame.
+  // @throws if gameboy runs a different ROM.
+  void seek(Gameboy& gameboy, unsigned long frame);
+
+  // Load keyframe index into gameboy, and play up to the next keyframe (or
+  // to the end of the movie). Unlike other methods, this does not change the
+  // player, so that different segments can be played at the same time.
+  // @throws if gameboy runs a different ROM.
+  void playSegment(Gameboy& gameboy, std::size_t index) const;
+
+  std::size_t getKeyframeCount() const;
+  // Frame a keyframe was taken at.
+  unsigned long getKeyframeFrame(std::size_t index) const;
+  // Hash of a keyframe state (see state::hash), to check where playback
+  // ended up.
+  std::uint64_t getKeyframeHash(std::size_t index) const;
+
+  // Number of frames in the movie.
+  unsigned long getFrameCount() const;
+  // Frame gameboy is at, as counted by this movie.
+  unsigned long getFrame(const Gameboy& gameboy) const;
+  int getKeyframeInterval() const;
+  bool isFinished(const Gameboy& gameboy) const;
+};
+
+}  // namespace gb
+
+#endif  // MOVIE_H
@@ -0,0 +1,313 @@
+#include "line-renderer.hpp"
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+
+#include "types.hpp"
+
+namespace gb {
+
+bool LineRenderer::LCDC(const PPU::LCDC_BIT flag) const {
+  return (line->LCDC >> flag) & 1;
+}
+
+word LineRenderer::readVRAM(const dword address) const {
+  assert(address >= VRAM_LOWER_BOUND && address < VRAM_UPPER_BOUND && "Renderer can only read from VRAM.");
+  return vram[address - VRAM_LOWER_BOUND];
+}
+
+// Palettes are applied using the lookup tables built from the values of the
+// registers latched for the last drawn line.
+LineRenderer::color LineRenderer::applyPalette0(const color input) const {
+  return palette0[input];
+}
+LineRenderer::color LineRenderer::applyPalette1(const color input) const {
+  return palette1[input];
+}
+LineRenderer::color LineRenderer::applyPaletteBG(const color input) const {
+  return paletteBG[input];
+}
+
+void LineRenderer::buildPalette(const word reg, PaletteLUT& lut) {
+  // Each color is mapped to the two bits at position 2*color of the register.
+  for (unsigned int input = 0; input != lut.size(); ++input) {
+    const auto shift = input * 2;
+    lut[input] = (reg >> shift) & 0b11;
+  }
+}
+
+void LineRenderer::latchPalettes() {
+  // Palettes change very rarely (mostly for fade in/out effects), so
+  // most of the time this is just three comparisons.
+  if (line->BGP != latchedBGP) {
+    latchedBGP = line->BGP;
+    buildPalette(latchedBGP, paletteBG);
+  }
+
+  if (line->OBP0 != latchedOBP0) {
+    latchedOBP0 = line->OBP0;
+    buildPalette(latchedOBP0, palette0);
+  }
+
+  if (line->OBP1 != latchedOBP1) {
+    latchedOBP1 = line->OBP1;
+    buildPalette(latchedOBP1, palette1);
+  }
+}
+
+bool LineRenderer::drawLine(const LineState& state, const word* vramData, color* screenBuffer) {
+  assert(state.LY < PPU::HEIGHT && "Only visible lines can be drawn.");
+  line = &state;
+  vram = vramData;
+
+  latchPalettes();
+  prepareBackgroundLine();
+  prepareWindowLine();
+  computeColorBuffers();
+  flushLineToOutputLine();
+  computeAndFlushSpritesToOutputLine();
+
+  // Only touch screen buffer if something actually changed.
+  color* screenLine = screenBuffer + line->LY * PPU::WIDTH;
+  const bool changed = !std::equal(outputLine.begin(), outputLine.end(), screenLine);
+  if (changed) {
+    std::copy(outputLine.begin(), outputLine.end(), screenLine);
+  }
+
+  line = nullptr;
+  vram = nullptr;
+  return changed;
+}
+
+void LineRenderer::prepareBackgroundLine() {
+  if (!LCDC(PPU::BG_WINDOW_ENABLE)) {
+    backgroundLineBufferLsb.fill(0);
+    backgroundLineBufferMsb.fill(0);
+    return;
+  }
+  // This is all straight from docs
+  const dword tilemapBaseAddress = getTilemapBaseAddress(false);
+  const dword tiledataBaseAddress = getTiledataBaseAddress();
+  const bool  isAddressing8000 = tiledataBaseAddress == TILEDATA_BASE_8000;
+
+  // This is the current tile we are drawing. We need to take into account the scrolling!
+  const int tileY = ((line->LY + line->SCY) / 8) % PPU::TILEMAP_SIDE_SIZE;
+
+  // Loop through each tile in the current line
+  for (int tileX = 0; tileX != PPU::TILEMAP_SIDE_SIZE; ++tileX) {
+    // Tile numbers are in a 32x32 grid. We want to loop over the full line at current tileY.
+    const dword tileNumberAddress = tilemapBaseAddress + (tileX + tileY*PPU::TILEMAP_SIDE_SIZE);
+    const word tileNumber_u = readVRAM(tileNumberAddress);
+    const auto tileNumber_s = static_cast<signed char>(readVRAM(tileNumberAddress));
+
+    // Starting from tiledataBase address, we have the tiles indexed by their tile number.
+    // Each tile takes 2 words per 8 lines of space.
+    assert(PPU::TILE_SIZE_IN_WORDS == 2 * 8);
+    // So, first we compute the offset given by the tile number, using the correct addressing method...
+    const int tiledataTileOffset = isAddressing8000
+                                   ? (tileNumber_u * PPU::TILE_SIZE_IN_WORDS)
+                                   : (tileNumber_s * PPU::TILE_SIZE_IN_WORDS);
+
+    // Then, we need to choose the line of the tile we are drawing right now. Each line is two words.
+    // We have already computed the scrolling (we are selecting the tile at the scrolled posiiton) but we still need
+    // LY and SCY to compute the line (taking modulo 8 = width of a tile).
+    assert(PPU::TILE_WIDTH == 8);
+    const int tileDataRowOffset = PPU::WORDS_PER_TILE_LINE * ((line->SCY + line->LY) % PPU::TILE_WIDTH);
+
+    // Then we sum the two offsets.
+    const dword tiledataAddress = tiledataBaseAddress + tiledataTileOffset + tileDataRowOffset;
+
+    backgroundLineBufferLsb[tileX] = readVRAM(tiledataAddress);
+    backgroundLineBufferMsb[tileX] = readVRAM(tiledataAddress + 1);
+  }
+}
+
+void LineRenderer::prepareWindowLine() {
+  if (!LCDC(PPU::BG_WINDOW_ENABLE)) {
+    windowLineBufferLsb.fill(0);
+    windowLineBufferMsb.fill(0);
+    return;
+  }
+
+  // We can spare ourselves some additional computation if we check here if
+  // the last pixel of the line is outside the window.
+  if (!isPositionInsideWindow(PPU::WIDTH - 1, line->LY)) {
+    return;
+  }
+
+  const dword tilemapBaseAddress = getTilemapBaseAddress(true);
+  const dword tiledataBaseAddress = getTiledataBaseAddress();
+  const bool  isAddressing8000 = tiledataBaseAddress == TILEDATA_BASE_8000;
+
+  // This is the current tile we are drawing. We need to take into account the scrolling!
+  // Here, the modulus is added just in case we are drawing outside the window
+  assert(PPU::TILE_WIDTH == 8);
+  const int tileY = ((line->LY - line->WY) / PPU::TILE_WIDTH) % PPU::TILEMAP_SIDE_SIZE;
+
+  // Loop through each tile in the current line
+  for (int tileX = 0; tileX != PPU::TILEMAP_SIDE_SIZE; ++tileX) {
+    // Tile numbers are in a 32x32 grid. We want to loop over the full line at current tileY.
+    const dword tileNumberAddress = tilemapBaseAddress + (tileX + tileY*PPU::TILEMAP_SIDE_SIZE);
+    const word tileNumber_u = readVRAM(tileNumberAddress);
+    const auto tileNumber_s = static_cast<signed char>(readVRAM(tileNumberAddress));
+
+    // Starting from tiledataBase address, we have the tiles indexed by their tile number.
+    // Each tile takes 2 words per 8 lines of space.
+    assert(PPU::TILE_SIZE_IN_WORDS == 2 * 8);
+    // So, first we compute the offset given by the tile number, using the correct addressing method...
+    const int tiledataTileOffset = isAddressing8000
+                                   ? (tileNumber_u * PPU::TILE_SIZE_IN_WORDS)
+                                   : (tileNumber_s * PPU::TILE_SIZE_IN_WORDS);
+
+    // Then, we need to choose the line of the tile we are drawing right now. Each line is two words.
+    // We have already computed the scrolling (we are selecting the tile at the scrolled posiiton) but we still need
+    // LY and SCY to compute the line (taking modulo 8 = width of a tile).
+    const int tileDataRowOffset = PPU::WORDS_PER_TILE_LINE * ((line->LY-line->WY) % PPU::TILE_WIDTH);
+
+    // Then we sum the two offsets.
+    const dword tiledataAddress = tiledataBaseAddress + tiledataTileOffset + tileDataRowOffset;
+
+    windowLineBufferLsb[tileX] = readVRAM(tiledataAddress);
+    windowLineBufferMsb[tileX] = readVRAM(tiledataAddress + 1);
+  }
+}
+
+void LineRenderer::computeColorBuffers() {
+  for (int tileX = 0; tileX != PPU::TILEMAP_SIDE_SIZE; ++tileX) {
+    const std::bitset<8> backgroundMsb = backgroundLineBufferMsb[tileX];
+    const std::bitset<8> backgroundLsb = backgroundLineBufferLsb[tileX];
+    const std::bitset<8> windowMsb = windowLineBufferMsb[tileX];
+    const std::bitset<8> windowLsb = windowLineBufferLsb[tileX];
+
+    for (int bit = 0; bit != 8; ++bit) {
+      // Here 7 is not the magic number WX_SHIFT!
+      const int pixelX = tileX * 8 + (7 - bit);
+
+      const color backgroundValue = backgroundMsb[bit] << 1 | backgroundLsb[bit];
+      backgroundLineBuffer[pixelX] = backgroundValue;
+
+      const color windowValue = windowMsb[bit] << 1 | windowLsb[bit];
+      windowLineBuffer[pixelX] = windowValue;
+    }
+  }
+}
+
+void LineRenderer::flushLineToOutputLine() {
+  for (int x = 0; x != PPU::WIDTH; ++x) {
+    const color value = isPositionInsideWindow(x, line->LY)
+      ? windowLineBuffer[(x - line->WX + PPU::WX_SHIFT) % (PPU::TILEMAP_SIDE_SIZE * PPU::TILE_WIDTH)]
+      : applyPaletteBG(backgroundLineBuffer[(x + line->SCX) % (PPU::TILEMAP_SIDE_SIZE * PPU::TILE_WIDTH)]);
+
+    outputLine[x] = value;
+  }
+}
+
+bool LineRenderer::isPositionInsideWindow(const int x, const int y) const {
+  if (!LCDC(PPU::WINDOW_DISPLAY_ENABLE)) {
+    return false;
+  }
+
+  return y >= line->WY && x >= line->WX - PPU::WX_SHIFT;
+}
+
+dword LineRenderer::getTilemapBaseAddress(const bool drawingWindow) const {
+   const bool bankSwitchCond
+     =  (!drawingWindow && LCDC(PPU::BG_TILE_MAP_SELECT))
+     || (drawingWindow && LCDC(PPU::WINDOW_TILE_MAP_SELECT));
+
+   if (bankSwitchCond) {
+     return TILEMAP_BASE_1;
+   }
+
+   return TILEMAP_BASE_0;
+}
+
+dword LineRenderer::getTiledataBaseAddress() const {
+  return LCDC(PPU::TILE_DATA_SELECT_MODE)
+    ? TILEDATA_BASE_8000
+    : TILEDATA_BASE_9000;
+}
+
+int LineRenderer::getSpriteHeight() const {
+  if (LCDC(PPU::SPRITE_SIZE)) {
+    // Game is running in double height sprite mode!
+    return 16;
+  }
+
+  return 8;
+}
+
+// TODO this is very long and ugly. It needs to be refactored.
+// Todo sprites are not correcyly scrolled in fromn the left.
+// Todo There is still some jankyness when a sprite is flipped along both axes
+void LineRenderer::computeAndFlushSpritesToOutputLine() {
+  if (!LCDC(PPU::SPRITE_ENABLE)) {
+     return;
+  }
+
+  std::array<color, 8> spritePixels;
+  for (int i = 0; i != line->spriteCount; ++i) {
+    const Sprite& sprite = line->sprites[i];
+    // First, fetch the tile we are currently drawing.
+    // Sprites always use 8000 addressing method.
+    const word spriteLine = line->LY - (sprite.yPos - PPU::MAX_SPRITE_HEIGHT);
+    bool drawingBottomTile = spriteLine > 7;
+    assert(spriteLine < PPU::MAX_SPRITE_HEIGHT && "Only visible sprites should be added to buffer. Something went wrong.");
+    word tileNumber;
+
+    if (sprite.flags[6]) {
+     drawingBottomTile = !drawingBottomTile;
+    }
+
+    static constexpr word bottomTileBitmask = 0b00000001; // see docs
+    static constexpr word topTileBitmask    = 0b11111110; // see docs
+
+    if (getSpriteHeight() == 8) {
+     tileNumber = sprite.tileNumber;
+    } else if (drawingBottomTile) {
+     tileNumber = sprite.tileNumber | bottomTileBitmask;
+    } else {
+     tileNumber = sprite.tileNumber & topTileBitmask; // see docs
+    }
+    const int tiledataTileOffset = tileNumber * PPU::TILE_SIZE_IN_WORDS;
+
+    // Then, we need to choose the line of the tile we are drawing right now. Each line is two words.
+    assert(sprite.yPos != 0);
+    const int tileDataRowOffset = sprite.flags[6]
+    ? PPU::WORDS_PER_TILE_LINE * (PPU::TILE_WIDTH - ( line->LY - (sprite.yPos - PPU::MAX_SPRITE_HEIGHT)) % PPU::TILE_WIDTH)
+    : PPU::WORDS_PER_TILE_LINE * (( line->LY - (sprite.yPos - PPU::MAX_SPRITE_HEIGHT)) % PPU::TILE_WIDTH);
+
+    const std::bitset<8> tileDataLsb = readVRAM(TILEDATA_BASE_8000 + tiledataTileOffset + tileDataRowOffset);
+    const std::bitset<8> tileDataMsb = readVRAM(TILEDATA_BASE_8000 + tiledataTileOffset + tileDataRowOffset + 1);
+
+    // Convert data to color format
+    for (int bit = 0; bit != PPU::SPRITE_WIDTH; ++bit) {
+      const color value = tileDataMsb[bit] << 1 | tileDataLsb[bit];
+      // Here 7 is not the magic WX_SHIFT!
+      spritePixels[7-bit] = value;
+    }
+
+    // Then, draw each pixel of the sprite onto the screen.
+    const PaletteLUT& palette = sprite.flags[4] ? palette1 : palette0;
+    for (int spriteX = 0; spriteX != PPU::SPRITE_WIDTH; ++spriteX) {
+      const int screenX = spriteX - PPU::SPRITE_WIDTH + sprite.xPos;
+
+      if (screenX >= PPU::WIDTH || screenX < 0) {
+        break;
+      }
+
+      const bool flipX = sprite.flags[5];
+      const color value = spritePixels[flipX ? 7 - spriteX : spriteX];
+      if (value == 0) {
+        continue;
+      }
+
+      // Priority flag
+      if (!sprite.flags[7] || backgroundLineBuffer[screenX] == 0) {
+        outputLine[screenX] = palette[value];
+      }
+    }
+  }
+}
+
+}  // namespace gb
@@ -0,0 +1,95 @@
+#ifndef LINE_RENDERER_H
+#define LINE_RENDERER_H
+
+#include <array>
+#include <bitset>
+
+#include "ppu.hpp"
+#include "types.hpp"
+
+namespace gb {
+
+// Draws a single line to the screen buffer, given the latched state of the
+// PPU for that line and the content of VRAM.
+// This does not access the address bus at all, so that it can be run
+// either by the PPU itself or by a separate render thread (see RenderThread),
+// which keeps its own copy of VRAM.
+class LineRenderer {
+ public:
+  typedef PPU::color color;
+  typedef PPU::LineState LineState;
+  typedef PPU::Sprite Sprite;
+
+  // Palettes are stored as lookup tables (one output color for each of the four
+  // input colors). The tables are rebuilt only when the value of the
+  // corresponding register changes, and that check is done once per line
+  // (see latchPalettes) instead of reading the register for each pixel.
+  typedef std::array<color, 4> PaletteLUT;
+
+ private:
+  // Store data encoded in two-word-per-8-pixel format
+  std::array<word, PPU::TILEMAP_SIDE_SIZE> backgroundLineBufferLsb{};
+  std::array<word, PPU::TILEMAP_SIDE_SIZE> backgroundLineBufferMsb{};
+  std::array<word, PPU::TILEMAP_SIDE_SIZE> windowLineBufferLsb{};
+  std::array<word, PPU::TILEMAP_SIDE_SIZE> windowLineBufferMsb{};
+  std::array<color, PPU::TILEMAP_SIDE_SIZE * PPU::TILE_WIDTH> backgroundLineBuffer{};
+  std::array<color, PPU::TILEMAP_SIDE_SIZE * PPU::TILE_WIDTH> windowLineBuffer{};
+  // Line is composed here first, then copied to screen buffer.
+  std::array<color, PPU::WIDTH> outputLine{};
+
+  word latchedBGP{0};
+  word latchedOBP0{0};
+  word latchedOBP1{0};
+  PaletteLUT paletteBG{};
+  PaletteLUT palette0{};
+  PaletteLUT palette1{};
+
+  // Line currently being drawn, and VRAM it has to be drawn from.
+  // VRAM is indexed starting from VRAM_LOWER_BOUND.
+  const LineState* line{ nullptr };
+  const word* vram{ nullptr };
+
+  bool LCDC(PPU::LCDC_BIT flag) const;
+  word readVRAM(dword address) const;
+
+  // Rebuild palette lookup tables if registers changed.
+  void latchPalettes();
+  static void buildPalette(word reg, PaletteLUT& lut);
+
+  // This prepares all the tile data needed to draw the (full 32 tile) current
+  // line and stores it in 2-byte-per-8-pixel format in
+  // backgroundLineBufferLsb/msb
+  void prepareBackgroundLine();
+  // Same but for window
+  void prepareWindowLine();
+  // TODO prepareXLine are two functions which are extremely similar. They could
+  //  probably be refactored in a way that code duplication is reduced.
+  // This converts the buffer format to a more suitable one for the
+  // current code structure and saves the result to
+  // backgroundLineBuffer, windowLineBuffer
+  void computeColorBuffers();
+  // Flush background/window (first) to output line; then,
+  // overwrite sprites (with transparency).
+  void flushLineToOutputLine();
+  void computeAndFlushSpritesToOutputLine();
+
+  // Helper functions for drawing //////////////////////////////////////////////
+  dword getTilemapBaseAddress(bool drawingWindow) const;
+  dword getTiledataBaseAddress() const;
+  bool  isPositionInsideWindow(int x, int y) const;
+  int   getSpriteHeight() const;
+
+ public:
+  // Draw line state.LY to screenBuffer (which has to hold
+  // PPU::WIDTH * PPU::HEIGHT pixels).
+  // Returns true if the line is different from what was there before.
+  bool drawLine(const LineState& state, const word* vramData, color* screenBuffer);
+
+  color applyPalette0(color input) const;
+  color applyPalette1(color input) const;
+  color applyPaletteBG(color input) const;
+};
+
+}  // namespace gb
+
+#endif  // LINE_RENDERER_H
@@ -0,0 +1,283 @@
+#include "ppu-log.hpp"
+#include <cassert>
+#include <stdexcept>
+
+#include "line-renderer.hpp"
+
+namespace gb {
+
+constexpr std::array<char, 4> PPULog::MAGIC;
+constexpr dword PPULog::VERSION;
+constexpr int PPULog::VRAM_SIZE;
+constexpr std::size_t PPULogWriter::BUFFER_SIZE;
+
+// Writer //////////////////////////////////////////////////////////////////////
+PPULogWriter::PPULogWriter(const std::string& path, const int keyframeInterval)
+  : output{ path, std::ios_base::binary }
+  , keyframeInterval{ keyframeInterval } {
+  if (output.fail()) {
+    throw std::runtime_error("Error opening PPU log file for writing!");
+  }
+  if (keyframeInterval <= 0) {
+    throw std::runtime_error("PPU log keyframe interval must be positive.");
+  }
+
+  buffer.reserve(BUFFER_SIZE);
+  output.write(PPULog::MAGIC.data(), PPULog::MAGIC.size());
+  put16(PPULog::VERSION);
+  put16(keyframeInterval);
+}
+
+PPULogWriter::~PPULogWriter() {
+  flush();
+}
+
+void PPULogWriter::put8(const word value) {
+  buffer.push_back(value);
+}
+
+void PPULogWriter::put16(const dword value) {
+  put8(value & 0xFF);
+  put8(value >> 8);
+}
+
+void PPULogWriter::put32(const unsigned long value) {
+  put16(value & 0xFFFF);
+  put16((value >> 16) & 0xFFFF);
+}
+
+void PPULogWriter::flush() {
+  output.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+  buffer.clear();
+}
+
+void PPULogWriter::makeRoom(const std::size_t size) {
+  if (buffer.size() + size > BUFFER_SIZE) {
+    flush();
+  }
+}
+
+void PPULogWriter::writeVRAM(const dword address, const word value) {
+  if (!started) {
+    return;
+  }
+
+  makeRoom(4);
+  put8(PPULog::VRAM_WRITE);
+  put16(address);
+  put8(value);
+}
+
+void PPULogWriter::writeLine(const PPU::LineState& line, const word* vram) {
+  // Worst case: a keyframe followed by a line with all its sprites.
+  makeRoom(5 + PPULog::VRAM_SIZE + 11 + 4 * PPU::MAX_SPRITES_PER_LINE);
+  if (line.LY == 0) {
+    if (started) {
+      ++frameNumber;
+    }
+    started = true;
+
+    if (frameNumber % keyframeInterval == 0) {
+      put8(PPULog::KEYFRAME);
+      put32(frameNumber);
+      buffer.insert(buffer.end(), vram, vram + PPULog::VRAM_SIZE);
+    }
+  }
+
+  if (!started) {
+    return;
+  }
+
+  put8(PPULog::LINE);
+  put8(line.LY);
+  put8(line.LCDC);
+  put8(line.SCY);
+  put8(line.SCX);
+  put8(line.WY);
+  put8(line.WX);
+  put8(line.BGP);
+  put8(line.OBP0);
+  put8(line.OBP1);
+  put8(line.spriteCount);
+  for (int i = 0; i != line.spriteCount; ++i) {
+    const auto& sprite = line.sprites[i];
+    put8(sprite.yPos);
+    put8(sprite.xPos);
+    put8(sprite.tileNumber);
+    put8(sprite.flags.to_ulong());
+  }
+}
+
+// Reader //////////////////////////////////////////////////////////////////////
+PPULogReader::PPULogReader(const std::string& path) : input{ path, std::ios_base::binary } {
+  if (input.fail()) {
+    throw std::runtime_error("Error opening PPU log file!");
+  }
+
+  std::array<char, 4> magic{};
+  input.read(magic.data(), magic.size());
+  if (input.fail() || magic != PPULog::MAGIC) {
+    throw std::runtime_error("Invalid PPU log file.");
+  }
+
+  const dword version = get16();
+  if (version != PPULog::VERSION) {
+    throw std::runtime_error("Unsupported PPU log version.");
+  }
+
+  keyframeInterval = get16();
+}
+
+word PPULogReader::get8() {
+  const auto value = input.get();
+  if (value == std::char_traits<char>::eof()) {
+    throw std::runtime_error("Unexpected end of PPU log.");
+  }
+  return static_cast<word>(value);
+}
+
+dword PPULogReader::get16() {
+  const dword lsb = get8();
+  const dword msb = get8();
+  return lsb | (msb << 8);
+}
+
+unsigned long PPULogReader::get32() {
+  const unsigned long lsb = get16();
+  const unsigned long msb = get16();
+  return lsb | (msb << 16);
+}
+
+int PPULogReader::getKeyframeInterval() const {
+  return keyframeInterval;
+}
+
+std::vector<PPULogReader::Keyframe> PPULogReader::indexKeyframes() {
+  constexpr int lineHeaderSize{ 9 };
+  constexpr int spriteSize{ 4 };
+  std::vector<Keyframe> keyframes;
+
+  // Start right after the header
+  input.clear();
+  input.seekg(PPULog::MAGIC.size() + 4);
+  std::streamoff position = input.tellg();
+
+  // Keep track of the position by hand, as tellg can be slow.
+  while (input.peek() != std::char_traits<char>::eof()) {
+    const auto type = get8();
+
+    switch (type) {
+      case PPULog::KEYFRAME:
+        keyframes.push_back({ position, get32() });
+        input.seekg(PPULog::VRAM_SIZE, std::ios_base::cur);
+        position += 1 + 4 + PPULog::VRAM_SIZE;
+        break;
+
+      case PPULog::VRAM_WRITE:
+        input.seekg(3, std::ios_base::cur);
+        position += 1 + 3;
+        break;
+
+      case PPULog::LINE: {
+        input.seekg(lineHeaderSize, std::ios_base::cur);
+        const int spriteCount = get8();
+        input.seekg(spriteCount * spriteSize, std::ios_base::cur);
+        position += 1 + lineHeaderSize + 1 + spriteCount * spriteSize;
+        break;
+      }
+
+      default:
+        throw std::runtime_error("Invalid record in PPU log.");
+    }
+  }
+
+  return keyframes;
+}
+
+void PPULogReader::renderSegment(const std::streamoff begin, const std::streamoff end, const FrameCallback& onFrame) {
+  std::array<word, PPULog::VRAM_SIZE> vram{};
+  std::array<PPU::color, PPU::TOTAL_PIXELS> screenBuffer{};
+  LineRenderer renderer;
+  PPU::LineState line;
+
+  unsigned long frameNumber{ 0 };
+  bool frameStarted{ false };
+
+  input.clear();
+  input.seekg(begin);
+  if (input.peek() != PPULog::KEYFRAME) {
+    throw std::runtime_error("PPU log segments must start with a keyframe.");
+  }
+
+  // Keep track of the position by hand, as tellg can be slow.
+  std::streamoff position = begin;
+  while (end < 0 || position < end) {
+    if (input.peek() == std::char_traits<char>::eof()) {
+      break;
+    }
+
+    const auto type = get8();
+    switch (type) {
+      case PPULog::KEYFRAME:
+        frameNumber = get32();
+        frameStarted = false;
+        input.read(reinterpret_cast<char*>(vram.data()), vram.size());
+        position += 1 + 4 + PPULog::VRAM_SIZE;
+        break;
+
+      case PPULog::VRAM_WRITE: {
+        const dword address = get16();
+        const word value = get8();
+        if (address < VRAM_LOWER_BOUND || address >= VRAM_UPPER_BOUND) {
+          throw std::runtime_error("Invalid VRAM write in PPU log.");
+        }
+        vram[address - VRAM_LOWER_BOUND] = value;
+        position += 1 + 3;
+        break;
+      }
+
+      case PPULog::LINE: {
+        line.LY = get8();
+        line.LCDC = get8();
+        line.SCY = get8();
+        line.SCX = get8();
+        line.WY = get8();
+        line.WX = get8();
+        line.BGP = get8();
+        line.OBP0 = get8();
+        line.OBP1 = get8();
+        line.spriteCount = get8();
+        if (line.LY >= PPU::HEIGHT || line.spriteCount > PPU::MAX_SPRITES_PER_LINE) {
+          throw std::runtime_error("Invalid line in PPU log.");
+        }
+        for (int i = 0; i != line.spriteCount; ++i) {
+          auto& sprite = line.sprites[i];
+          sprite.yPos = get8();
+          sprite.xPos = get8();
+          sprite.tileNumber = get8();
+          sprite.flags = get8();
+        }
+        position += 1 + 10 + line.spriteCount * 4;
+
+        if (line.LY == 0) {
+          if (frameStarted) {
+            ++frameNumber;
+          }
+          frameStarted = true;
+        }
+
+        renderer.drawLine(line, vram.data(), screenBuffer.data());
+
+        if (line.LY == PPU::HEIGHT - 1 && frameStarted) {
+          onFrame(frameNumber, screenBuffer.data());
+        }
+        break;
+      }
+
+      default:
+        throw std::runtime_error("Invalid record in PPU log.");
+    }
+  }
+}
+
+}  // namespace gb
@@ -0,0 +1,111 @@
+#ifndef PPU_LOG_H
+#define PPU_LOG_H
+
+#include <array>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ppu.hpp"
+#include "types.hpp"
+
+namespace gb {
+
+// The PPU input log stores everything that is needed to draw frames after
+// emulation has finished: VRAM writes and the latched state of each line
+// (see PPU::LineState), in the order they happened. A full copy of VRAM
+// (keyframe) is stored at the start of every N frames, so that the log can be
+// split in independent segments and rendered in parallel.
+//
+// Format (multi-byte values are little-endian):
+//  header:   "GBPL" | u16 version | u16 keyframe interval
+//  records:  u8 record type | payload
+//    KEYFRAME:   u32 frame number | VRAM (8KiB)
+//    VRAM_WRITE: u16 address | u8 value
+//    LINE:       LY, LCDC, SCY, SCX, WY, WX, BGP, OBP0, OBP1 (u8 each) |
+//                u8 sprite count | sprites (y, x, tile number, flags; u8 each)
+struct PPULog {
+  static constexpr std::array<char, 4> MAGIC{ { 'G', 'B', 'P', 'L' } };
+  static constexpr dword VERSION{ 1 };
+  static constexpr int VRAM_SIZE{ VRAM_UPPER_BOUND - VRAM_LOWER_BOUND };
+
+  typedef enum : word {
+    KEYFRAME   = 1,
+    VRAM_WRITE = 2,
+    LINE       = 3
+  } RecordType;
+};
+
+class PPULogWriter {
+  std::ofstream output;
+  // Records are buffered here and written to file in big chunks.
+  std::vector<word> buffer;
+  static constexpr std::size_t BUFFER_SIZE{ 1u << 16 };
+
+  int keyframeInterval;
+  unsigned long frameNumber{ 0 };
+  // Nothing gets logged until the first line of a frame, which
+  // always starts with a keyframe.
+  bool started{ false };
+
+  void put8(word value);
+  void put16(dword value);
+  void put32(unsigned long value);
+  void flush();
+  // Flushes first if size more bytes would not fit in buffer, so that
+  // buffer never needs to grow.
+  void makeRoom(std::size_t size);
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // @throws if the output file can not be opened.
+  PPULogWriter(const std::string& path, int keyframeInterval);
+  ~PPULogWriter();
+
+  PPULogWriter(const PPULogWriter&) = delete;
+  PPULogWriter& operator=(const PPULogWriter&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  void writeVRAM(dword address, word value);
+  // vram is needed to write keyframes.
+  void writeLine(const PPU::LineState& line, const word* vram);
+};
+
+class PPULogReader {
+  std::ifstream input;
+  int keyframeInterval{ 0 };
+
+  word get8();
+  dword get16();
+  unsigned long get32();
+
+ public:
+  struct Keyframe {
+    std::streamoff offset;
+    unsigned long frameNumber;
+  };
+
+  // Called for each complete frame, with the frame number and the
+  // screen buffer (PPU::WIDTH * PPU::HEIGHT pixels).
+  typedef std::function<void(unsigned long, const PPU::color*)> FrameCallback;
+
+  // Constructor ///////////////////////////////////////////////////////////////
+  // @throws if the file can not be opened or is not a valid log.
+  explicit PPULogReader(const std::string& path);
+  //////////////////////////////////////////////////////////////////////////////
+
+  int getKeyframeInterval() const;
+
+  // Scan the whole log and find where each keyframe is.
+  std::vector<Keyframe> indexKeyframes();
+
+  // Draw all frames from the keyframe at offset begin up to end (excluded,
+  // use -1 for end of file). Segments that start at different keyframes are
+  // independent and can be rendered at the same time by different readers.
+  void renderSegment(std::streamoff begin, std::streamoff end, const FrameCallback& onFrame);
+};
+
+}  // namespace gb
+
+#endif  // PPU_LOG_H
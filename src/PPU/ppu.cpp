@@ -1,9 +1,13 @@
 #include "ppu.hpp"
 #include <bitset>
 #include <cassert>
+#include <stdexcept>
 #include <gameboy.hpp>
 
 #include "address-bus.hpp"
+#include "line-renderer.hpp"
+#include "render-thread.hpp"
+#include "save-state.hpp"
 
 namespace gb {
 
@@ -77,17 +81,19 @@ void PPU::LY(const word value) const {
   bus->write(REG_LY, value, AddressBus::PPU);
 }
 
+// Palettes are applied using the values of the registers
+// latched for the last drawn line.
 PPU::color PPU::applyPalette0(gb::PPU::color input) const {
-  const auto shift = input.to_ulong() * 2;
-  return (bus->read(REG_OBP0) & (0b11 << shift)) >> shift;
+  const auto shift = input * 2;
+  return (currentLine.OBP0 >> shift) & 0b11;
 }
 PPU::color PPU::applyPalette1(gb::PPU::color input) const {
-  const auto shift = input.to_ulong() * 2;
-  return (bus->read(REG_OBP1) & (0b11 << shift)) >> shift;
+  const auto shift = input * 2;
+  return (currentLine.OBP1 >> shift) & 0b11;
 }
 PPU::color PPU::applyPaletteBG(gb::PPU::color input) const {
-  const auto shift = input.to_ulong() * 2;
-  return (bus->read(REG_BGP) & (0b11 << shift)) >> shift;
+  const auto shift = input * 2;
+  return (currentLine.BGP >> shift) & 0b11;
 }
 
 void PPU::lineEndLogic(const word ly) {
@@ -141,108 +147,52 @@ void PPU::lineEndLogic(const word ly) {
   STATAlreadyRequestedThisLine = false;
 }
 
-void PPU::prepareBackgroundLine() {
-  if (!LCDC(BG_WINDOW_ENABLE)) {
-    backgroundLineBufferLsb.fill(0);
-    backgroundLineBufferMsb.fill(0);
-    return;
+void PPU::drawCurrentLine() {
+  // Sprites have already been selected during OAM scan. Here,
+  // we latch all the registers that are needed to draw the line.
+  currentLine.LY   = LY();
+  currentLine.LCDC = bus->read(REG_LCDC);
+  currentLine.SCY  = SCY();
+  currentLine.SCX  = SCX();
+  currentLine.WY   = WY();
+  currentLine.WX   = WX();
+  currentLine.BGP  = bus->read(REG_BGP);
+  currentLine.OBP0 = bus->read(REG_OBP0);
+  currentLine.OBP1 = bus->read(REG_OBP1);
+
+  if (gameboy->ppuLog) {
+    gameboy->ppuLog->writeLine(currentLine, bus->getVRAM());
   }
-  // This is all straight from docs
-  const dword tilemapBaseAddress = getTilemapBaseAddress(false);
-  const dword tiledataBaseAddress = getTiledataBaseAddress();
-  const bool  isAddressing8000 = tiledataBaseAddress == TILEDATA_BASE_8000;
-
-  // This is the current tile we are drawing. We need to take into account the scrolling!
-  const int tileY = ((LY() + SCY()) / 8) % TILEMAP_SIDE_SIZE;
-
-  // Loop through each tile in the current line
-  for (int tileX = 0; tileX != TILEMAP_SIDE_SIZE; ++tileX) {
-    // Tile numbers are in a 32x32 grid. We want to loop over the full line at current tileY.
-    const dword tileNumberAddress = tilemapBaseAddress + (tileX + tileY*TILEMAP_SIDE_SIZE);
-    const word tileNumber_u = bus->read(tileNumberAddress);
-    const auto tileNumber_s = static_cast<signed char>(bus->read(tileNumberAddress));
-
-    // Starting from tiledataBase address, we have the tiles indexed by their tile number.
-    // Each tile takes 2 words per 8 lines of space.
-    assert(TILE_SIZE_IN_WORDS == 2 * 8);
-    // So, first we compute the offset given by the tile number, using the correct addressing method...
-    const int tiledataTileOffset = isAddressing8000
-                                   ? (tileNumber_u * TILE_SIZE_IN_WORDS)
-                                   : (tileNumber_s * TILE_SIZE_IN_WORDS);
-
-    // Then, we need to choose the line of the tile we are drawing right now. Each line is two words.
-    // We have already computed the scrolling (we are selecting the tile at the scrolled posiiton) but we still need
-    // LY and SCY to compute the line (taking modulo 8 = width of a tile).
-    assert(TILE_WIDTH == 8);
-    const int tileDataRowOffset = WORDS_PER_TILE_LINE * ((SCY() + LY()) % TILE_WIDTH);
-
-    // Then we sum the two offsets.
-    const dword tiledataAddress = tiledataBaseAddress + tiledataTileOffset + tileDataRowOffset;
-
-    backgroundLineBufferLsb[tileX] = bus->read(tiledataAddress);
-    backgroundLineBufferMsb[tileX] = bus->read(tiledataAddress + 1);
+
+  // When rendering is disabled, screen buffer is just left as it is.
+  if (gameboy->renderingEnabled) {
+    if (gameboy->renderThread) {
+      // Render thread keeps its own copy of VRAM, so line will be drawn
+      // exactly as if it was drawn right now.
+      gameboy->renderThread->pushLine(currentLine);
+    } else {
+      const bool changed = renderer->drawLine(currentLine, bus->getVRAM(), gameboy->screenBuffer.data());
+      gameboy->screenChanges.lineDrawn(currentLine.LY, changed);
+    }
   }
+
+  resetOamBuffer();
 }
 
-void PPU::prepareWindowLine() {
-  if (!LCDC(BG_WINDOW_ENABLE)) {
-    windowLineBufferLsb.fill(0);
-    windowLineBufferMsb.fill(0);
-    return;
-  }
+void PPU::ScreenChanges::lineDrawn(const int ly, const bool changed) {
+  currentFrame[ly] = changed;
 
-  // We can spare ourselves some additional computation if we check here if
-  // the last pixel of the line is outside the window.
-  if (!isPositionInsideWindow(WIDTH - 1, LY())) {
+  if (ly != HEIGHT - 1) {
     return;
   }
 
-  const dword tilemapBaseAddress = getTilemapBaseAddress(true);
-  const dword tiledataBaseAddress = getTiledataBaseAddress();
-  const bool  isAddressing8000 = tiledataBaseAddress == TILEDATA_BASE_8000;
-
-  // This is the current tile we are drawing. We need to take into account the scrolling!
-  // Here, the modulus is added just in case we are drawing outside the window
-  assert(TILE_WIDTH == 8);
-  const int tileY = ((LY() - WY()) / TILE_WIDTH) % TILEMAP_SIDE_SIZE;
-
-  // Loop through each tile in the current line
-  for (int tileX = 0; tileX != TILEMAP_SIDE_SIZE; ++tileX) {
-    // Tile numbers are in a 32x32 grid. We want to loop over the full line at current tileY.
-    const dword tileNumberAddress = tilemapBaseAddress + (tileX + tileY*TILEMAP_SIDE_SIZE);
-    const word tileNumber_u = bus->read(tileNumberAddress);
-    const auto tileNumber_s = static_cast<signed char>(bus->read(tileNumberAddress));
-
-    // Starting from tiledataBase address, we have the tiles indexed by their tile number.
-    // Each tile takes 2 words per 8 lines of space.
-    assert(TILE_SIZE_IN_WORDS == 2 * 8);
-    // So, first we compute the offset given by the tile number, using the correct addressing method...
-    const int tiledataTileOffset = isAddressing8000
-                                   ? (tileNumber_u * TILE_SIZE_IN_WORDS)
-                                   : (tileNumber_s * TILE_SIZE_IN_WORDS);
-
-    // Then, we need to choose the line of the tile we are drawing right now. Each line is two words.
-    // We have already computed the scrolling (we are selecting the tile at the scrolled posiiton) but we still need
-    // LY and SCY to compute the line (taking modulo 8 = width of a tile).
-    const int tileDataRowOffset = WORDS_PER_TILE_LINE * ((LY()-WY()) % TILE_WIDTH);
-
-    // Then we sum the two offsets.
-    const dword tiledataAddress = tiledataBaseAddress + tiledataTileOffset + tileDataRowOffset;
-
-    windowLineBufferLsb[tileX] = bus->read(tiledataAddress);
-    windowLineBufferMsb[tileX] = bus->read(tiledataAddress + 1);
+  lastFrame = currentFrame;
+  ++framesDrawn;
+  if (lastFrame.any()) {
+    lastChangedFrame = framesDrawn;
   }
 }
 
-void PPU::drawCurrentLine() {
-  prepareBackgroundLine();
-  prepareWindowLine();
-  computeColorBuffers();
-  flushLineToScreenBuffer();
-  computeAndFlushSpritesToScreenBuffer();
-  resetOamBuffer();
-}
-
 void PPU::tryRequestSTATInterrupt() {
   // At most one stat interrupt per line
   if (STATAlreadyRequestedThisLine) {
@@ -252,67 +202,8 @@ void PPU::tryRequestSTATInterrupt() {
   gameboy->requestInterrupt(INTERRUPT_ID ::INTERRUPT_STAT);
 }
 
-void PPU::computeColorBuffers() {
-  for (int tileX = 0; tileX != TILEMAP_SIDE_SIZE; ++tileX) {
-    const std::bitset<8> backgroundMsb = backgroundLineBufferMsb[tileX];
-    const std::bitset<8> backgroundLsb = backgroundLineBufferLsb[tileX];
-    const std::bitset<8> windowMsb = windowLineBufferMsb[tileX];
-    const std::bitset<8> windowLsb = windowLineBufferLsb[tileX];
-
-    for (int bit = 0; bit != 8; ++bit) {
-      // Here 7 is not the magic number WX_SHIFT!
-      const int pixelX = tileX * 8 + (7 - bit);
-
-      const color backgroundValue = backgroundMsb[bit] << 1 | backgroundLsb[bit];
-      backgroundLineBuffer[pixelX] = backgroundValue;
-
-      const color windowValue = windowMsb[bit] << 1 | windowLsb[bit];
-      windowLineBuffer[pixelX] = windowValue;
-    }
-  }
-}
-
-void PPU::flushLineToScreenBuffer() const {
-  for (int x = 0; x != WIDTH; ++x) {
-    const color value = isPositionInsideWindow(x, LY())
-      ? windowLineBuffer[(x - WX() + WX_SHIFT) % (TILEMAP_SIDE_SIZE * TILE_WIDTH)]
-      : applyPaletteBG(backgroundLineBuffer[(x + SCX()) % (TILEMAP_SIDE_SIZE * TILE_WIDTH)]);
-
-    gameboy->screenBuffer[x + LY() * WIDTH] = value;
-  }
-}
-
-bool PPU::isPositionInsideWindow(const int x, const int y) const {
-  if (!LCDC(WINDOW_DISPLAY_ENABLE)) {
-    return false;
-  }
-
-  return y >= WY() && x >= WX() - WX_SHIFT;
-}
-
-dword PPU::getTilemapBaseAddress(const bool drawingWindow) const {
-   const bool bankSwitchCond
-     =  (!drawingWindow && LCDC(BG_TILE_MAP_SELECT))
-     || (drawingWindow && LCDC(WINDOW_TILE_MAP_SELECT));
-
-   if (bankSwitchCond) {
-     return TILEMAP_BASE_1;
-   }
-
-   return TILEMAP_BASE_0;
-}
-
-dword PPU::getTiledataBaseAddress() const {
-  return LCDC(TILE_DATA_SELECT_MODE)
-    ? TILEDATA_BASE_8000
-    : TILEDATA_BASE_9000;
-}
-
 void PPU::resetOamBuffer() {
-  // Reserve and clear won't cause reallocation after
-  // the space was allocated for the first time
-  OAMLineBuffer.clear();
-  OAMLineBuffer.reserve(MAX_SPRITES_PER_LINE);
+  currentLine.spriteCount = 0;
 }
 
 void PPU::addSpriteToBufferIfNeeded(const int spriteNumber) {
@@ -326,7 +217,7 @@ void PPU::addSpriteToBufferIfNeeded(const int spriteNumber) {
     .flags      = bus->read(spriteAddress + 3)
   };
 
-  if (OAMLineBuffer.size() == MAX_SPRITES_PER_LINE) {
+  if (currentLine.spriteCount == MAX_SPRITES_PER_LINE) {
      return;
   }
 
@@ -343,7 +234,8 @@ void PPU::addSpriteToBufferIfNeeded(const int spriteNumber) {
   }
   assert(sprite.yPos > 0);
 
-  OAMLineBuffer.push_back(sprite);
+  currentLine.sprites[currentLine.spriteCount] = sprite;
+  ++currentLine.spriteCount;
 }
 
 int PPU::getSpriteHeight() const {
@@ -354,88 +246,19 @@ int PPU::getSpriteHeight() const {
 
   return 8;
 }
-// TODO this is very long and ugly. It needs to be refactored.
-// Todo sprites are not correcyly scrolled in fromn the left.
-// Todo There is still some jankyness when a sprite is flipped along both axes
-void PPU::computeAndFlushSpritesToScreenBuffer() {
-  if (!LCDC(SPRITE_ENABLE)) {
-     return;
-  }
-
-  std::array<color, 8> spritePixels;
-  for (auto& sprite : OAMLineBuffer) {
-    // First, fetch the tile we are currently drawing.
-    // Sprites always use 8000 addressing method.
-    const word spriteLine = LY() - (sprite.yPos - MAX_SPRITE_HEIGHT);
-    bool drawingBottomTile = spriteLine > 7;
-    assert(spriteLine < MAX_SPRITE_HEIGHT && "Only visible sprites should be added to buffer. Something went wrong.");
-    word tileNumber;
-
-    if (sprite.flags[6]) {
-     drawingBottomTile = !drawingBottomTile;
-    }
-
-    static constexpr word bottomTileBitmask = 0b00000001; // see docs
-    static constexpr word topTileBitmask    = 0b11111110; // see docs
-
-    if (getSpriteHeight() == 8) {
-     tileNumber = sprite.tileNumber;
-    } else if (drawingBottomTile) {
-     tileNumber = sprite.tileNumber | bottomTileBitmask;
-    } else {
-     tileNumber = sprite.tileNumber & topTileBitmask; // see docs
-    }
-    const int tiledataTileOffset = tileNumber * TILE_SIZE_IN_WORDS;
-
-    // Then, we need to choose the line of the tile we are drawing right now. Each line is two words.
-    assert(sprite.yPos != 0);
-    const int tileDataRowOffset = sprite.flags[6]
-    ? WORDS_PER_TILE_LINE * (TILE_WIDTH - ( LY() - (sprite.yPos - MAX_SPRITE_HEIGHT)) % TILE_WIDTH)
-    : WORDS_PER_TILE_LINE * (( LY() - (sprite.yPos - MAX_SPRITE_HEIGHT)) % TILE_WIDTH);
-
-    const std::bitset<8> tileDataLsb = bus->read(TILEDATA_BASE_8000 + tiledataTileOffset + tileDataRowOffset);
-    const std::bitset<8> tileDataMsb = bus->read(TILEDATA_BASE_8000 + tiledataTileOffset + tileDataRowOffset + 1);
-
-    // Convert data to color format
-    for (int bit = 0; bit != SPRITE_WIDTH; ++bit) {
-      const color value = tileDataMsb[bit] << 1 | tileDataLsb[bit];
-      // Here 7 is not the magic WX_SHIFT!
-      spritePixels[7-bit] = value;
-    }
-
-    // Then, draw each pixel of the sprite onto the screen.
-    for (int spriteX = 0; spriteX != SPRITE_WIDTH; ++spriteX) {
-      const int screenX = spriteX - SPRITE_WIDTH + sprite.xPos;
-
-      if (screenX >= WIDTH || screenX < 0) {
-        break;
-      }
-
-      const bool flipX = sprite.flags[5];
-      const color value = spritePixels[flipX ? 7 - spriteX : spriteX];
-      if (value == 0) {
-        continue;
-      }
-
-      // Priority flag
-      if (!sprite.flags[7] || backgroundLineBuffer[screenX] == 0) {
-        const auto palettedValue = sprite.flags[4]
-           ? applyPalette1(value)
-           : applyPalette0(value);
-        gameboy->screenBuffer[screenX + LY() * WIDTH] = palettedValue;
-      }
-    }
-  }
-}
 
 PPU::PPU(Gameboy* gameboy, AddressBus* bus)
   : bus{ bus }
-  , gameboy{ gameboy } {
+  , gameboy{ gameboy }
+  , renderer{ std::make_unique<LineRenderer>() } {
   STAT(STAT_UNUSED_BIT, true);
   setPPUMode(OAM_SCAN); // TODO actually find a reference that states this is correct mode at boot
   resetOamBuffer();
 };
 
+// Defined here as LineRenderer is incomplete in header.
+PPU::~PPU() = default;
+
 // Todo this function is too long, it should be broken up into smaller pieces.
 void PPU::machineClock() {
   const PPU_MODE mode = getPPUMode();
@@ -487,7 +310,7 @@ void PPU::machineClock() {
       const int spriteIndex = currentLineClockCounter * spritesParsedPerClock;
 
       // If any of the sprites need to be drawn in the current line,
-      // then add them to OAMLineBuffer (only if there is still space).
+      // then add them to currentLine (only if there is still space).
       addSpriteToBufferIfNeeded(spriteIndex);
       addSpriteToBufferIfNeeded(spriteIndex + 1);
 
@@ -589,4 +412,57 @@ word PPU::LY() const {
   return bus->read(REG_LY);
 }
 
+// Save states /////////////////////////////////////////////////////////////////
+void PPU::saveState(state::Writer& writer) const {
+  writer.beginSection("PPU ");
+  writer.put16(currentLineClockCounter);
+  writer.putBool(STATAlreadyRequestedThisLine);
+  writer.put64(frameCount);
+
+  writer.put8(currentLine.LY);
+  writer.put8(currentLine.LCDC);
+  writer.put8(currentLine.SCY);
+  writer.put8(currentLine.SCX);
+  writer.put8(currentLine.WY);
+  writer.put8(currentLine.WX);
+  writer.put8(currentLine.BGP);
+  writer.put8(currentLine.OBP0);
+  writer.put8(currentLine.OBP1);
+  writer.put8(currentLine.spriteCount);
+  for (const auto& sprite : currentLine.sprites) {
+    writer.put8(sprite.yPos);
+    writer.put8(sprite.xPos);
+    writer.put8(sprite.tileNumber);
+    writer.put8(sprite.flags.to_ulong());
+  }
+  writer.endSection();
+}
+
+void PPU::loadState(state::Reader& reader) {
+  reader.requireSection("PPU ");
+  currentLineClockCounter = reader.get16();
+  STATAlreadyRequestedThisLine = reader.getBool();
+  frameCount = reader.get64();
+
+  currentLine.LY = reader.get8();
+  currentLine.LCDC = reader.get8();
+  currentLine.SCY = reader.get8();
+  currentLine.SCX = reader.get8();
+  currentLine.WY = reader.get8();
+  currentLine.WX = reader.get8();
+  currentLine.BGP = reader.get8();
+  currentLine.OBP0 = reader.get8();
+  currentLine.OBP1 = reader.get8();
+  currentLine.spriteCount = reader.get8();
+  if (currentLine.spriteCount > MAX_SPRITES_PER_LINE) {
+    throw std::runtime_error("Save state has an invalid sprite count!");
+  }
+  for (auto& sprite : currentLine.sprites) {
+    sprite.yPos = reader.get8();
+    sprite.xPos = reader.get8();
+    sprite.tileNumber = reader.get8();
+    sprite.flags = reader.get8();
+  }
+}
+
 } // namespace gb
\ No newline at end of file
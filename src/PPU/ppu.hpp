@@ -1,7 +1,9 @@
 #ifndef PPU_H
 #define PPU_H
 
+#include <array>
 #include <bitset>
+#include <memory>
 
 #include "address-bus.hpp"
 
@@ -9,6 +11,11 @@ namespace gb {
 
 class Gameboy;
 class AddressBus;
+class LineRenderer;
+namespace state {
+class Writer;
+class Reader;
+}
 
 class PPU {
   // Bare pointers are not ideal; see Gameboy
@@ -16,7 +23,9 @@ class PPU {
   Gameboy* gameboy;
 
 public:
-  typedef std::bitset<2> color;
+  // Shade of a pixel, from 0 (white) to 3 (black). One byte each, so that
+  // screen buffers can be handed out as plain arrays of bytes.
+  typedef word color;
 
   typedef enum {
     LCD_DISPLAY_ENABLE      = 7,
@@ -70,6 +79,40 @@ public:
   // For some reason, WX needs to be shifted by 7
   static constexpr int WX_SHIFT = 7;
 
+  // Everything the PPU needs to draw a line. Registers are latched when
+  // drawing starts; sprites are selected during OAM scan.
+  // Together with VRAM, this is enough to draw the line without
+  // going through the bus (see LineRenderer).
+  struct LineState {
+    word LY{};
+    word LCDC{};
+    word SCY{};
+    word SCX{};
+    word WY{};
+    word WX{};
+    word BGP{};
+    word OBP0{};
+    word OBP1{};
+    int spriteCount{0};
+    std::array<Sprite, MAX_SPRITES_PER_LINE> sprites{};
+  };
+
+  // Keeps track of which lines of the screen buffer actually changed, so
+  // that consumers do not need to compare the whole buffer each frame.
+  // This is updated by whoever draws the lines (PPU or render thread).
+  struct ScreenChanges {
+    // Lines changed in the frame that is being drawn, and in the
+    // last complete one.
+    std::bitset<HEIGHT> currentFrame{};
+    std::bitset<HEIGHT> lastFrame{};
+    // Complete frames drawn so far, and number of the last one
+    // (counting from 1) that was different from the one before.
+    unsigned long long framesDrawn{0};
+    unsigned long long lastChangedFrame{0};
+
+    void lineDrawn(int ly, bool changed);
+  };
+
 private:
   // Count how many machine clocks have been fired in this line.
   // This is needed to implement correct PPU timing.
@@ -78,14 +121,12 @@ private:
   // Only one STAT interrupt can be fired for each line.
   bool STATAlreadyRequestedThisLine{false};
 
-  // Store data encoded in two-word-per-8-pixel format
-  std::array<word, TILEMAP_SIDE_SIZE> backgroundLineBufferLsb{};
-  std::array<word, TILEMAP_SIDE_SIZE> backgroundLineBufferMsb{};
-  std::array<word, TILEMAP_SIDE_SIZE> windowLineBufferLsb{};
-  std::array<word, TILEMAP_SIDE_SIZE> windowLineBufferMsb{};
-  std::array<color, TILEMAP_SIDE_SIZE * TILE_WIDTH> backgroundLineBuffer{};
-  std::array<color, TILEMAP_SIDE_SIZE * TILE_WIDTH> windowLineBuffer{};
-  std::vector<Sprite> OAMLineBuffer{};
+  // State of the line that is currently being processed. Sprites get added
+  // to this during OAM scan.
+  LineState currentLine{};
+
+  // Draws lines to screen buffer when rendering is done on the emulation thread.
+  std::unique_ptr<LineRenderer> renderer;
 
   // Write to registers ////////////////////////////////////////////////////////
   // LCD Control Register (LCDC : $FF40)
@@ -105,36 +146,18 @@ private:
   void lineEndLogic(word ly);
   // Prepares which sprites need to be drawn
   void addSpriteToBufferIfNeeded(int spriteNumber);
-  // drawCurrentLine
+  // Latch registers and draw current line (either right away or
+  // on the render thread, if it is enabled).
   void drawCurrentLine();
-  // This prepares all the tile data needed to draw the (full 32 tile) current
-  // line and stores it in 2-byte-per-8-pixel format in
-  // backgroundLineBufferLsb/msb
-  void prepareBackgroundLine();
-  // Same but for window
-  void prepareWindowLine();
-  // TODO prepareXLine are two functions which are extremely similar. They could
-  //  probably be refactored in a way that code duplication is reduced.
-  // This converts the buffer format to a more suitable one for the
-  // current code structure and saves the result to
-  // backgroundLineBuffer, windowLineBuffer
-  void computeColorBuffers();
-  // Flush background/window (first) to screen buffer; then,
-  // overwrite sprites (with transparency).
-  void flushLineToScreenBuffer() const;
-  void computeAndFlushSpritesToScreenBuffer();
   // Finally, reset OAM buffer.
   void resetOamBuffer();
 
-  // Helper functions for drawing //////////////////////////////////////////////
-  dword getTilemapBaseAddress(bool drawingWindow) const;
-  dword getTiledataBaseAddress() const;
-  bool  isPositionInsideWindow(int x, int y) const;
-  int   getSpriteHeight() const;
+  int getSpriteHeight() const;
 
  public:
   // Constructor ///////////////////////////////////////////////////////////////
   PPU(Gameboy* gameboy, AddressBus* bus);
+  ~PPU();
   //////////////////////////////////////////////////////////////////////////////
 
   // How many frames have been drawn
@@ -143,7 +166,12 @@ private:
   // To be called exactly once for each machine cycle
   void machineClock();
 
-  // Apply palette to a color
+  // Save state section (see save-state.hpp).
+  void saveState(state::Writer& writer) const;
+  void loadState(state::Reader& reader);
+
+  // Apply palette to a color. Palettes are the ones that were
+  // used to draw the last line.
   color applyPalette0(color input) const;
   color applyPalette1(color input) const;
   color applyPaletteBG(color input) const;
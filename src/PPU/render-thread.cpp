@@ -0,0 +1,111 @@
+#include "render-thread.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace gb {
+
+constexpr std::size_t RenderThread::COMMAND_QUEUE_SIZE;
+constexpr std::size_t RenderThread::LINE_QUEUE_SIZE;
+
+// Constructor /////////////////////////////////////////////////////////////////
+RenderThread::RenderThread(const word* vramData, color* screenBuffer, PPU::ScreenChanges* screenChanges)
+  : screenBuffer{ screenBuffer }
+  , screenChanges{ screenChanges } {
+  std::copy(vramData, vramData + vram.size(), vram.begin());
+
+  // Thread is started last, so that everything else is initialized
+  thread = std::thread{ &RenderThread::run, this };
+}
+
+RenderThread::~RenderThread() {
+  running.store(false, std::memory_order_release);
+  thread.join();
+}
+
+// Methods /////////////////////////////////////////////////////////////////////
+void RenderThread::pushCommand(const Command& command) {
+  // If the queue is full, the emulation is running too far ahead.
+  // Just wait for the render thread to catch up.
+  while (!commands.push(command)) {
+    std::this_thread::yield();
+  }
+}
+
+void RenderThread::pushVRAMWrite(const dword address, const word value) {
+  assert(address >= VRAM_LOWER_BOUND && address < VRAM_UPPER_BOUND);
+  pushCommand({ VRAM_WRITE, value, address });
+}
+
+void RenderThread::pushLine(const PPU::LineState& line) {
+  // Line data has to be in its queue before the command referring to it
+  // is pushed.
+  while (!lines.push(line)) {
+    std::this_thread::yield();
+  }
+  pushCommand({ DRAW_LINE, 0, 0 });
+}
+
+void RenderThread::waitUntilIdle() const {
+  // Commands are popped only after they are fully processed.
+  while (!commands.empty()) {
+    std::this_thread::yield();
+  }
+}
+
+void RenderThread::resyncVRAM(const word* vramData) {
+  waitUntilIdle();
+  // Render thread is not touching VRAM now, and it will see these values as
+  // soon as it reads the next command (push has release semantics).
+  std::copy(vramData, vramData + vram.size(), vram.begin());
+}
+
+unsigned long long RenderThread::getFramesRendered() const {
+  return framesRendered.load(std::memory_order_acquire);
+}
+
+void RenderThread::run() {
+  // When there is nothing to do, spin for a bit and then start sleeping.
+  // A line is produced roughly every 100us when emulation runs at normal speed.
+  constexpr int maxIdleSpins{ 1000 };
+  constexpr std::chrono::microseconds idleSleep{ 50 };
+  int idleSpins{ 0 };
+
+  while (running.load(std::memory_order_acquire)) {
+    const Command* command = commands.front();
+
+    if (command == nullptr) {
+      if (idleSpins < maxIdleSpins) {
+        ++idleSpins;
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(idleSleep);
+      }
+      continue;
+    }
+    idleSpins = 0;
+
+    switch (command->type) {
+      case VRAM_WRITE:
+        vram[command->address - VRAM_LOWER_BOUND] = command->value;
+        break;
+
+      case DRAW_LINE: {
+        const PPU::LineState* line = lines.front();
+        assert(line != nullptr && "Line data should be pushed before its command.");
+
+        const bool changed = renderer.drawLine(*line, vram.data(), screenBuffer);
+        screenChanges->lineDrawn(line->LY, changed);
+        if (line->LY == PPU::HEIGHT - 1) {
+          framesRendered.fetch_add(1, std::memory_order_release);
+        }
+        lines.pop();
+        break;
+      }
+    }
+
+    commands.pop();
+  }
+}
+
+}  // namespace gb
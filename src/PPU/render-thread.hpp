@@ -0,0 +1,149 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#include "line-renderer.hpp"
+#include "ppu.hpp"
+#include "types.hpp"
+
+namespace gb {
+
+// Single-producer single-consumer lock-free ring buffer.
+// Producer and consumer indices are kept on separate cache lines, and each
+// side keeps a cached copy of the other index, so that the atomic
+// variables are touched only when the cached value is not enough.
+template <typename T, std::size_t N>
+class SPSCRing {
+  static_assert((N & (N - 1)) == 0, "Ring size must be a power of two.");
+  static constexpr std::size_t CACHE_LINE{64};
+
+  std::array<T, N> slots{};
+
+  std::atomic<std::size_t> head{0};  // Written by producer
+  std::size_t cachedTail{0};         // Producer copy of tail
+  char producerPadding[CACHE_LINE - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)]{};
+
+  std::atomic<std::size_t> tail{0};  // Written by consumer
+  std::size_t cachedHead{0};         // Consumer copy of head
+  char consumerPadding[CACHE_LINE - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)]{};
+
+ public:
+  // Producer side. Returns false if the ring is full.
+  inline bool push(const T& value) {
+    const std::size_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead - cachedTail == N) {
+      cachedTail = tail.load(std::memory_order_acquire);
+      if (currentHead - cachedTail == N) {
+        return false;
+      }
+    }
+
+    slots[currentHead & (N - 1)] = value;
+    head.store(currentHead + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns nullptr if the ring is empty. The returned element
+  // stays valid until pop() is called.
+  inline const T* front() {
+    const std::size_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail == cachedHead) {
+      cachedHead = head.load(std::memory_order_acquire);
+      if (currentTail == cachedHead) {
+        return nullptr;
+      }
+    }
+
+    return &slots[currentTail & (N - 1)];
+  }
+
+  inline void pop() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Can be called by both sides.
+  inline bool empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
+
+// Draws lines on a separate thread.
+// The emulation thread pushes each VRAM write and, whenever a line needs to be
+// drawn, the latched line state (see PPU::LineState). Both go through a
+// single command queue, so that the render thread can apply them to its own
+// copy of VRAM in the same order as they happened: each line is drawn
+// against VRAM exactly as it was when the PPU latched it. This means that the
+// final output is the same as if the line was drawn on the emulation thread.
+class RenderThread {
+ public:
+  typedef PPU::color color;
+
+ private:
+  typedef enum : word {
+    VRAM_WRITE,
+    DRAW_LINE
+  } CommandType;
+
+  // Commands are kept small as most of them are VRAM writes.
+  struct Command {
+    CommandType type;
+    word value;
+    dword address;
+  };
+
+  static constexpr std::size_t COMMAND_QUEUE_SIZE{1u << 14};
+  // A bit more than a full frame of lines.
+  static constexpr std::size_t LINE_QUEUE_SIZE{256};
+
+  SPSCRing<Command, COMMAND_QUEUE_SIZE> commands;
+  SPSCRing<PPU::LineState, LINE_QUEUE_SIZE> lines;
+
+  // Render thread copy of VRAM.
+  std::array<word, VRAM_UPPER_BOUND - VRAM_LOWER_BOUND> vram{};
+  LineRenderer renderer;
+  color* screenBuffer;
+  PPU::ScreenChanges* screenChanges;
+
+  std::atomic<bool> running{true};
+  std::atomic<unsigned long long> framesRendered{0};
+  std::thread thread;
+
+  // Producer side: wait for the render thread to free some space.
+  void pushCommand(const Command& command);
+  // Render thread main loop.
+  void run();
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // vramData is copied to initialize the render thread copy of VRAM.
+  // screenChanges gets updated as lines are drawn.
+  RenderThread(const word* vramData, color* screenBuffer, PPU::ScreenChanges* screenChanges);
+  ~RenderThread();
+
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Emulation thread side.
+  void pushVRAMWrite(dword address, word value);
+  void pushLine(const PPU::LineState& line);
+
+  // Frame fence: block until all the lines pushed so far have been
+  // drawn to screen buffer.
+  void waitUntilIdle() const;
+
+  // Replace render thread copy of VRAM. This waits for all the
+  // pending commands to be processed first.
+  void resyncVRAM(const word* vramData);
+
+  // Number of full frames drawn so far.
+  unsigned long long getFramesRendered() const;
+};
+
+}  // namespace gb
+
+#endif  // RENDER_THREAD_H
@@ -0,0 +1,92 @@
+#include "gameboy-pool.hpp"
+#include <cassert>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace gb {
+
+// Constructor /////////////////////////////////////////////////////////////////
+GameboyPool::GameboyPool(std::shared_ptr<const ROMImage> rom, const std::size_t machines)
+  : slots{ new Slot[machines] } {
+  if (machines == 0) {
+    throw std::runtime_error("Pool needs at least one machine!");
+  }
+
+  // Machines are constructed in place. If one fails, the ones before it
+  // have to be destroyed by hand.
+  try {
+    for (; count != machines; ++count) {
+      new (&slots[count]) Gameboy{ rom };
+    }
+  } catch (...) {
+    while (count != 0) {
+      machine(--count)->~Gameboy();
+    }
+    throw;
+  }
+
+  // Machines are handed out from the back: start from the first one.
+  available.reserve(count);
+  for (std::size_t i = count; i != 0; --i) {
+    available.push_back(machine(i - 1));
+  }
+}
+
+GameboyPool::~GameboyPool() {
+  assert(available.size() == count && "Machines are still in use!");
+  for (std::size_t i = 0; i != count; ++i) {
+    machine(i)->~Gameboy();
+  }
+}
+
+GameboyPool::Releaser::Releaser(GameboyPool* pool) : pool{ pool } {}
+
+void GameboyPool::Releaser::operator()(Gameboy* gameboy) const {
+  pool->release(gameboy);
+}
+
+// Methods /////////////////////////////////////////////////////////////////////
+Gameboy* GameboyPool::machine(const std::size_t index) {
+  return reinterpret_cast<Gameboy*>(&slots[index]);
+}
+
+void GameboyPool::release(Gameboy* gameboy) {
+  std::lock_guard<std::mutex> lock{ mutex };
+  // Capacity is reserved for all machines: this does not allocate.
+  available.push_back(gameboy);
+}
+
+GameboyPool::Handle GameboyPool::acquire(const bool booted) {
+  Gameboy* gameboy{ nullptr };
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    if (available.empty()) {
+      throw std::runtime_error("All machines of the pool are in use!");
+    }
+    gameboy = available.back();
+    available.pop_back();
+  }
+  // From here on, the machine goes back to the pool whatever happens.
+  Handle handle{ gameboy, Releaser{ this } };
+
+  gameboy->stopPPULog();
+  gameboy->setThreadedRendering(false);
+  gameboy->setRenderingEnabled(true);
+  gameboy->hardReset();
+  if (booted) {
+    gameboy->boot();
+  }
+  return handle;
+}
+
+std::size_t GameboyPool::size() const {
+  return count;
+}
+
+std::size_t GameboyPool::getAvailable() {
+  std::lock_guard<std::mutex> lock{ mutex };
+  return available.size();
+}
+
+}  // namespace gb
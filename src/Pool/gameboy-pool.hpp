@@ -0,0 +1,71 @@
+#ifndef GAMEBOY_POOL_H
+#define GAMEBOY_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "gameboy.hpp"
+
+namespace gb {
+
+// Fixed set of machines running the same ROM, created once, next to each
+// other in a single block of memory, and handed out for reuse. Machines
+// go back to the pool when their handle is destroyed, and get hard reset
+// (see Gameboy::hardReset) when they are handed out again: starting an
+// episode costs a state load instead of a construction, and allocates
+// nothing.
+//
+// Pools can be shared by many threads. Handles must not outlive their pool,
+// and machines must not use save files (see Gameboy::hardReset).
+class GameboyPool {
+ public:
+  // Gives the machine back to its pool.
+  class Releaser {
+    GameboyPool* pool{ nullptr };
+
+   public:
+    Releaser() = default;
+    explicit Releaser(GameboyPool* pool);
+    void operator()(Gameboy* gameboy) const;
+  };
+  typedef std::unique_ptr<Gameboy, Releaser> Handle;
+
+ private:
+  typedef std::aligned_storage<sizeof(Gameboy), alignof(Gameboy)>::type Slot;
+
+  std::unique_ptr<Slot[]> slots;
+  std::size_t count{ 0 };
+  // Machines that can be handed out.
+  std::vector<Gameboy*> available;
+  std::mutex mutex;
+
+  Gameboy* machine(std::size_t index);
+  void release(Gameboy* gameboy);
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // @throws if machines is 0, or if the ROM is not supported (see Gameboy).
+  GameboyPool(std::shared_ptr<const ROMImage> rom, std::size_t machines);
+  ~GameboyPool();
+
+  GameboyPool(const GameboyPool&) = delete;
+  GameboyPool& operator=(const GameboyPool&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Hand out a machine at power on, or at the end of the boot ROM if booted
+  // (see Gameboy::boot). Settings changed by the last user (rendering,
+  // threaded rendering, PPU log) are back to their defaults.
+  // @throws if all machines are in use.
+  Handle acquire(bool booted = false);
+
+  std::size_t size() const;
+  // Machines that are not in use.
+  std::size_t getAvailable();
+};
+
+}  // namespace gb
+
+#endif  // GAMEBOY_POOL_H
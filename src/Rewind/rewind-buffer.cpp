@@ -0,0 +1,255 @@
+#include "rewind-buffer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "gameboy.hpp"
+
+namespace gb {
+
+namespace {
+
+// Shorter runs of unchanged bytes are cheaper to store as part of a literal.
+constexpr std::size_t MIN_ZERO_RUN{ 4 };
+
+std::size_t putVarint(word* output, std::size_t value) {
+  std::size_t length{ 0 };
+  while (value >= 0x80) {
+    output[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  output[length++] = value;
+  return length;
+}
+
+std::size_t getVarint(const word* input, std::size_t& position) {
+  std::size_t value{ 0 };
+  int shift{ 0 };
+  word byte;
+  do {
+    byte = input[position++];
+    value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+// Length of the run of equal bytes at the start of a and b.
+std::size_t equalRun(const word* a, const word* b, const std::size_t size) {
+  std::size_t length{ 0 };
+  // Compare eight bytes at a time first.
+  while (length + 8 <= size) {
+    std::uint64_t x;
+    std::uint64_t y;
+    std::memcpy(&x, a + length, 8);
+    std::memcpy(&y, b + length, 8);
+    if (x != y) {
+      break;
+    }
+    length += 8;
+  }
+  while (length < size && a[length] == b[length]) {
+    ++length;
+  }
+  return length;
+}
+
+}  // namespace
+
+// Constructor /////////////////////////////////////////////////////////////////
+RewindBuffer::RewindBuffer(const std::size_t stateSize, const std::size_t memoryLimit, const int keyframeInterval)
+  : stateSize{ stateSize }
+  , keyframeInterval{ keyframeInterval }
+  , ring(memoryLimit)
+  , newest(stateSize)
+  , scratch(stateSize)
+  , delta(maxDeltaSize()) {
+  if (keyframeInterval <= 0) {
+    throw std::runtime_error("Rewind keyframe interval must be positive!");
+  }
+  // Worst case, a keyframe and a delta that did not compress at all.
+  if (memoryLimit < 2 * (stateSize + maxDeltaSize())) {
+    throw std::runtime_error("Rewind memory limit is too small for this machine!");
+  }
+}
+
+// Methods /////////////////////////////////////////////////////////////////////
+void RewindBuffer::push(const Gameboy& gameboy) {
+  if (gameboy.saveState(scratch.data(), scratch.size()) != stateSize) {
+    throw std::runtime_error("Machine state size does not match rewind buffer!");
+  }
+
+  const bool isKeyframe = entries.empty() || framesPushed % keyframeInterval == 0;
+  ++framesPushed;
+
+  // The oldest entry needs no delta (there is nothing before it).
+  const std::size_t deltaSize = entries.empty()
+    ? 0
+    : encodeDelta(newest.data(), scratch.data(), stateSize, delta.data());
+
+  const std::size_t size = deltaSize + (isKeyframe ? stateSize : 0);
+  const std::size_t offset = allocate(size);
+  std::copy(delta.begin(), delta.begin() + deltaSize, ring.begin() + offset);
+  if (isKeyframe) {
+    std::copy(scratch.begin(), scratch.end(), ring.begin() + offset + deltaSize);
+  }
+  head = offset + size;
+  entries.push_back(Entry{ offset, deltaSize, isKeyframe });
+
+  std::swap(newest, scratch);
+}
+
+std::size_t RewindBuffer::stepBack(Gameboy& gameboy, std::size_t frames) {
+  frames = std::min(frames, framesAvailable());
+  if (frames == 0) {
+    return 0;
+  }
+
+  const std::size_t target = entries.size() - 1 - frames;
+
+  // Going back from newest costs one delta per frame. Going forward from the
+  // closest keyframe costs a full copy, and one delta per frame after it.
+  std::size_t walkCost{ 0 };
+  for (std::size_t i = target + 1; i != entries.size(); ++i) {
+    walkCost += entries[i].deltaSize;
+  }
+  std::size_t keyframe = target;
+  std::size_t keyframeCost{ stateSize };
+  while (!entries[keyframe].isKeyframe && keyframe != 0) {
+    keyframeCost += entries[keyframe].deltaSize;
+    --keyframe;
+  }
+
+  if (entries[keyframe].isKeyframe && keyframeCost < walkCost) {
+    const Entry& entry = entries[keyframe];
+    const auto start = ring.begin() + entry.offset + entry.deltaSize;
+    std::copy(start, start + stateSize, newest.begin());
+    for (std::size_t i = keyframe + 1; i <= target; ++i) {
+      applyDelta(&ring[entries[i].offset], entries[i].deltaSize, newest.data());
+    }
+  } else {
+    for (std::size_t i = entries.size() - 1; i != target; --i) {
+      applyDelta(&ring[entries[i].offset], entries[i].deltaSize, newest.data());
+    }
+  }
+
+  entries.resize(target + 1);
+  const Entry& last = entries.back();
+  head = last.offset + last.deltaSize + (last.isKeyframe ? stateSize : 0);
+  framesPushed -= frames;
+
+  gameboy.loadState(newest.data(), stateSize);
+  return frames;
+}
+
+std::size_t RewindBuffer::framesAvailable() const {
+  return entries.empty() ? 0 : entries.size() - 1;
+}
+
+std::size_t RewindBuffer::memoryUsed() const {
+  std::size_t used{ 0 };
+  for (const auto& entry : entries) {
+    used += entry.deltaSize + (entry.isKeyframe ? stateSize : 0);
+  }
+  return used;
+}
+
+void RewindBuffer::clear() {
+  entries.clear();
+  head = 0;
+  framesPushed = 0;
+}
+
+std::size_t RewindBuffer::maxDeltaSize() const {
+  // Each literal is preceded by two varints, and literals are separated by
+  // at least MIN_ZERO_RUN unchanged bytes.
+  std::size_t varintSize{ 1 };
+  for (std::size_t value = stateSize; value >= 0x80; value >>= 7) {
+    ++varintSize;
+  }
+  const std::size_t maxRuns = stateSize / (MIN_ZERO_RUN + 1) + 1;
+  return stateSize + maxRuns * 2 * varintSize;
+}
+
+std::size_t RewindBuffer::allocate(const std::size_t size) {
+  assert(size < ring.size());
+
+  while (!entries.empty()) {
+    const std::size_t tail = entries.front().offset;
+
+    // Entries are between tail and head, not wrapped around the end.
+    if (head > tail) {
+      if (head + size <= ring.size()) {
+        return head;
+      }
+      // Wrap around. Entries never end right at tail, so that head == tail
+      // only when the ring is empty.
+      if (size < tail) {
+        return 0;
+      }
+    } else if (head + size < tail) {
+      return head;
+    }
+
+    dropOldest();
+  }
+
+  return 0;
+}
+
+void RewindBuffer::dropOldest() {
+  entries.pop_front();
+  if (entries.empty()) {
+    head = 0;
+  }
+}
+
+std::size_t RewindBuffer::encodeDelta(const word* a, const word* b, const std::size_t size, word* output) {
+  std::size_t position{ 0 };
+  std::size_t length{ 0 };
+
+  while (position < size) {
+    const std::size_t zeroRun = equalRun(a + position, b + position, size - position);
+    position += zeroRun;
+    if (position == size) {
+      break;
+    }
+
+    // Literal goes on until a long enough run of equal bytes.
+    const std::size_t literalStart = position;
+    while (position < size) {
+      if (a[position] != b[position]) {
+        ++position;
+        continue;
+      }
+      const std::size_t run = equalRun(a + position, b + position, std::min(MIN_ZERO_RUN, size - position));
+      if (run == MIN_ZERO_RUN || position + run == size) {
+        break;
+      }
+      position += run;
+    }
+
+    length += putVarint(output + length, zeroRun);
+    length += putVarint(output + length, position - literalStart);
+    for (std::size_t i = literalStart; i != position; ++i) {
+      output[length++] = a[i] ^ b[i];
+    }
+  }
+
+  return length;
+}
+
+void RewindBuffer::applyDelta(const word* delta, const std::size_t deltaSize, word* state) {
+  std::size_t position{ 0 };
+  std::size_t target{ 0 };
+  while (position < deltaSize) {
+    target += getVarint(delta, position);
+    const std::size_t literal = getVarint(delta, position);
+    for (std::size_t i = 0; i != literal; ++i) {
+      state[target++] ^= delta[position++];
+    }
+  }
+}
+
+}  // namespace gb
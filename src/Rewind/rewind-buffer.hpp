@@ -0,0 +1,91 @@
+#ifndef REWIND_BUFFER_H
+#define REWIND_BUFFER_H
+
+#include <cstddef>
+#include <deque>
+
+#include "types.hpp"
+
+namespace gb {
+
+class Gameboy;
+
+// Keeps the last few seconds of emulation in memory, so that it can be
+// played backwards.
+//
+// A save state (see Gameboy::saveState) is pushed after each frame, but only
+// what changed is stored: each frame is kept as the XOR between its state and
+// the one before, run-length encoded. Most of the machine memory stays the
+// same from one frame to the next, so this is usually a few hundred bytes.
+// Since XOR works both ways, going back one frame only means applying the
+// newest delta to the newest state. Every keyframeInterval frames, a full
+// copy of the state is stored as well: jumping back many frames then starts
+// from the closest keyframe, instead of walking back one frame at a time.
+//
+// Everything lives in a single ring of memoryLimit bytes, allocated up front.
+// When it is full, the oldest frames are dropped.
+class RewindBuffer {
+  struct Entry {
+    // Position of the entry data in ring. Delta comes first, followed by the
+    // full state if this is a keyframe.
+    std::size_t offset;
+    std::size_t deltaSize;
+    bool isKeyframe;
+  };
+
+  std::size_t stateSize;
+  int keyframeInterval;
+  // Frames pushed so far, used to place keyframes.
+  unsigned long long framesPushed{ 0 };
+
+  Binary ring;
+  // Where the next entry goes, if there is enough space.
+  std::size_t head{ 0 };
+  // Entries, from oldest to newest. Data of the oldest entry is never used
+  // (it leads to a state that is not stored anymore), but it is kept so that
+  // the newest state always has a delta.
+  std::deque<Entry> entries;
+
+  // State of the newest entry, and scratch space for the next one.
+  Binary newest;
+  Binary scratch;
+  Binary delta;
+
+  // XOR between a and b, run-length encoded to output.
+  // @return encoded size. output must hold at least maxDeltaSize() bytes.
+  static std::size_t encodeDelta(const word* a, const word* b, std::size_t size, word* output);
+  // XOR delta into state.
+  static void applyDelta(const word* delta, std::size_t deltaSize, word* state);
+  std::size_t maxDeltaSize() const;
+
+  // Make room for a new entry and return its offset in ring.
+  std::size_t allocate(std::size_t size);
+  void dropOldest();
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // stateSize must be the save state size of the machines that are going to
+  // be pushed (see Gameboy::stateSize()).
+  // @throws if memoryLimit can not hold at least a few frames.
+  RewindBuffer(std::size_t stateSize, std::size_t memoryLimit, int keyframeInterval = 60);
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Store current state of gameboy. Call this once per frame.
+  void push(const Gameboy& gameboy);
+
+  // Drop the newest frames and load the one before them into gameboy. If
+  // fewer frames are stored, goes back as far as possible.
+  // @return number of frames actually stepped back (0 if there was nothing
+  // to go back to).
+  std::size_t stepBack(Gameboy& gameboy, std::size_t frames = 1);
+
+  // Number of frames that can be stepped back to.
+  std::size_t framesAvailable() const;
+  // Bytes of the ring that hold frames.
+  std::size_t memoryUsed() const;
+  void clear();
+};
+
+}  // namespace gb
+
+#endif  // REWIND_BUFFER_H
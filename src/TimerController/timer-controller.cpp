@@ -3,66 +3,187 @@
 #include "timer-controller.hpp"
 #include "gameboy.hpp"
 #include "address-bus.hpp"
+#include "save-state.hpp"
 
 namespace gb {
 
-constexpr std::array<int, 4> TimerController::TIMA_RATES;
+constexpr std::array<int, 4> TimerController::TIMA_DIVIDER_BITS;
+constexpr unsigned long long TimerController::NEVER;
 
-void TimerController::incrementTimer(dword address) {
-  assert(
-    (address == REG_DIV || address == REG_TIMA)
-    && "Only timers can be incremented this way."
-  );
+unsigned long long TimerController::dividerAt(const unsigned long long clock) const {
+  assert(clock >= dividerBaseClock);
+  return dividerBase + (clock - dividerBaseClock) * CYCLES_PER_CLOCK;
+}
+
+bool TimerController::isTimerEnabled() const {
+  // This bit indicates wether timer is enabled or not.
+  return TAC & 0b100;
+}
+
+bool TimerController::timerSignal() const {
+  // Just the two lower bits of the register are used to select rate.
+  const int bit = TIMA_DIVIDER_BITS[TAC & 0b11];
+  return isTimerEnabled() && ((dividerAt(clockCount) >> bit) & 1);
+}
+
+void TimerController::sync() {
+  assert(timaClock <= clockCount);
+
+  if (isTimerEnabled()) {
+    // Each time the selected bit goes from 1 to 0, the divider has
+    // just reached a multiple of period.
+    const unsigned long long period = 1ull << (TIMA_DIVIDER_BITS[TAC & 0b11] + 1);
+    const auto edges = dividerAt(clockCount) / period - dividerAt(timaClock) / period;
+
+    // Overflows are handled in machineClock, exactly when they happen.
+    assert(TIMA + edges <= 0xFF && "TIMA overflow should have been scheduled.");
+    TIMA += edges;
+  }
 
-  // First, check for overflow.
-  const auto oldValue = bus->read(address);
-  const bool overflow = oldValue == 0xFF;
+  timaClock = clockCount;
+}
+
+void TimerController::schedule() {
+  assert(timaClock == clockCount);
 
-  // DIV timer does not trigger an interrupt on overflow.
-  // TIMA triggers an interrupt ONLY when it overflows.
-  if (address == REG_DIV || !overflow) {
-    bus->write(address, oldValue + 1, AddressBus::TC);
+  if (!isTimerEnabled()) {
+    nextOverflow = NEVER;
     return;
   }
 
-  // If TMA register overflows, it gets reset to TMA value.
-  const auto TMA = bus->read(REG_TMA);
-  bus->write(REG_TIMA, TMA, AddressBus::TC);
+  // TIMA needs this many more falling edges to overflow. Find the
+  // divider value at which the last one of them happens.
+  const unsigned long long period = 1ull << (TIMA_DIVIDER_BITS[TAC & 0b11] + 1);
+  const unsigned long long remaining = 0x100 - TIMA;
+  const auto overflowDivider = (dividerAt(clockCount) / period + remaining) * period;
+
+  nextOverflow = dividerBaseClock + (overflowDivider - dividerBase) / CYCLES_PER_CLOCK;
+}
+
+void TimerController::incrementTimer() {
+  if (TIMA == 0xFF) {
+    overflow();
+    return;
+  }
+  ++TIMA;
+}
+
+void TimerController::overflow() {
+  // If TIMA register overflows, it gets reset to TMA value.
+  TIMA = TMA;
+  timaClock = clockCount;
   gameboy->requestInterrupt(INTERRUPT_TIMER);
+  schedule();
 }
 
 // Public ////////////////////////////////////////////
 TimerController::TimerController(Gameboy* gameboy, AddressBus* bus)
 : bus{ bus }
 , gameboy{ gameboy }
-{}
+{
+  bus->attachTimer(this);
+}
 
 void TimerController::machineClock() {
   ++clockCount;
 
-
-  if (clockCount % DIV_RATE == 0) {
-    // Here overflow does not trigger an interrupt
-    incrementTimer(REG_DIV);
+  if (clockCount == nextOverflow) {
+    overflow();
   }
+}
 
-  const std::bitset<3> TAC = bus->read(REG_TAC);
-  // This bit indicates wether timer is enabled or not.
-  if (!TAC[2]) {
-    return;
+word TimerController::read(const dword address) {
+  switch (address) {
+    case REG_DIV:
+      return (dividerAt(clockCount) >> 8) & 0xFF;
+
+    case REG_TIMA:
+      sync();
+      return TIMA;
+
+    case REG_TMA:
+      return TMA;
+
+    case REG_TAC:
+      return TAC;
+
+    default:
+      assert(false && "Only timer registers can be read here.");
+      return 0xFF;
   }
+}
 
-  // Just the two lower bits of the register are used to select rate.
-  const auto TIMARateSelector = TAC.to_ulong() & 0b11;
-  const auto currentTIMARate = TIMA_RATES[TIMARateSelector];
-  assert(currentTIMARate != 0 && "Tima rates have not been initialized properly.");
-
-  if (clockCount % currentTIMARate == 0) {
-    // here overflow triggers an interrupt.
-    // This should probably be handled by bus but for now it is handled
-    // in incrementTimer
-    incrementTimer(REG_TIMA);
+void TimerController::write(const dword address, const word value, const bool forced) {
+  switch (address) {
+    case REG_DIV: {
+      sync();
+      const bool oldSignal = timerSignal();
+
+      // Writing any value to DIV resets the whole divider.
+      dividerBase = forced ? value << 8 : 0;
+      dividerBaseClock = clockCount;
+
+      // This can cause a falling edge on the selected bit.
+      if (!forced && oldSignal && !timerSignal()) {
+        incrementTimer();
+      }
+      schedule();
+      return;
+    }
+
+    case REG_TIMA:
+      sync();
+      TIMA = value;
+      schedule();
+      return;
+
+    case REG_TMA:
+      TMA = value;
+      return;
+
+    case REG_TAC: {
+      sync();
+      const bool oldSignal = timerSignal();
+
+      TAC = value;
+
+      // Disabling the timer or changing rate can cause a falling edge, too.
+      if (!forced && oldSignal && !timerSignal()) {
+        incrementTimer();
+      }
+      schedule();
+      return;
+    }
+
+    default:
+      assert(false && "Only timer registers can be written here.");
   }
 }
 
-}
\ No newline at end of file
+// Save states /////////////////////////////////////////////////////////////////
+void TimerController::saveState(state::Writer& writer) const {
+  writer.beginSection("TIMR");
+  writer.put64(clockCount);
+  writer.put64(dividerBaseClock);
+  writer.put16(dividerBase);
+  writer.put64(timaClock);
+  writer.put8(TIMA);
+  writer.put8(TMA);
+  writer.put8(TAC);
+  writer.put64(nextOverflow);
+  writer.endSection();
+}
+
+void TimerController::loadState(state::Reader& reader) {
+  reader.requireSection("TIMR");
+  clockCount = reader.get64();
+  dividerBaseClock = reader.get64();
+  dividerBase = reader.get16();
+  timaClock = reader.get64();
+  TIMA = reader.get8();
+  TMA = reader.get8();
+  TAC = reader.get8();
+  nextOverflow = reader.get64();
+}
+
+}
@@ -1,6 +1,7 @@
 #ifndef TIMER_CONTROLLER_H
 #define TIMER_CONTROLLER_H
 #include <array>
+#include <limits>
 
 #include "types.hpp"
 
@@ -8,7 +9,23 @@ namespace gb {
 
 class Gameboy;
 class AddressBus;
+namespace state {
+class Writer;
+class Reader;
+}
 
+// On real hardware, both timers are driven by a single 16-bit divider that
+// counts T-cycles (4 per machine clock). DIV is its upper byte, and TIMA
+// increments on each falling edge of one of its bits (selected by TAC).
+//
+// Here, the divider is never actually incremented: it is derived from
+// clockCount when needed. TIMA is brought up to date (see sync) only when
+// it is read or when timer registers are written, and the clock at which it
+// will overflow is computed in advance (see schedule). This way, machineClock
+// does nothing but a comparison on most cycles.
+//
+// Timer registers ($FF04-$FF07) are stored here and not in AddressBus: the
+// bus forwards all reads and writes to them (see AddressBus::attachTimer).
 class TimerController {
   // Bare pointers are not ideal; see Gameboy
   AddressBus* bus;
@@ -16,19 +33,48 @@ class TimerController {
 
   // TIMA timer can be incremented with four different rates (chosen by the ROM code).
   // These are stored in the 2 lower bits of  TAC (Timer access control) register.
-  // Depending on those bits, this is the rate of the timer.
-  static constexpr std::array<int, 4> TIMA_RATES{ 256, 4, 16, 64 };
+  // Depending on those bits, TIMA increments on the falling edge of one of these
+  // divider bits (that is, once every 256, 4, 16 or 64 machine clocks).
+  static constexpr std::array<int, 4> TIMA_DIVIDER_BITS{ 9, 3, 5, 7 };
+
+  // The divider counts T-cycles.
+  static constexpr int CYCLES_PER_CLOCK{ 4 };
+
+  static constexpr unsigned long long NEVER{ std::numeric_limits<unsigned long long>::max() };
+
+  // Emulator "fake" variable to keep track of time. Everything else is
+  // derived from this.
+  unsigned long long clockCount{0};
+
+  // Divider had value dividerBase at clock dividerBaseClock. It is kept
+  // as a multiple of CYCLES_PER_CLOCK.
+  unsigned long long dividerBaseClock{0};
+  dword dividerBase{0};
 
-  // DIV timer increments at a fixed rate of once every 64 machine clocks.
-  static constexpr int DIV_RATE = 64;
+  // TIMA value is up to date as of clock timaClock.
+  unsigned long long timaClock{0};
+  word TIMA{0};
+  word TMA{0};
+  word TAC{0};
 
-  // Emulator "fake" variable to check when timer triggers. In real GB this would have
-  // been a physical signal that originated from a hardware counter.
-  long long unsigned clockCount{0};
+  // Clock at which TIMA is going to overflow.
+  unsigned long long nextOverflow{ NEVER };
 
-  // Increments a specific timer. This takes care of interrupt calling and of timer-specific
-  // additional logic.
-  void incrementTimer(dword address);
+  // Divider value, not wrapped to 16 bits, at a certain clock.
+  unsigned long long dividerAt(unsigned long long clock) const;
+  bool isTimerEnabled() const;
+  // Input of the TIMA falling edge detector (enable bit AND divider bit).
+  bool timerSignal() const;
+
+  // Bring TIMA up to date with clockCount.
+  void sync();
+  // Compute when TIMA will overflow next. Has to be called each time
+  // anything that affects TIMA changes.
+  void schedule();
+  // Single TIMA increment. This takes care of overflow and interrupts.
+  void incrementTimer();
+  // Reset TIMA to TMA and request interrupt.
+  void overflow();
 
  public:
   TimerController(Gameboy* gameboy, AddressBus* bus);
@@ -36,6 +82,22 @@ class TimerController {
   // This function needs to be called once each machine clock.
   // Machine clock runs at 1'048'576 Hz.
   void machineClock();
+
+  // Machine clocks elapsed since the timer was created. Anything else that
+  // depends on emulated time can be derived from this.
+  inline const unsigned long long& getClockCount() const {
+    return clockCount;
+  }
+
+  // Timer registers access, forwarded by AddressBus.
+  // Forced writes (see AddressBus::GB) set DIV to the given value instead
+  // of resetting it.
+  word read(dword address);
+  void write(dword address, word value, bool forced = false);
+
+  // Save state section (see save-state.hpp).
+  void saveState(state::Writer& writer) const;
+  void loadState(state::Reader& reader);
 };
 
 }
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lyra/lyra.hpp>
+
+#include "batch.hpp"
+
+// Run many ROMs headless, as fast as possible, on all cores. Each job is a
+// ROM, optionally played with the inputs of a movie (see gb::MovieRecorder),
+// and runs for a fixed number of machine clocks. Results are written one job
+// per line, tab separated:
+//
+//   rom | movie | clocks | seconds | MHz | frame hash | serial | error
+//
+// Clocks are machine clocks (1.05 MHz on real hardware), counted after the
+// boot ROM (see gb::Gameboy::boot). The frame hash is a hash of the last
+// complete frame, which ended at most a frame before the job did. Serial
+// output is escaped so that it fits on one line.
+//
+// Jobs run on threads, or in worker processes (--processes), so that a job
+// that crashes does not take the others down (see gb::batch).
+
+namespace {
+
+std::string escape(const std::string& text) {
+  std::ostringstream output;
+  for (const unsigned char c : text) {
+    switch (c) {
+      case '\\': output << "\\\\"; break;
+      case '\n': output << "\\n"; break;
+      case '\t': output << "\\t"; break;
+      default:
+        if (c < 0x20 || c >= 0x7F) {
+          output << "\\x" << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(c) << std::dec;
+        } else {
+          output << c;
+        }
+    }
+  }
+  return output.str();
+}
+
+// Each line holds a ROM path, optionally followed by a movie path. Empty
+// lines and lines starting with # are skipped.
+void readJobList(const std::string& path, std::vector<gb::batch::Job>& jobs) {
+  std::ifstream input{ path };
+  if (!input) {
+    throw std::runtime_error("Can not open job list " + path);
+  }
+  std::string line;
+  while (std::getline(input, line)) {
+    std::istringstream fields{ line };
+    gb::batch::Job job;
+    if (!(fields >> job.romPath) || job.romPath[0] == '#') {
+      continue;
+    }
+    fields >> job.moviePath;
+    jobs.push_back(job);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+
+  // Parse command line arguments
+  bool showHelp{ false };
+  std::vector<std::string> romPaths{};
+  std::string listPath{};
+  std::string outputPath{};
+  unsigned long long frames{ 3600 };
+  unsigned long long clocks{ 0 };
+  unsigned jobs{ std::max(1u, std::thread::hardware_concurrency()) };
+  unsigned processes{ 0 };
+  std::string dumpDirectory{};
+
+  const auto cli = lyra::help(showHelp)
+                 | lyra::opt(jobs, "jobs")
+                   ["-j"]["--jobs"]
+                   ("Number of worker threads.")
+                 | lyra::opt(frames, "frames")
+                   ["-f"]["--frames"]
+                   ("Frames to run each job for.")
+                 | lyra::opt(clocks, "clocks")
+                   ["-c"]["--clocks"]
+                   ("Machine clocks to run each job for, instead of whole frames.")
+                 | lyra::opt(listPath, "list")
+                   ["-l"]["--list"]
+                   ("File listing one job per line: a ROM path, optionally followed by a movie path.")
+                 | lyra::opt(processes, "processes")
+                   ["-p"]["--processes"]
+                   ("Run jobs in this many worker processes instead of threads, so that crashes only fail their job.")
+                 | lyra::opt(outputPath, "output")
+                   ["-o"]["--output"]
+                   ("Write results to this file instead of the standard output.")
+                 | lyra::opt(dumpDirectory, "directory")
+                   ["-d"]["--dump"]
+                   ("Write the last frame (job-N.pgm) and RAM (job-N.ram) of each job to this directory.")
+                 | lyra::arg(romPaths, "rom")
+                   ("ROMs to run, one job each.");
+
+  const auto result = cli.parse({ argc, argv });
+
+  if (!result)
+  {
+    std::cerr << result.errorMessage() << std::endl;
+    std::cerr << cli;
+    exit(EXIT_FAILURE);
+  }
+
+  if(showHelp)
+  {
+    std::cout << cli << '\n';
+    exit(EXIT_SUCCESS);
+  }
+
+  try {
+    std::vector<gb::batch::Job> jobList;
+    for (const auto& path : romPaths) {
+      jobList.push_back({ path, "" });
+    }
+    if (!listPath.empty()) {
+      readJobList(listPath, jobList);
+    }
+    if (jobList.empty()) {
+      std::cerr << "No jobs to run." << std::endl;
+      std::cerr << cli;
+      return EXIT_FAILURE;
+    }
+    if (clocks == 0) {
+      clocks = frames * gb::batch::CLOCKS_PER_FRAME;
+    }
+    const bool useProcesses = processes != 0;
+    jobs = std::max(1u, std::min<unsigned>(useProcesses ? processes : jobs, jobList.size()));
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto results = useProcesses ? gb::batch::runInProcesses(jobList, clocks, jobs, dumpDirectory)
+                                      : gb::batch::runOnThreads(jobList, clocks, jobs, dumpDirectory);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream file;
+    if (!outputPath.empty()) {
+      file.open(outputPath);
+      if (!file) {
+        throw std::runtime_error("Can not open output file " + outputPath);
+      }
+    }
+    std::ostream& output = outputPath.empty() ? std::cout : file;
+
+    unsigned long long totalClocks{ 0 };
+    std::size_t failed{ 0 };
+    output << "rom\tmovie\tclocks\tseconds\tmhz\tframe_hash\tserial\terror\n";
+    for (std::size_t i = 0; i != results.size(); ++i) {
+      const auto& job = jobList[i];
+      const auto& jobResult = results[i];
+      totalClocks += jobResult.clocks;
+      failed += jobResult.error.empty() ? 0 : 1;
+
+      const double mhz = jobResult.seconds > 0 ? jobResult.clocks / jobResult.seconds / 1E6 : 0;
+      output << job.romPath << '\t' << job.moviePath << '\t' << jobResult.clocks << '\t'
+             << std::fixed << std::setprecision(6) << jobResult.seconds << '\t' << std::setprecision(2) << mhz
+             << '\t' << std::hex << std::setfill('0') << std::setw(16) << jobResult.frameHash << std::dec << '\t'
+             << escape(jobResult.serial) << '\t' << escape(jobResult.error) << '\n';
+    }
+    output.flush();
+
+    // Throughput of the whole batch, as a benchmark.
+    const double mhz = totalClocks / seconds / 1E6;
+    std::cerr << "Ran " << results.size() << " jobs (" << failed << " failed) on " << jobs << (useProcesses ? " processes in " : " threads in ")
+              << std::fixed << std::setprecision(2) << seconds << " s: " << mhz << " MHz, "
+              << mhz / 1.048576 << "x real time." << std::endl;
+    if (failed != 0) {
+      return EXIT_FAILURE;
+    }
+  } catch (const std::runtime_error& err) {
+    std::cerr << "An error occurred while running the batch:" << std::endl;
+    std::cerr << err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
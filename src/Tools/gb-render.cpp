@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lyra/lyra.hpp>
+
+#include "gameboy.hpp"
+#include "ppu-log.hpp"
+
+// Render frames from a PPU log (see gb::PPULogWriter) to a raw video file:
+// one byte per pixel (8-bit grayscale), PPU::WIDTH * PPU::HEIGHT bytes per
+// frame, frames stored one after the other. This can be converted with
+// e.g. ffmpeg -f rawvideo -pix_fmt gray -s 160x144 -r 60 -i out.raw out.mp4
+//
+// Optionally, the log can be recorded first by running a ROM with
+// rendering disabled.
+
+namespace {
+
+constexpr int FRAME_SIZE{ gb::PPU::TOTAL_PIXELS };
+constexpr int CYCLES_PER_FRAME{ 17556 };
+
+void recordLog(const std::string& romPath, const std::string& logPath, int frames, int keyframeInterval) {
+  gb::Gameboy gameboy{ gb::ROMImage::fromFile(romPath) };
+  gameboy.setRenderingEnabled(false);
+  gameboy.startPPULog(logPath, keyframeInterval);
+
+  for (int frame = 0; frame != frames; ++frame) {
+    for (int i = 0; i != CYCLES_PER_FRAME; ++i) {
+      gameboy.machineClock();
+    }
+  }
+
+  gameboy.stopPPULog();
+}
+
+void renderLog(const std::string& logPath, const std::string& outputPath, unsigned jobs) {
+  // Output file has to exist before workers open it for writing in place.
+  std::ofstream{ outputPath, std::ios_base::binary | std::ios_base::trunc };
+
+  const auto keyframes = gb::PPULogReader{ logPath }.indexKeyframes();
+  if (keyframes.empty()) {
+    throw std::runtime_error("PPU log does not contain any frame.");
+  }
+
+  // Each segment goes from a keyframe to the next one. Workers pick up the
+  // next segment as soon as they are done with the previous one.
+  std::atomic<std::size_t> nextSegment{ 0 };
+  std::atomic<unsigned long> framesRendered{ 0 };
+
+  const auto worker = [&]() {
+    gb::PPULogReader reader{ logPath };
+    std::fstream output{ outputPath, std::ios_base::binary | std::ios_base::in | std::ios_base::out };
+    std::vector<char> frameData(FRAME_SIZE);
+
+    const auto writeFrame = [&](unsigned long frameNumber, const gb::PPU::color* screen) {
+      // Lighter colors have lower values.
+      std::transform(screen, screen + FRAME_SIZE, frameData.begin(),
+        [](const gb::PPU::color& pixel) { return static_cast<char>(255 - pixel * 85); });
+
+      output.seekp(static_cast<std::streamoff>(frameNumber) * FRAME_SIZE);
+      output.write(frameData.data(), FRAME_SIZE);
+      ++framesRendered;
+    };
+
+    for (auto i = nextSegment++; i < keyframes.size(); i = nextSegment++) {
+      const std::streamoff end = i + 1 < keyframes.size() ? keyframes[i + 1].offset : -1;
+      reader.renderSegment(keyframes[i].offset, end, writeFrame);
+    }
+  };
+
+  // Errors are passed back to the main thread.
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  const auto safeWorker = [&]() {
+    try {
+      worker();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock{ errorMutex };
+      error = std::current_exception();
+      nextSegment = keyframes.size();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i != jobs; ++i) {
+    threads.emplace_back(safeWorker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  std::cout << "Rendered " << framesRendered << " frames (" << keyframes.size() << " segments, "
+            << jobs << " jobs)." << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+
+  // Parse command line arguments
+  bool showHelp{ false };
+  std::string logPath{};
+  std::string outputPath{};
+  std::string romPath{};
+  int frames{ 600 };
+  int keyframeInterval{ 60 };
+  unsigned jobs{ std::max(1u, std::thread::hardware_concurrency()) };
+
+  const auto cli = lyra::help(showHelp)
+                 | lyra::opt(romPath, "rom")
+                   ["-r"]["--record"]
+                   ("Record the log first, by running this ROM with rendering disabled.")
+                 | lyra::opt(frames, "frames")
+                   ["-f"]["--frames"]
+                   ("Number of frames to record.")
+                 | lyra::opt(keyframeInterval, "frames")
+                   ["-k"]["--keyframe-interval"]
+                   ("Frames between keyframes in the recorded log.")
+                 | lyra::opt(jobs, "jobs")
+                   ["-j"]["--jobs"]
+                   ("Number of rendering threads.")
+                 | lyra::arg(logPath, "log")
+                   ("Path to PPU log.").required()
+                 | lyra::arg(outputPath, "output")
+                   ("Path to raw video output.").required();
+
+  const auto result = cli.parse({ argc, argv });
+
+  if (!result)
+  {
+    std::cerr << result.errorMessage() << std::endl;
+    std::cerr << cli;
+    exit(EXIT_FAILURE);
+  }
+
+  if(showHelp)
+  {
+    std::cout << cli << '\n';
+    exit(EXIT_SUCCESS);
+  }
+
+  try {
+    if (!romPath.empty()) {
+      recordLog(romPath, logPath, frames, keyframeInterval);
+    }
+    renderLog(logPath, outputPath, std::max(1u, jobs));
+  } catch (const std::runtime_error& err) {
+    std::cerr << "An error occurred while rendering:" << std::endl;
+    std::cerr << err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
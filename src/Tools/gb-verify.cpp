@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lyra/lyra.hpp>
+
+#include "gameboy.hpp"
+#include "movie.hpp"
+#include "save-state.hpp"
+
+// Check that a movie (see gb::MovieRecorder) still plays back exactly as it
+// was recorded. The movie is split at its keyframes: each segment is played
+// from its keyframe on its own machine, and the state it ends in has to hash
+// the same as the next keyframe. Segments are independent, so they are
+// verified on a pool of threads.
+
+namespace {
+
+struct Mismatch {
+  std::size_t segment;
+  std::uint64_t expected;
+  std::uint64_t actual;
+};
+
+// @return segments that did not end in the expected state, in order.
+std::vector<Mismatch> verifyMovie(const std::string& romPath, const gb::MoviePlayer& player, unsigned jobs) {
+  const auto image = gb::ROMImage::fromFile(romPath);
+  // The last keyframe has nothing after it to be checked against.
+  const std::size_t segments = player.getKeyframeCount() - 1;
+
+  std::atomic<std::size_t> nextSegment{ 0 };
+  std::vector<Mismatch> mismatches;
+  std::exception_ptr error;
+  std::mutex resultMutex;
+
+  const auto worker = [&]() {
+    try {
+      gb::Gameboy gameboy{ image };
+      gameboy.setRenderingEnabled(false);
+      gb::Binary state(gameboy.stateSize());
+
+      for (auto i = nextSegment++; i < segments; i = nextSegment++) {
+        player.playSegment(gameboy, i);
+        gameboy.saveState(state.data(), state.size());
+
+        const std::uint64_t actual = gb::state::hash(state.data(), state.size());
+        const std::uint64_t expected = player.getKeyframeHash(i + 1);
+        if (actual != expected) {
+          std::lock_guard<std::mutex> lock{ resultMutex };
+          mismatches.push_back({ i, expected, actual });
+        }
+      }
+    } catch (...) {
+      // Errors are passed back to the main thread.
+      std::lock_guard<std::mutex> lock{ resultMutex };
+      error = std::current_exception();
+      nextSegment = segments;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i != jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  std::sort(mismatches.begin(), mismatches.end(),
+    [](const Mismatch& a, const Mismatch& b) { return a.segment < b.segment; });
+  return mismatches;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+
+  // Parse command line arguments
+  bool showHelp{ false };
+  std::string romPath{};
+  std::string moviePath{};
+  unsigned jobs{ std::max(1u, std::thread::hardware_concurrency()) };
+
+  const auto cli = lyra::help(showHelp)
+                 | lyra::opt(jobs, "jobs")
+                   ["-j"]["--jobs"]
+                   ("Number of verification threads.")
+                 | lyra::arg(romPath, "rom")
+                   ("Path to the Game Boy ROM the movie was recorded with.").required()
+                 | lyra::arg(moviePath, "movie")
+                   ("Path to the movie to verify.").required();
+
+  const auto result = cli.parse({ argc, argv });
+
+  if (!result)
+  {
+    std::cerr << result.errorMessage() << std::endl;
+    std::cerr << cli;
+    exit(EXIT_FAILURE);
+  }
+
+  if(showHelp)
+  {
+    std::cout << cli << '\n';
+    exit(EXIT_SUCCESS);
+  }
+
+  try {
+    const gb::MoviePlayer player{ moviePath };
+    const auto mismatches = verifyMovie(romPath, player, std::max(1u, jobs));
+
+    for (const auto& mismatch : mismatches) {
+      std::cout << "Segment " << mismatch.segment << " (frames " << player.getKeyframeFrame(mismatch.segment)
+                << " to " << player.getKeyframeFrame(mismatch.segment + 1) << ") desynced: expected "
+                << std::hex << std::setfill('0') << std::setw(16) << mismatch.expected << ", got "
+                << std::setw(16) << mismatch.actual << std::dec << std::endl;
+    }
+
+    const std::size_t segments = player.getKeyframeCount() - 1;
+    std::cout << "Verified " << segments << " segments (" << player.getFrameCount() << " frames, " << jobs
+              << " jobs): " << (segments - mismatches.size()) << " match." << std::endl;
+    if (!mismatches.empty()) {
+      return EXIT_FAILURE;
+    }
+  } catch (const std::runtime_error& err) {
+    std::cerr << "An error occurred while verifying:" << std::endl;
+    std::cerr << err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+#include "vec-env.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace gb {
+
+constexpr int GameboyVecEnv::CLOCKS_PER_FRAME;
+constexpr std::size_t GameboyVecEnv::OBSERVATION_SIZE;
+
+// Constructor /////////////////////////////////////////////////////////////////
+GameboyVecEnv::GameboyVecEnv(std::shared_ptr<const ROMImage> rom, const std::size_t count,
+                             std::vector<RewardTerm> rewards, unsigned threads)
+  : instances(count)
+  , rewardTerms{ std::move(rewards) } {
+  if (count == 0) {
+    throw std::runtime_error("Environment needs at least one machine!");
+  }
+  for (const auto& term : rewardTerms) {
+    if (term.bytes < 1 || term.bytes > 4) {
+      throw std::runtime_error("Reward values must be 1 to 4 bytes long!");
+    }
+  }
+
+  // Boot once: all machines start from there. Boot ends in the middle of a
+  // frame, so steps would not line up with frames.
+  Gameboy first{ rom };
+  first.boot();
+  drawFrame(first);
+  resetState.resize(first.stateSize());
+  first.saveState(resetState.data(), resetState.size());
+  resetScreen = first.screenBuffer;
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threadCount = std::min<std::size_t>(threads, count);
+  for (unsigned thread = 1; thread != threadCount; ++thread) {
+    workers.emplace_back(&GameboyVecEnv::runWorker, this, thread);
+  }
+
+  // Each machine is created by the thread that steps it, so that its memory
+  // is allocated close to that thread.
+  try {
+    runOnAll([&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t i = begin; i != end; ++i) {
+        instances[i].reset(new Gameboy{ rom });
+        instances[i]->setRenderingEnabled(false);
+        resetInstance(*instances[i]);
+      }
+    });
+  } catch (...) {
+    stopWorkers();
+    throw;
+  }
+}
+
+GameboyVecEnv::~GameboyVecEnv() {
+  stopWorkers();
+}
+
+// Methods /////////////////////////////////////////////////////////////////////
+std::size_t GameboyVecEnv::sliceBegin(const unsigned thread) const {
+  return thread * instances.size() / threadCount;
+}
+
+void GameboyVecEnv::runOnAll(const Task& newTask) {
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    task = newTask;
+    pending = workers.size();
+    ++generation;
+  }
+  taskReady.notify_all();
+
+  try {
+    task(sliceBegin(0), sliceBegin(1));
+  } catch (...) {
+    std::lock_guard<std::mutex> lock{ mutex };
+    if (!error) {
+      error = std::current_exception();
+    }
+  }
+
+  std::exception_ptr failure;
+  {
+    std::unique_lock<std::mutex> lock{ mutex };
+    taskDone.wait(lock, [this]() { return pending == 0; });
+    std::swap(failure, error);
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+void GameboyVecEnv::runWorker(const unsigned thread) {
+  unsigned long long done{ 0 };
+  std::unique_lock<std::mutex> lock{ mutex };
+  while (true) {
+    taskReady.wait(lock, [&]() { return stopping || generation != done; });
+    if (stopping) {
+      return;
+    }
+    done = generation;
+
+    // Task does not change until all workers are done with it.
+    lock.unlock();
+    try {
+      task(sliceBegin(thread), sliceBegin(thread + 1));
+    } catch (...) {
+      lock.lock();
+      if (!error) {
+        error = std::current_exception();
+      }
+      lock.unlock();
+    }
+    lock.lock();
+
+    if (--pending == 0) {
+      taskDone.notify_one();
+    }
+  }
+}
+
+void GameboyVecEnv::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    stopping = true;
+  }
+  taskReady.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+
+double GameboyVecEnv::readRewards(const Gameboy& gameboy) const {
+  double reward{ 0 };
+  for (const auto& term : rewardTerms) {
+    unsigned long value{ 0 };
+    for (int i = 0; i != term.bytes; ++i) {
+      value |= static_cast<unsigned long>(gameboy.readMemory(term.address + i)) << (8 * i);
+    }
+    reward += term.scale * static_cast<double>(value);
+  }
+  return reward;
+}
+
+void GameboyVecEnv::resetInstance(Gameboy& gameboy) {
+  gameboy.loadState(resetState.data(), resetState.size());
+  gameboy.screenBuffer = resetScreen;
+}
+
+void GameboyVecEnv::drawFrame(Gameboy& gameboy) {
+  // Lines of the current frame that are already past would be left over from
+  // an older frame: unless the screen is in VBlank, the frame after is needed.
+  word ly = gameboy.readMemory(REG_LY);
+  int framesLeft = ly >= PPU::HEIGHT ? 1 : 2;
+
+  // No frame ends while the screen is off: give up after a frame.
+  gameboy.setRenderingEnabled(true);
+  int clocks{ 0 };
+  while (framesLeft != 0 && clocks != CLOCKS_PER_FRAME) {
+    gameboy.machineClock();
+    ++clocks;
+    const word previous = ly;
+    ly = gameboy.readMemory(REG_LY);
+    if (ly == PPU::HEIGHT && previous != PPU::HEIGHT) {
+      --framesLeft;
+      clocks = 0;
+    }
+  }
+  gameboy.setRenderingEnabled(false);
+}
+
+void GameboyVecEnv::writeObservation(const Gameboy& gameboy, word* observation) const {
+  for (std::size_t i = 0; i != OBSERVATION_SIZE; ++i) {
+    observation[i] = gameboy.screenBuffer[i];
+  }
+}
+
+void GameboyVecEnv::reset(word* observations) {
+  runOnAll([&](const std::size_t begin, const std::size_t end) {
+    for (std::size_t i = begin; i != end; ++i) {
+      resetInstance(*instances[i]);
+      if (observations != nullptr) {
+        writeObservation(*instances[i], observations + i * OBSERVATION_SIZE);
+      }
+    }
+  });
+}
+
+void GameboyVecEnv::reset(const std::size_t index, word* observation) {
+  Gameboy& gameboy = getInstance(index);
+  resetInstance(gameboy);
+  if (observation != nullptr) {
+    writeObservation(gameboy, observation);
+  }
+}
+
+void GameboyVecEnv::step(const word* actions, const int frameskip, word* observations, float* rewards) {
+  if (frameskip <= 0) {
+    throw std::runtime_error("Steps must last at least one frame!");
+  }
+
+  runOnAll([&](const std::size_t begin, const std::size_t end) {
+    for (std::size_t i = begin; i != end; ++i) {
+      stepInstance(i, actions[i], frameskip, observations, rewards);
+    }
+  });
+}
+
+void GameboyVecEnv::stepInstance(const std::size_t index, const word action, const int frameskip,
+                                 word* observations, float* rewards) {
+  Gameboy& gameboy = *instances[index];
+  const double before = rewards != nullptr ? readRewards(gameboy) : 0;
+
+  gameboy.setJoypad(action);
+  // Rendering does not change emulation: skipped frames are not drawn.
+  for (int frame = 1; frame < frameskip; ++frame) {
+    for (int clock = 0; clock != CLOCKS_PER_FRAME; ++clock) {
+      gameboy.machineClock();
+    }
+  }
+  drawFrame(gameboy);
+
+  if (observations != nullptr) {
+    writeObservation(gameboy, observations + index * OBSERVATION_SIZE);
+  }
+  if (rewards != nullptr) {
+    rewards[index] = static_cast<float>(readRewards(gameboy) - before);
+  }
+}
+
+std::size_t GameboyVecEnv::size() const {
+  return instances.size();
+}
+
+unsigned GameboyVecEnv::getThreadCount() const {
+  return threadCount;
+}
+
+Gameboy& GameboyVecEnv::getInstance(const std::size_t index) {
+  if (index >= instances.size()) {
+    throw std::out_of_range("Environment has no machine with this index!");
+  }
+  return *instances[index];
+}
+
+const Gameboy& GameboyVecEnv::getInstance(const std::size_t index) const {
+  if (index >= instances.size()) {
+    throw std::out_of_range("Environment has no machine with this index!");
+  }
+  return *instances[index];
+}
+
+}  // namespace gb
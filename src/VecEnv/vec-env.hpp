@@ -0,0 +1,119 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gameboy.hpp"
+#include "types.hpp"
+
+namespace gb {
+
+// Many machines running the same ROM, stepped all at once, as environments
+// for reinforcement learning. Each step sets one joypad action per machine,
+// runs some frames, and writes observations and rewards for all of them to
+// caller-provided buffers.
+//
+// Machines are split into fixed slices, one per thread: a machine is always
+// stepped by the same thread, which also created it. The calling thread
+// steps the first slice itself.
+class GameboyVecEnv {
+ public:
+  // Rewards come from game variables in memory. A term is worth its value
+  // change during a step, times scale. Values of more than one byte are
+  // little endian.
+  struct RewardTerm {
+    dword address;
+    int bytes{ 1 };
+    float scale{ 1 };
+  };
+
+  static constexpr int CLOCKS_PER_FRAME{ 17556 };
+  // One byte per pixel, holding its shade (0-3) as in Gameboy::screenBuffer.
+  static constexpr std::size_t OBSERVATION_SIZE{ PPU::HEIGHT * PPU::WIDTH };
+
+ private:
+  typedef std::function<void(std::size_t begin, std::size_t end)> Task;
+
+  std::vector<std::unique_ptr<Gameboy>> instances;
+  std::vector<RewardTerm> rewardTerms;
+
+  // Machines are reset to the end of the first frame drawn whole after the
+  // boot ROM.
+  Binary resetState;
+  Gameboy::ScreenBuffer resetScreen;
+
+  // Thread pool. Workers wait for a new generation of task, run it on their
+  // slice, and report back through pending.
+  unsigned threadCount{ 1 };
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable taskReady;
+  std::condition_variable taskDone;
+  Task task;
+  unsigned long long generation{ 0 };
+  unsigned pending{ 0 };
+  bool stopping{ false };
+  std::exception_ptr error;
+
+  // First machine of the slice of a thread. Slice t goes up to sliceBegin(t + 1).
+  std::size_t sliceBegin(unsigned thread) const;
+  // Run task on all slices, and wait for it to complete.
+  // @throws the first exception thrown by task, if any.
+  void runOnAll(const Task& newTask);
+  void runWorker(unsigned thread);
+  void stopWorkers();
+
+  double readRewards(const Gameboy& gameboy) const;
+  void resetInstance(Gameboy& gameboy);
+  // Run until the end of a frame that was drawn whole (see step()).
+  static void drawFrame(Gameboy& gameboy);
+  void writeObservation(const Gameboy& gameboy, word* observation) const;
+  void stepInstance(std::size_t index, word action, int frameskip, word* observations, float* rewards);
+
+ public:
+  // Constructor ///////////////////////////////////////////////////////////////
+  // With threads = 0, one thread per core is used (at most one per machine).
+  GameboyVecEnv(std::shared_ptr<const ROMImage> rom, std::size_t count,
+                std::vector<RewardTerm> rewards = {}, unsigned threads = 0);
+  ~GameboyVecEnv();
+
+  GameboyVecEnv(const GameboyVecEnv&) = delete;
+  GameboyVecEnv& operator=(const GameboyVecEnv&) = delete;
+  //////////////////////////////////////////////////////////////////////////////
+
+  // Bring all machines back to their start: the end of the first frame
+  // drawn whole after the boot ROM.
+  // @param observations count * OBSERVATION_SIZE bytes, or null.
+  void reset(word* observations = nullptr);
+  // Same as reset(), for a single machine.
+  void reset(std::size_t index, word* observation = nullptr);
+
+  // Set the joypad of each machine (see Gameboy::setJoypad) and run them all
+  // for some frames. Only the last frame is drawn, and steps end with it
+  // (when the screen enters VBlank), so that observations hold a whole
+  // frame. Steps last frameskip frames, except after the game turned the
+  // screen off and on: frames start over, and the last frame of the step
+  // ends wherever the first whole frame ends.
+  // @param actions count joypad values.
+  // @param observations count * OBSERVATION_SIZE bytes, or null.
+  // @param rewards count rewards, or null.
+  // @throws if frameskip is not positive.
+  void step(const word* actions, int frameskip, word* observations, float* rewards);
+
+  std::size_t size() const;
+  unsigned getThreadCount() const;
+  Gameboy& getInstance(std::size_t index);
+  const Gameboy& getInstance(std::size_t index) const;
+};
+
+}  // namespace gb
+
+#endif  // VEC_ENV_H
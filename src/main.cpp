@@ -8,9 +8,25 @@ int main(int argc, char* argv[]) {
 
   // Parse command line arguments
   bool showHelp{false};
+  bool threadedRendering{false};
+  int runAheadFrames{0};
   std::string romPath{};
+  std::string recordPath{};
+  std::string playPath{};
 
   const auto cli = lyra::help(showHelp)
+                 | lyra::opt(threadedRendering)
+                   ["-t"]["--threaded-rendering"]
+                   ("Draw the screen on a separate thread.")
+                 | lyra::opt(runAheadFrames, "frames")
+                   ["--run-ahead"]
+                   ("Show frames this far ahead, to hide input lag built into games.")
+                 | lyra::opt(recordPath, "movie")
+                   ["--record"]
+                   ("Record all inputs to a movie file.")
+                 | lyra::opt(playPath, "movie")
+                   ["--play"]
+                   ("Play back a recorded movie file.")
                  | lyra::arg(romPath, "path")
                    ("Path to Game Boy rom.");
 
@@ -35,6 +51,14 @@ int main(int argc, char* argv[]) {
     // handle non-exceptional path without overhead.
     // see https://stackoverflow.com/questions/16784601/does-try-catch-block-decrease-performance
     gb::Frontend frontend{ romPath };
+    frontend.setThreadedRendering(threadedRendering);
+    frontend.setRunAhead(runAheadFrames);
+    if (!recordPath.empty()) {
+      frontend.recordMovie(recordPath);
+    }
+    if (!playPath.empty()) {
+      frontend.playMovie(playPath);
+    }
     // Start main emulation loop. This function returns when the window closes
     // or when there is an error.
     frontend.start();
@@ -57,6 +57,8 @@ typedef enum : dword {
   ECHO_RAM_LOWER_BOUND_1 = 0xC000,
   ECHO_RAM_UPPER_BOUND_1 = 0xDE00,
   OAM_MEMORY_LOWER_BOUND = 0xFE00,
+  VRAM_LOWER_BOUND       = 0x8000,
+  VRAM_UPPER_BOUND       = 0xA000,
   TILEDATA_LOWER_BOUND   = 0x8000,
   TILEDATA_UPPER_BOUND   = 0x9800,
   TILEMAP_LOWER_BOUND    = 0x9800,
@@ -112,7 +112,7 @@ TEST_CASE("AddressBus Cartridge Operations") {
   Gameboy gameboy{ rom };
   AddressBus bus{ &gameboy };
   // Load empty ROM to address bus
-  const auto cart = std::make_unique<MBC0>(rom);
+  const auto cart = std::make_unique<MBC0>(ROMImage::fromBinary(rom));
   bus.loadCart(cart.get());
 
   SUBCASE("Cartridge Reference Check") {
@@ -0,0 +1,129 @@
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include "doctest.h"
+#include "gameboy.hpp"
+#include "gameboy-pool.hpp"
+#include "types.hpp"
+#include "test-helpers.hpp"
+
+using namespace gb;
+
+// Global allocation functions are replaced for the whole test executable.
+// Allocations are only counted while counting is true.
+namespace {
+
+std::atomic<bool> counting{ false };
+std::atomic<unsigned long> allocations{ 0 };
+
+void* allocate(const std::size_t size) {
+  if (counting) {
+    ++allocations;
+  }
+  // malloc(0) may return null.
+  if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc{};
+}
+
+}  // namespace
+
+void* operator new(const std::size_t size) {
+  return allocate(size);
+}
+void* operator new[](const std::size_t size) {
+  return allocate(size);
+}
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+void operator delete[](void* memory) noexcept {
+  std::free(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+void operator delete[](void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+namespace {
+
+// Count allocations while running a machine for some frames.
+unsigned long allocationsDuring(Gameboy& gameboy, const int frames) {
+  allocations = 0;
+  counting = true;
+  runFrames(gameboy, frames);
+  counting = false;
+  return allocations;
+}
+
+Binary readROM(const std::string& path) {
+  std::ifstream input(path, std::ios_base::binary);
+  REQUIRE_FALSE(input.fail());
+  return { std::istreambuf_iterator<char>(input), {} };
+}
+
+}  // namespace
+
+// Once a machine is created, running it must not allocate: allocations in
+// the emulation loop cause latency spikes, and contention on the allocator
+// when many machines run in the same process.
+TEST_CASE("Emulation Does Not Allocate") {
+  SUBCASE("tetris") {
+    Gameboy gameboy{ ROMImage::fromFile("tetris.gb") };
+    CHECK_EQ(allocationsDuring(gameboy, 300), 0);
+
+    // Press start, so that the game begins.
+    gameboy.setJoypad(0b01111111);
+    CHECK_EQ(allocationsDuring(gameboy, 60), 0);
+    gameboy.setJoypad(0b11111111);
+    CHECK_EQ(allocationsDuring(gameboy, 300), 0);
+
+    gameboy.setRenderingEnabled(false);
+    CHECK_EQ(allocationsDuring(gameboy, 60), 0);
+  }
+
+  SUBCASE("Blargg test ROMs") {
+    // Most of these write their results to serial.
+    const std::string paths[] = {
+      "blargg-test-roms/cpu_instrs/individual/01-special.gb",
+      "blargg-test-roms/cpu_instrs/individual/02-interrupts.gb",
+      "blargg-test-roms/cpu_instrs/individual/03-op sp,hl.gb",
+      "blargg-test-roms/cpu_instrs/individual/04-op r,imm.gb",
+      "blargg-test-roms/cpu_instrs/individual/05-op rp.gb",
+      "blargg-test-roms/cpu_instrs/individual/06-ld r,r.gb",
+      "blargg-test-roms/cpu_instrs/individual/07-jr,jp,call,ret,rst.gb",
+      "blargg-test-roms/cpu_instrs/individual/08-misc instrs.gb",
+      "blargg-test-roms/instr_timing/instr_timing.gb",
+      "blargg-test-roms/halt_bug/halt_bug.gb",
+    };
+    bool serialWritten{ false };
+    for (const auto& path : paths) {
+      CAPTURE(path);
+      Gameboy gameboy{ readROM(path) };
+      gameboy.skipBoot();
+      CHECK_EQ(allocationsDuring(gameboy, 300), 0);
+      serialWritten = serialWritten || !gameboy.serialBuffer.empty();
+    }
+    CHECK(serialWritten);
+  }
+
+  SUBCASE("Pool turnover") {
+    GameboyPool pool{ ROMImage::fromFile("tetris.gb"), 2 };
+    // The first reset and boot fill the caches of power-on and boot states.
+    pool.acquire(true);
+
+    allocations = 0;
+    counting = true;
+    for (int episode = 0; episode != 10; ++episode) {
+      auto gameboy = pool.acquire(episode % 2 == 0);
+      runFrames(*gameboy, 10);
+    }
+    counting = false;
+    CHECK_EQ(allocations, 0);
+  }
+}
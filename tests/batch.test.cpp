@@ -0,0 +1,103 @@
+#include "batch.hpp"
+#include "gameboy.hpp"
+#include "movie.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "doctest.h"
+#include "test-helpers.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+using namespace gb;
+
+TEST_CASE("Batch Runs") {
+  // A short movie: its jobs end with it, whatever the clocks of the batch.
+  const std::string moviePath{ "batch-test.gbmv" };
+  constexpr int movieFrames{ 30 };
+  {
+    Gameboy gameboy{ ROMImage::fromFile("tetris.gb") };
+    gameboy.boot();
+    MovieRecorder recorder{ moviePath, gameboy, 10 };
+    for (int frame = 0; frame != movieFrames; ++frame) {
+      recorder.setJoypad(gameboy, frame % 10 == 0 ? 0b01111111 : 0b11111111);
+      runFrames(gameboy, 1);
+      recorder.update(gameboy);
+    }
+    recorder.finish(gameboy);
+  }
+
+  const std::vector<batch::Job> jobs{
+    { "tetris.gb", "" },
+    { "blargg-test-roms/cpu_instrs/individual/06-ld r,r.gb", "" },
+    { "tetris.gb", moviePath },
+    { "missing.gb", "" },
+    { "tetris.gb", "" },
+  };
+  constexpr unsigned long long clocks{ 120 * batch::CLOCKS_PER_FRAME };
+
+  const auto threaded = batch::runOnThreads(jobs, clocks, 2);
+  REQUIRE_EQ(threaded.size(), jobs.size());
+  CHECK(threaded[0].error.empty());
+  CHECK_EQ(threaded[0].clocks, clocks);
+  CHECK_EQ(threaded[0].frameHash, threaded[4].frameHash);
+  CHECK_FALSE(threaded[1].serial.empty());
+  CHECK(threaded[2].error.empty());
+  CHECK_EQ(threaded[2].clocks, movieFrames * batch::CLOCKS_PER_FRAME);
+  CHECK_FALSE(threaded[3].error.empty());
+
+#if defined(__unix__) || defined(__APPLE__)
+  SUBCASE("Processes give the same results") {
+    // A single worker runs more jobs than its result ring holds.
+    const auto results = batch::runInProcesses(jobs, clocks, 1);
+    REQUIRE_EQ(results.size(), jobs.size());
+    for (std::size_t i = 0; i != jobs.size(); ++i) {
+      CHECK_EQ(results[i].clocks, threaded[i].clocks);
+      CHECK_EQ(results[i].frameHash, threaded[i].frameHash);
+      CHECK_EQ(results[i].serial, threaded[i].serial);
+      CHECK_EQ(results[i].error.empty(), threaded[i].error.empty());
+    }
+  }
+
+  SUBCASE("Crashed workers are replaced") {
+    // Forked workers start with no CPU time used, and inherit the limit: the
+    // worker running a job that never ends gets killed (SIGXCPU). The limit
+    // is past the CPU time used by this process so far.
+    rlimit cpu{};
+    rlimit core{};
+    REQUIRE_EQ(getrlimit(RLIMIT_CPU, &cpu), 0);
+    REQUIRE_EQ(getrlimit(RLIMIT_CORE, &core), 0);
+    rusage usage{};
+    REQUIRE_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+
+    rlimit limitedCPU{ cpu };
+    limitedCPU.rlim_cur = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 3;
+    rlimit noCore{ core };
+    noCore.rlim_cur = 0;
+    REQUIRE_EQ(setrlimit(RLIMIT_CORE, &noCore), 0);
+    REQUIRE_EQ(setrlimit(RLIMIT_CPU, &limitedCPU), 0);
+
+    const std::vector<batch::Job> crashing{
+      { "tetris.gb", "" },
+      { "tetris.gb", moviePath },
+      { "tetris.gb", moviePath },
+    };
+    const auto results = batch::runInProcesses(crashing, ~0ull, 1);
+    setrlimit(RLIMIT_CPU, &cpu);
+    setrlimit(RLIMIT_CORE, &core);
+
+    REQUIRE_EQ(results.size(), crashing.size());
+    CHECK_NE(results[0].error.find("killed by signal"), std::string::npos);
+    for (std::size_t i = 1; i != crashing.size(); ++i) {
+      CHECK(results[i].error.empty());
+      CHECK_EQ(results[i].clocks, threaded[2].clocks);
+      CHECK_EQ(results[i].frameHash, threaded[2].frameHash);
+    }
+  }
+#endif
+
+  std::remove(moviePath.c_str());
+}
@@ -0,0 +1,100 @@
+#include "libgameboy.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "doctest.h"
+
+TEST_CASE("C Interface") {
+  CHECK_EQ(gb_api_version(), GB_API_VERSION);
+
+  std::ifstream input("tetris.gb", std::ios_base::binary);
+  REQUIRE(input);
+  const std::vector<uint8_t> rom{ std::istreambuf_iterator<char>(input), {} };
+
+  gb_machine* machine = gb_create(rom.data(), rom.size());
+  REQUIRE(machine != nullptr);
+  CHECK_EQ(gb_boot(machine), 0);
+  const uint64_t bootClocks = gb_clock_count(machine);
+  CHECK(bootClocks > 0);
+
+  SUBCASE("Running and screen") {
+    const uint8_t* screen = gb_screen(machine);
+    CHECK_EQ(gb_run_frames(machine, 120), 0);
+    CHECK_EQ(gb_clock_count(machine), bootClocks + 120 * GB_CLOCKS_PER_FRAME);
+    CHECK_EQ(gb_run_clocks(machine, 10), 0);
+    CHECK_EQ(gb_clock_count(machine), bootClocks + 120 * GB_CLOCKS_PER_FRAME + 10);
+    CHECK(gb_frames_drawn(machine) > 0);
+
+    // Screen is shared in place: same pointer, updated content.
+    CHECK_EQ(gb_screen(machine), screen);
+    bool drawn{ false };
+    for (int i = 0; i != GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT; ++i) {
+      REQUIRE(screen[i] <= 3);
+      drawn = drawn || screen[i] != 0;
+    }
+    CHECK(drawn);
+
+    // Pressing start changes what happens next.
+    std::vector<uint8_t> state(gb_state_size(machine));
+    gb_save_state(machine, state.data(), state.size());
+    gb_run_frames(machine, 60);
+    const uint64_t released = gb_state_hash(machine);
+    gb_load_state(machine, state.data(), state.size());
+    gb_set_buttons(machine, GB_BUTTON_START);
+    gb_run_frames(machine, 60);
+    CHECK_NE(gb_state_hash(machine), released);
+  }
+
+  SUBCASE("Memory") {
+    size_t size{ 0 };
+    const uint8_t* wram = gb_memory(machine, GB_MEMORY_WRAM, &size);
+    CHECK_EQ(size, 0x2000);
+    const uint8_t* hram = gb_memory(machine, GB_MEMORY_HRAM, &size);
+    CHECK_EQ(size, 0x7F);
+    CHECK_EQ(gb_memory(machine, GB_MEMORY_VRAM, &size) != nullptr, true);
+    CHECK_EQ(size, 0x2000);
+    CHECK_EQ(gb_memory(machine, GB_MEMORY_OAM, &size) != nullptr, true);
+    CHECK_EQ(size, 0xA0);
+    // Tetris has no cartridge RAM.
+    CHECK_EQ(gb_memory(machine, GB_MEMORY_CART, &size), nullptr);
+    CHECK_EQ(size, 0);
+
+    gb_run_frames(machine, 60);
+    for (int i = 0; i != 0x2000; ++i) {
+      REQUIRE_EQ(wram[i], gb_read(machine, 0xC000 + i));
+    }
+    for (int i = 0; i != 0x7F; ++i) {
+      REQUIRE_EQ(hram[i], gb_read(machine, 0xFF80 + i));
+    }
+  }
+
+  SUBCASE("Save states") {
+    std::vector<uint8_t> state(gb_state_size(machine));
+    CHECK_EQ(gb_save_state(machine, state.data(), state.size()), state.size());
+    const uint64_t hash = gb_state_hash(machine);
+
+    gb_run_frames(machine, 30);
+    CHECK_NE(gb_state_hash(machine), hash);
+    CHECK_EQ(gb_load_state(machine, state.data(), state.size()), 0);
+    CHECK_EQ(gb_state_hash(machine), hash);
+    CHECK_EQ(gb_clock_count(machine), bootClocks);
+
+    // Errors are reported, not thrown.
+    CHECK_EQ(gb_save_state(machine, state.data(), 16), 0);
+    CHECK(std::strlen(gb_last_error()) > 0);
+    state[0] = 'X';
+    CHECK_EQ(gb_load_state(machine, state.data(), state.size()), -1);
+    CHECK_EQ(std::string{ gb_last_error() }, "Data is not a save state!");
+    CHECK_EQ(gb_boot(machine), 0);
+    CHECK_EQ(std::string{ gb_last_error() }, "");
+  }
+
+  gb_destroy(machine);
+
+  CHECK_EQ(gb_create(nullptr, 0), nullptr);
+  CHECK_EQ(gb_create(rom.data(), 100), nullptr);
+  CHECK(std::strlen(gb_last_error()) > 0);
+  gb_destroy(nullptr);
+}
@@ -1,8 +1,23 @@
 #include "cartridge.hpp"
+#include "cartridge-types.hpp"
+#include "save-file.hpp"
+#include "save-state.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iterator>
 #include <vector>
 #include <string>
+#include <thread>
 #include "doctest.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace gb;
 
 // Helper function to create a minimal valid ROM binary
@@ -86,4 +101,414 @@ TEST_CASE("Cartridge Edge Cases") {
     // This should throw an exception or handle the error gracefully
     CHECK_THROWS(Cartridge::Header(smallRom));
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Cartridge ROM Images") {
+  SUBCASE("Mapped from file") {
+    const auto image = ROMImage::fromFile("tetris.gb");
+    CHECK(image->isMapped());
+    CHECK_EQ(image->size(), 0x8000);
+    CHECK_EQ(Cartridge::getMBC(*image), Cartridge::MBCType::MBC0);
+
+    // Header is the same as the one read from a copy of the file.
+    std::ifstream input("tetris.gb", std::ios_base::binary);
+    const auto rom = Binary(std::istreambuf_iterator<char>(input), {});
+    CHECK(std::equal(rom.begin(), rom.end(), image->data()));
+    CHECK_EQ(Cartridge::Header{ *image }.headerChecksum, Cartridge::Header{ rom }.headerChecksum);
+  }
+
+  SUBCASE("Copied from binary") {
+    const auto rom = createTestROM();
+    const auto image = ROMImage::fromBinary(rom);
+    CHECK_FALSE(image->isMapped());
+    CHECK_EQ(image->size(), rom.size());
+    CHECK(std::equal(rom.begin(), rom.end(), image->data()));
+  }
+
+  SUBCASE("Used in place") {
+    const auto rom = createTestROM();
+    const auto image = ROMImage::fromMemory(rom.data(), rom.size());
+    CHECK_FALSE(image->isMapped());
+    CHECK_EQ(image->data(), rom.data());
+    CHECK_EQ(image->size(), rom.size());
+  }
+
+  SUBCASE("Invalid files") {
+    CHECK_THROWS(ROMImage::fromFile("nonexistent.gb"));
+  }
+}
+
+// Each bank starts with its own number (low byte, then high byte).
+std::shared_ptr<const ROMImage> createBankedROM(Cartridge::MBCType mbcType, word ROMSize, word RAMSize) {
+  const unsigned int banks = 2u << ROMSize;
+  Binary rom(banks * Cartridge::ROM_BANK_SIZE, 0);
+  for (unsigned int bank = 0; bank != banks; ++bank) {
+    rom[bank * Cartridge::ROM_BANK_SIZE] = bank & 0xFF;
+    rom[bank * Cartridge::ROM_BANK_SIZE + 1] = bank >> 8;
+  }
+  rom[0x147] = static_cast<word>(mbcType);
+  rom[0x148] = ROMSize;
+  rom[0x149] = RAMSize;
+
+  return ROMImage::fromBinary(rom);
+}
+
+unsigned int highBank(const Cartridge& cart) {
+  return cart.read(0x4000) | cart.read(0x4001) << 8;
+}
+
+TEST_CASE("Cartridge Bank Mapping") {
+  SUBCASE("MBC1") {
+    // 2MB ROM (128 banks), 32KB RAM
+    MBC1 cart{ createBankedROM(Cartridge::MBC1_RAM, 0x06, 0x03) };
+    CHECK_EQ(highBank(cart), 1);
+
+    // Bank 0 maps to 1, upper bits are added afterwards
+    cart.write(0x2000, 0x00);
+    CHECK_EQ(highBank(cart), 1);
+    cart.write(0x4000, 0x01);
+    CHECK_EQ(highBank(cart), 0x21);
+    cart.write(0x2000, 0x05);
+    CHECK_EQ(highBank(cart), 0x25);
+    CHECK_EQ(cart.read(0x0000), 0);
+
+    // Mode 1 maps upper bits in low area too
+    cart.write(0x6000, 0x01);
+    CHECK_EQ(cart.read(0x0000), 0x20);
+
+    // RAM is disabled by default
+    CHECK_EQ(cart.read(0xA000), 0xFF);
+    cart.write(0x0000, 0x0A);
+    cart.write(0xA000, 0x42);
+    CHECK_EQ(cart.read(0xA000), 0x42);
+    // In mode 1, RAM bank is selected by the upper bits as well
+    cart.write(0x4000, 0x02);
+    CHECK_EQ(cart.read(0xA000), 0x00);
+    cart.write(0x4000, 0x01);
+    CHECK_EQ(cart.read(0xA000), 0x42);
+
+    cart.write(0x0000, 0x00);
+    CHECK_EQ(cart.read(0xA000), 0xFF);
+  }
+
+  SUBCASE("MBC1 small ROM") {
+    // 256KB ROM (16 banks): bank number wraps around.
+    MBC1 cart{ createBankedROM(Cartridge::MBC1, 0x03, 0x00) };
+    cart.write(0x2000, 0x13);
+    CHECK_EQ(highBank(cart), 0x03);
+  }
+
+  SUBCASE("MBC2") {
+    MBC2 cart{ createBankedROM(Cartridge::MBC2_BATTERY, 0x03, 0x00) };
+    CHECK_EQ(cart.getRam().size(), 0x200);
+
+    // Address bit 8 selects ROM bank register
+    cart.write(0x2100, 0x07);
+    CHECK_EQ(highBank(cart), 7);
+    cart.write(0x0100, 0x00);
+    CHECK_EQ(highBank(cart), 1);
+
+    // Half-byte RAM, mirrored
+    cart.write(0x0000, 0x0A);
+    cart.write(0xA001, 0xAB);
+    CHECK_EQ(cart.read(0xA001), 0xFB);
+    CHECK_EQ(cart.read(0xA201), 0xFB);
+  }
+
+  SUBCASE("MBC5") {
+    // 8MB ROM (512 banks), 128KB RAM
+    MBC5 cart{ createBankedROM(Cartridge::MBC5_RAM_BATTERY, 0x08, 0x04) };
+    CHECK_EQ(cart.getRam().size(), 0x20000);
+
+    // 9-bit bank number, and bank 0 can be mapped
+    cart.write(0x2000, 0x00);
+    CHECK_EQ(highBank(cart), 0);
+    cart.write(0x2000, 0x34);
+    cart.write(0x3000, 0x01);
+    CHECK_EQ(highBank(cart), 0x134);
+
+    cart.write(0x0000, 0x0A);
+    cart.write(0x4000, 0x0F);
+    cart.write(0xBFFF, 0x42);
+    CHECK_EQ(cart.getRam()[0x1FFFF], 0x42);
+    cart.write(0x4000, 0x00);
+    CHECK_EQ(cart.read(0xBFFF), 0x00);
+  }
+}
+
+TEST_CASE("Cartridge Save Files") {
+  const std::string path = "cartridge-test.sav";
+  std::remove(path.c_str());
+
+  SUBCASE("RAM persists in file") {
+    {
+      MBC1 cart{ createBankedROM(Cartridge::MBC1_RAM_BATTERY, 0x01, 0x03) };
+      cart.write(0x0000, 0x0A);
+      cart.write(0xA000, 0x11);
+      // File does not exist yet: it gets created from current RAM.
+      CHECK_FALSE(cart.attachSaveFile(path, std::chrono::seconds{ 10 }));
+      CHECK_EQ(cart.read(0xA000), 0x11);
+
+      // RAM banking mode
+      cart.write(0x6000, 0x01);
+      cart.write(0x4000, 0x03);
+      cart.write(0xBFFF, 0x42);
+      cart.flushSaveFile();
+    }
+
+    std::ifstream input(path, std::ios_base::binary);
+    const auto save = Binary(std::istreambuf_iterator<char>(input), {});
+    REQUIRE_EQ(save.size(), 0x8000);
+    CHECK_EQ(save[0x0000], 0x11);
+    CHECK_EQ(save[0x7FFF], 0x42);
+
+    // Reopening loads the file content.
+    MBC1 cart{ createBankedROM(Cartridge::MBC1_RAM_BATTERY, 0x01, 0x03) };
+    CHECK(cart.attachSaveFile(path, std::chrono::seconds{ 10 }));
+    CHECK_EQ(cart.getRam(), save);
+  }
+
+  SUBCASE("MBC2 internal RAM") {
+    {
+      MBC2 cart{ createBankedROM(Cartridge::MBC2_BATTERY, 0x01, 0x00) };
+      cart.attachSaveFile(path, std::chrono::seconds{ 10 });
+      cart.write(0x0000, 0x0A);
+      cart.write(0xA1FF, 0x0C);
+    }
+
+    MBC2 cart{ createBankedROM(Cartridge::MBC2_BATTERY, 0x01, 0x00) };
+    CHECK(cart.attachSaveFile(path, std::chrono::seconds{ 10 }));
+    cart.write(0x0000, 0x0A);
+    CHECK_EQ(cart.read(0xA1FF), 0xFC);
+  }
+
+  SUBCASE("Flush on request") {
+    const Binary ram(0x2000, 0);
+    SaveFile file{ path, ram.size(), ram.data(), std::chrono::hours{ 1 } };
+    file.getData()[0x1000] = 0x42;
+    file.markDirty();
+    file.requestFlush();
+
+    // Background thread does not wait for the interval.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 10 };
+    while (file.getFlushCount() == 0 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+    CHECK_EQ(file.getFlushCount(), 1);
+
+    // The file was replaced whole, and nothing is left behind.
+    std::ifstream input(path, std::ios_base::binary);
+    const auto save = Binary(std::istreambuf_iterator<char>(input), {});
+    REQUIRE_EQ(save.size(), ram.size());
+    CHECK_EQ(save[0x1000], 0x42);
+    CHECK_FALSE(std::ifstream(path + ".tmp").good());
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  SUBCASE("RAM survives a crash") {
+    const Binary ram(0x2000, 0);
+    // Child process writes RAM, then dies without flushing.
+    const pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+      SaveFile* file = new SaveFile{ path, ram.size(), ram.data(), std::chrono::hours{ 1 } };
+      file->getData()[0x1000] = 0x42;
+      file->markDirty();
+      _exit(0);
+    }
+    int status;
+    REQUIRE_EQ(waitpid(pid, &status, 0), pid);
+
+    // The file is still as it was created.
+    {
+      std::ifstream input(path, std::ios_base::binary);
+      const auto save = Binary(std::istreambuf_iterator<char>(input), {});
+      REQUIRE_EQ(save.size(), ram.size());
+      CHECK_EQ(save[0x1000], 0x00);
+    }
+
+    // RAM is picked up from memory, and reaches the disk on close.
+    {
+      SaveFile file{ path, ram.size(), ram.data(), std::chrono::hours{ 1 } };
+      CHECK_FALSE(file.wasCreated());
+      CHECK_EQ(file.getData()[0x1000], 0x42);
+    }
+    std::ifstream input(path, std::ios_base::binary);
+    const auto save = Binary(std::istreambuf_iterator<char>(input), {});
+    CHECK_EQ(save[0x1000], 0x42);
+
+    // Memory is gone once RAM is on disk.
+    std::remove(path.c_str());
+    {
+      std::ofstream output(path, std::ios_base::binary);
+      output << std::string(ram.size(), '\0');
+    }
+    SaveFile file{ path, ram.size(), ram.data(), std::chrono::hours{ 1 } };
+    CHECK_EQ(file.getData()[0x1000], 0x00);
+  }
+#endif
+
+  SUBCASE("Wrong size") {
+    {
+      std::ofstream output(path, std::ios_base::binary);
+      output << "too short";
+    }
+
+    MBC1 cart{ createBankedROM(Cartridge::MBC1_RAM_BATTERY, 0x01, 0x03) };
+    CHECK_THROWS(cart.attachSaveFile(path, std::chrono::seconds{ 10 }));
+    // RAM is still usable.
+    cart.write(0x0000, 0x0A);
+    cart.write(0xA000, 0x42);
+    CHECK_EQ(cart.read(0xA000), 0x42);
+  }
+
+  std::remove(path.c_str());
+}
+
+word readClockRegister(Cartridge& cart, word reg) {
+  cart.write(0x4000, reg);
+  return cart.read(0xA000);
+}
+
+TEST_CASE("Cartridge Real Time Clock") {
+  MBC3 cart{ createBankedROM(Cartridge::MBC3_TIMER_RAM_BATTERY, 0x01, 0x03) };
+  REQUIRE(cart.getRTC() != nullptr);
+  unsigned long long clock{ 0 };
+  cart.getRTC()->attachClock(&clock);
+  cart.write(0x0000, 0x0A);
+
+  const auto latch = [&cart]() {
+    cart.write(0x6000, 0x00);
+    cart.write(0x6000, 0x01);
+  };
+
+  SUBCASE("Advances with emulated clocks") {
+    // Not even a second
+    clock += RTC::CLOCKS_PER_SECOND - 1;
+    latch();
+    CHECK_EQ(readClockRegister(cart, RTC::SECONDS), 0);
+
+    // Registers only change when latched
+    clock += 1 + 61 * RTC::CLOCKS_PER_SECOND;
+    CHECK_EQ(readClockRegister(cart, RTC::SECONDS), 0);
+    latch();
+    CHECK_EQ(readClockRegister(cart, RTC::SECONDS), 2);
+    CHECK_EQ(readClockRegister(cart, RTC::MINUTES), 1);
+
+    // RAM banks are still there
+    cart.write(0x4000, 0x00);
+    cart.write(0xA000, 0x42);
+    CHECK_EQ(cart.read(0xA000), 0x42);
+  }
+
+  SUBCASE("Day counter carry") {
+    cart.write(0x4000, RTC::DAYS_LOW);
+    cart.write(0xA000, 0xFF);
+    cart.write(0x4000, RTC::DAYS_HIGH);
+    cart.write(0xA000, 0x01);
+    cart.write(0x4000, RTC::HOURS);
+    cart.write(0xA000, 23);
+    cart.write(0x4000, RTC::MINUTES);
+    cart.write(0xA000, 59);
+    cart.write(0x4000, RTC::SECONDS);
+    cart.write(0xA000, 59);
+
+    clock += RTC::CLOCKS_PER_SECOND;
+    latch();
+    CHECK_EQ(readClockRegister(cart, RTC::DAYS_LOW), 0);
+    CHECK_EQ(readClockRegister(cart, RTC::DAYS_HIGH), 0x80);
+    CHECK_EQ(readClockRegister(cart, RTC::HOURS), 0);
+  }
+
+  SUBCASE("Out of range values") {
+    // 62 seconds count up to 63 and wrap without carry
+    cart.write(0x4000, RTC::SECONDS);
+    cart.write(0xA000, 62);
+    clock += 3 * RTC::CLOCKS_PER_SECOND;
+    latch();
+    CHECK_EQ(readClockRegister(cart, RTC::SECONDS), 1);
+    CHECK_EQ(readClockRegister(cart, RTC::MINUTES), 0);
+  }
+
+  SUBCASE("Halt") {
+    cart.write(0x4000, RTC::DAYS_HIGH);
+    cart.write(0xA000, 0x40);
+    clock += 100 * RTC::CLOCKS_PER_SECOND;
+    latch();
+    CHECK_EQ(readClockRegister(cart, RTC::SECONDS), 0);
+
+    cart.write(0x4000, RTC::DAYS_HIGH);
+    cart.write(0xA000, 0x00);
+    clock += 5 * RTC::CLOCKS_PER_SECOND;
+    latch();
+    CHECK_EQ(readClockRegister(cart, RTC::SECONDS), 5);
+  }
+
+  SUBCASE("Save and load") {
+    clock += 3725 * RTC::CLOCKS_PER_SECOND;
+    latch();
+    const std::time_t savedAt = 1000000;
+    const auto data = cart.getRTC()->save(savedAt);
+    CHECK_EQ(data[0], 5);
+    CHECK_EQ(data[4], 2);
+    CHECK_EQ(data[8], 1);
+    CHECK_EQ(data[20], 5);
+
+    MBC3 loaded{ createBankedROM(Cartridge::MBC3_TIMER_RAM_BATTERY, 0x01, 0x03) };
+    loaded.write(0x0000, 0x0A);
+    loaded.getRTC()->load(data.data(), data.size(), savedAt + 10, false);
+    CHECK_EQ(readClockRegister(loaded, RTC::SECONDS), 5);
+
+    // Wall-clock sync adds the time passed since saving.
+    loaded.getRTC()->load(data.data(), data.size(), savedAt + 10, true);
+    loaded.write(0x6000, 0x00);
+    loaded.write(0x6000, 0x01);
+    CHECK_EQ(readClockRegister(loaded, RTC::SECONDS), 15);
+
+    CHECK_THROWS(loaded.getRTC()->load(data.data(), 10, savedAt, false));
+  }
+
+  SUBCASE("Not present on plain MBC3") {
+    MBC3 plain{ createBankedROM(Cartridge::MBC3_RAM_BATTERY, 0x01, 0x03) };
+    CHECK(plain.getRTC() == nullptr);
+    plain.write(0x0000, 0x0A);
+    CHECK_EQ(readClockRegister(plain, RTC::SECONDS), 0xFF);
+  }
+}
+
+TEST_CASE("Cartridge State Hash") {
+  const auto image = createBankedROM(Cartridge::MBC1_RAM_BATTERY, 0x01, 0x03);
+  MBC1 cart{ image };
+  MBC1 other{ image };
+  CHECK_EQ(cart.stateHash(), other.stateHash());
+
+  // Registers count
+  cart.write(0x0000, 0x0A);
+  CHECK(cart.stateHash() != other.stateHash());
+
+  // RAM too, wherever it is
+  cart.write(0xA000, 0x11);
+  cart.write(0x6000, 0x01);
+  cart.write(0x4000, 0x03);
+  cart.write(0xBFFF, 0x22);
+  const auto hash = cart.stateHash();
+  cart.write(0xBFFF, 0x33);
+  CHECK(cart.stateHash() != hash);
+  cart.write(0xBFFF, 0x22);
+  CHECK_EQ(cart.stateHash(), hash);
+
+  // Same state, reached in different ways
+  other.loadBatteryBackedRAM(cart.getRam());
+  other.write(0x0000, 0x0A);
+  other.write(0x6000, 0x01);
+  other.write(0x4000, 0x03);
+  CHECK_EQ(other.stateHash(), hash);
+
+  Binary state(0x10000);
+  state::Writer writer{ state.data(), state.size() };
+  cart.saveState(writer);
+  state.resize(writer.finish());
+  MBC1 loaded{ image };
+  state::Reader reader{ state.data(), state.size() };
+  loaded.loadState(reader);
+  CHECK_EQ(loaded.stateHash(), hash);
+}
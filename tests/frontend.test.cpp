@@ -6,6 +6,5 @@ using namespace gb;
 TEST_CASE("Frontend ROM Loading") {
   SUBCASE("Invalid ROM Path") {
     CHECK_THROWS(Frontend("nonexistent.gb"));
-    CHECK_THROWS(Frontend::getROM("nonexistent.gb"));
   }
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "gameboy-pool.hpp"
+#include <set>
+#include <vector>
+#include "doctest.h"
+#include "test-helpers.hpp"
+#include "types.hpp"
+
+using namespace gb;
+
+TEST_CASE("GameboyPool") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+
+  constexpr std::size_t count{ 4 };
+  GameboyPool pool{ image, count };
+  CHECK_EQ(pool.size(), count);
+  CHECK_EQ(pool.getAvailable(), count);
+  CHECK_THROWS(GameboyPool(image, 0));
+
+  SUBCASE("Machines are handed out once") {
+    std::vector<GameboyPool::Handle> handles;
+    std::set<const Gameboy*> machines;
+    for (std::size_t i = 0; i != count; ++i) {
+      handles.push_back(pool.acquire());
+      machines.insert(handles.back().get());
+    }
+    CHECK_EQ(machines.size(), count);
+    CHECK_EQ(pool.getAvailable(), 0);
+    CHECK_THROWS(pool.acquire());
+
+    // Machines are next to each other.
+    const auto first = reinterpret_cast<const char*>(*machines.begin());
+    const auto last = reinterpret_cast<const char*>(*machines.rbegin());
+    CHECK_EQ(last - first, static_cast<long>((count - 1) * sizeof(Gameboy)));
+
+    handles.pop_back();
+    CHECK_EQ(pool.getAvailable(), 1);
+    CHECK(pool.acquire());
+  }
+
+  SUBCASE("Machines are reset when handed out again") {
+    Gameboy fresh{ image };
+    const Gameboy* used{ nullptr };
+    {
+      auto gameboy = pool.acquire();
+      used = gameboy.get();
+      gameboy->setJoypad(0b01111111);
+      gameboy->setRenderingEnabled(false);
+      gameboy->setThreadedRendering(true);
+      runFrames(*gameboy, 60);
+    }
+
+    auto gameboy = pool.acquire();
+    CHECK_EQ(gameboy.get(), used);
+    CHECK(saveState(*gameboy) == saveState(fresh));
+    CHECK(gameboy->isRenderingEnabled());
+    CHECK_FALSE(gameboy->isRenderingThreaded());
+    gameboy.reset();
+
+    // Booted machines end up where the boot ROM does.
+    fresh.boot();
+    gameboy = pool.acquire(true);
+    CHECK(saveState(*gameboy) == saveState(fresh));
+  }
+}
@@ -1,6 +1,10 @@
 #include "gameboy.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <vector>
 #include "doctest.h"
+#include "test-helpers.hpp"
 #include "types.hpp"
 
 using namespace gb;
@@ -34,7 +38,7 @@ TEST_CASE("Gameboy Initialization") {
 
     // Screen buffer should be initialized to all zeros (black)
     for (const auto& pixel : gameboy.screenBuffer) {
-      CHECK_EQ(pixel.to_ulong(), 0);
+      CHECK_EQ(pixel, 0);
     }
 
     // Should not have battery-backed save by default with ROM ONLY cartridge
@@ -51,6 +55,15 @@ TEST_CASE("Gameboy Initialization") {
   }
 }
 
+TEST_CASE("Gameboy Footprint") {
+  // Thousands of machines can run side by side (see GameboyVecEnv): keep
+  // them small. The bus only holds memory it owns.
+  CHECK(sizeof(AddressBus) <= 17 * 1024);
+  CHECK(sizeof(Gameboy) <= 80 * 1024);
+  // So do states, which get copied around (e.g. by rewinding).
+  CHECK(Gameboy{ createMinimalTestROM() }.stateSize() <= 20 * 1024);
+}
+
 TEST_CASE("Gameboy Save State") {
   SUBCASE("ROM Only (No Save)") {
     Binary rom = createMinimalTestROM();
@@ -100,4 +113,429 @@ TEST_CASE("Loading ROM of unsupported MBC Type") {
 
   // Gameboy has to throw.
   CHECK_THROWS(Gameboy{ rom });
-}
\ No newline at end of file
+}
+TEST_CASE("Gameboy Threaded Rendering") {
+  std::ifstream input("tetris.gb", std::ios_base::binary);
+  REQUIRE_FALSE(input.fail());
+  const auto rom = Binary(std::istreambuf_iterator<char>(input), {});
+
+  Gameboy reference{ rom };
+  Gameboy threaded{ rom };
+  threaded.setThreadedRendering(true);
+  CHECK(threaded.isRenderingThreaded());
+
+  // Run for a few seconds (boot ROM and title screen),
+  // comparing the screens every frame.
+  bool screensMatch{ true };
+  for (int frame = 0; frame != 300; ++frame) {
+    for (int i = 0; i != cyclesPerFrame; ++i) {
+      reference.machineClock();
+      threaded.machineClock();
+    }
+
+    threaded.waitForRenderer();
+    screensMatch = screensMatch && reference.screenBuffer == threaded.screenBuffer;
+  }
+  CHECK(screensMatch);
+
+  threaded.setThreadedRendering(false);
+  CHECK_FALSE(threaded.isRenderingThreaded());
+}
+
+TEST_CASE("Gameboy PPU Log") {
+  std::ifstream input("tetris.gb", std::ios_base::binary);
+  REQUIRE_FALSE(input.fail());
+  const auto rom = Binary(std::istreambuf_iterator<char>(input), {});
+
+  const std::string logPath{ "ppu-log.test.bin" };
+  constexpr int frames{ 120 };
+
+  // Frames are stored one byte per pixel to save some memory.
+  const auto packFrame = [](const PPU::color* screen) {
+    std::vector<word> frame(PPU::TOTAL_PIXELS);
+    for (int i = 0; i != PPU::TOTAL_PIXELS; ++i) {
+      frame[i] = screen[i];
+    }
+    return frame;
+  };
+
+  // Record log while drawing normally. Each frame starts right at the
+  // beginning of a frame (see PPU), so screen buffer holds a full frame
+  // after each iteration.
+  std::vector<std::vector<word>> reference;
+  {
+    Gameboy gameboy{ rom };
+    gameboy.startPPULog(logPath, 25);
+    for (int frame = 0; frame != frames; ++frame) {
+      runFrames(gameboy, 1);
+      reference.push_back(packFrame(gameboy.screenBuffer.data()));
+    }
+    gameboy.stopPPULog();
+  }
+
+  SUBCASE("Rendering can be disabled") {
+    Gameboy gameboy{ rom };
+    gameboy.setRenderingEnabled(false);
+    CHECK_FALSE(gameboy.isRenderingEnabled());
+    runFrames(gameboy, frames);
+
+    bool screenUntouched{ true };
+    for (const auto& pixel : gameboy.screenBuffer) {
+      screenUntouched = screenUntouched && pixel == 0;
+    }
+    CHECK(screenUntouched);
+  }
+
+  SUBCASE("Segments render the same frames") {
+    PPULogReader reader{ logPath };
+    CHECK_EQ(reader.getKeyframeInterval(), 25);
+
+    const auto keyframes = reader.indexKeyframes();
+    REQUIRE_EQ(keyframes.size(), 5);
+    CHECK_EQ(keyframes[0].frameNumber, 0);
+    CHECK_EQ(keyframes[4].frameNumber, 100);
+
+    // Render segments backwards, so that each of them has to start from
+    // its own keyframe.
+    int framesRendered{ 0 };
+    bool framesMatch{ true };
+    for (auto i = keyframes.size(); i-- != 0;) {
+      const std::streamoff end = i + 1 < keyframes.size() ? keyframes[i + 1].offset : -1;
+      reader.renderSegment(keyframes[i].offset, end, [&](unsigned long frame, const PPU::color* screen) {
+        ++framesRendered;
+        framesMatch = framesMatch && frame < reference.size() && packFrame(screen) == reference[frame];
+      });
+    }
+    CHECK_EQ(framesRendered, frames);
+    CHECK(framesMatch);
+  }
+
+  CHECK_THROWS(PPULogReader{ "tetris.gb" });
+
+  std::remove(logPath.c_str());
+}
+
+TEST_CASE("Gameboy Dirty Lines") {
+  std::ifstream input("tetris.gb", std::ios_base::binary);
+  REQUIRE_FALSE(input.fail());
+  const auto rom = Binary(std::istreambuf_iterator<char>(input), {});
+
+
+  Gameboy gameboy{ rom };
+  Gameboy threaded{ rom };
+  threaded.setThreadedRendering(true);
+
+  CHECK_EQ(gameboy.getFramesDrawn(), 0);
+  CHECK_EQ(gameboy.getLastChangedFrame(), 0);
+
+  // Compare tracked lines with the ones that actually changed.
+  auto previous = gameboy.screenBuffer;
+  bool linesMatch{ true };
+  bool threadedMatch{ true };
+  int staticFrames{ 0 };
+  for (int frame = 1; frame != 300; ++frame) {
+    for (int i = 0; i != cyclesPerFrame; ++i) {
+      gameboy.machineClock();
+      threaded.machineClock();
+    }
+    threaded.waitForRenderer();
+
+    std::bitset<PPU::HEIGHT> changed;
+    for (int y = 0; y != PPU::HEIGHT; ++y) {
+      changed[y] = !std::equal(
+        previous.begin() + y * PPU::WIDTH,
+        previous.begin() + (y + 1) * PPU::WIDTH,
+        gameboy.screenBuffer.begin() + y * PPU::WIDTH);
+    }
+    previous = gameboy.screenBuffer;
+
+    linesMatch = linesMatch
+      && gameboy.getFramesDrawn() == static_cast<unsigned long long>(frame)
+      && gameboy.getDirtyLines() == changed
+      && gameboy.hasFrameChanged() == changed.any()
+      && (!changed.any() || gameboy.getLastChangedFrame() == gameboy.getFramesDrawn());
+    threadedMatch = threadedMatch
+      && threaded.getDirtyLines() == gameboy.getDirtyLines()
+      && threaded.getLastChangedFrame() == gameboy.getLastChangedFrame();
+    staticFrames += !changed.any();
+  }
+  CHECK(linesMatch);
+  CHECK(threadedMatch);
+
+  // Title screens do not change much.
+  CHECK(staticFrames > 0);
+  CHECK(gameboy.getLastChangedFrame() < gameboy.getFramesDrawn());
+}
+
+TEST_CASE("Gameboy Shared ROM") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+
+  {
+    Gameboy first{ image };
+    Gameboy second{ image };
+    // ROM is not copied.
+    CHECK_EQ(image.use_count(), 3);
+
+    for (int i = 0; i != 100000; ++i) {
+      first.machineClock();
+      second.machineClock();
+    }
+    CHECK(first.screenBuffer == second.screenBuffer);
+  }
+
+  CHECK_EQ(image.use_count(), 1);
+}
+
+TEST_CASE("Gameboy State Serialization") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+
+  Gameboy gameboy{ image };
+  runFrames(gameboy, 200);
+  // Press start, so that something happens.
+  gameboy.setJoypad(0b01111111);
+  runFrames(gameboy, 5);
+
+  const std::size_t size = gameboy.stateSize();
+  Binary state(size);
+  CHECK_EQ(gameboy.saveState(state.data(), state.size()), size);
+
+  SUBCASE("Emulation continues the same way") {
+    runFrames(gameboy, 60);
+    const auto expectedScreen = gameboy.screenBuffer;
+    Binary expectedState(size);
+    gameboy.saveState(expectedState.data(), expectedState.size());
+
+    // Same machine
+    gameboy.loadState(state.data(), state.size());
+    runFrames(gameboy, 60);
+    CHECK(gameboy.screenBuffer == expectedScreen);
+
+    // Fresh machine, with threaded rendering
+    Gameboy other{ image };
+    other.setThreadedRendering(true);
+    other.loadState(state.data(), state.size());
+    runFrames(other, 60);
+    other.waitForRenderer();
+    CHECK(other.screenBuffer == expectedScreen);
+
+    Binary otherState(size);
+    other.saveState(otherState.data(), otherState.size());
+    CHECK(otherState == expectedState);
+  }
+
+  SUBCASE("Invalid states") {
+    Binary small(size - 1);
+    CHECK_THROWS(gameboy.saveState(small.data(), small.size()));
+
+    Binary truncated(state.begin(), state.end() - 1);
+    CHECK_THROWS(gameboy.loadState(truncated.data(), truncated.size()));
+
+    Binary corrupted{ state };
+    corrupted[0] = 'X';
+    CHECK_THROWS(gameboy.loadState(corrupted.data(), corrupted.size()));
+
+    // Different cartridge
+    Gameboy other{ createMinimalTestROM() };
+    CHECK_THROWS(other.loadState(state.data(), state.size()));
+  }
+}
+
+TEST_CASE("Gameboy Cloning") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+
+  Gameboy gameboy{ image };
+  gameboy.setThreadedRendering(true);
+  runFrames(gameboy, 200);
+  gameboy.setJoypad(0b01111111);
+  runFrames(gameboy, 5);
+
+  const auto copy = gameboy.clone();
+  // ROM is shared, not copied.
+  CHECK_EQ(image.use_count(), 3);
+  CHECK_FALSE(copy->isRenderingThreaded());
+  CHECK(saveState(*copy) == saveState(gameboy));
+  gameboy.waitForRenderer();
+  CHECK(copy->screenBuffer == gameboy.screenBuffer);
+
+  // Both go on the same way, without affecting each other.
+  runFrames(gameboy, 60);
+  gameboy.waitForRenderer();
+  CHECK(saveState(*copy) != saveState(gameboy));
+  runFrames(*copy, 60);
+  CHECK(saveState(*copy) == saveState(gameboy));
+  CHECK(copy->screenBuffer == gameboy.screenBuffer);
+
+  // Different inputs lead to different machines.
+  copy->setJoypad(0b11111110);
+  runFrames(*copy, 30);
+  runFrames(gameboy, 30);
+  CHECK(saveState(*copy) != saveState(gameboy));
+}
+
+TEST_CASE("Gameboy State Hash") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+
+  Gameboy gameboy{ image };
+  Gameboy other{ image };
+  CHECK_EQ(gameboy.stateHash(), other.stateHash());
+
+  runFrames(gameboy, 100);
+  const auto hash = gameboy.stateHash();
+  CHECK(hash != other.stateHash());
+  Binary state(gameboy.stateSize());
+  gameboy.saveState(state.data(), state.size());
+
+  SUBCASE("Same state, same hash") {
+    other.loadState(state.data(), state.size());
+    CHECK_EQ(other.stateHash(), hash);
+    CHECK_EQ(gameboy.clone()->stateHash(), hash);
+
+    runFrames(gameboy, 1);
+    CHECK(gameboy.stateHash() != hash);
+    gameboy.loadState(state.data(), state.size());
+    CHECK_EQ(gameboy.stateHash(), hash);
+  }
+
+  SUBCASE("Hash follows every change") {
+    // A fresh machine loading the state hashes all of its memory, while the
+    // running one only hashes what changes.
+    gameboy.setJoypad(0b01111111);
+    bool hashesMatch{ true };
+    for (int frame = 0; frame != 30; ++frame) {
+      runFrames(gameboy, 1);
+      gameboy.saveState(state.data(), state.size());
+      Gameboy fresh{ image };
+      fresh.loadState(state.data(), state.size());
+      hashesMatch = hashesMatch && fresh.stateHash() == gameboy.stateHash();
+    }
+    CHECK(hashesMatch);
+  }
+}
+
+TEST_CASE("Gameboy Boot Snapshot") {
+
+  // Tetris header, but with battery-backed RAM, so that no other test
+  // boots the same cartridge.
+  std::ifstream input("tetris.gb", std::ios_base::binary);
+  auto rom = Binary(std::istreambuf_iterator<char>(input), {});
+  rom[0x147] = Cartridge::MBC1_RAM_BATTERY;
+  rom[0x149] = 0x02;
+  word checksum{ 0 };
+  for (int address = 0x134; address != 0x14D; ++address) {
+    checksum = checksum - rom[address] - 1;
+  }
+  rom[0x14D] = checksum;
+  const auto image = ROMImage::fromBinary(rom);
+
+  // First boot runs the boot ROM.
+  Gameboy first{ image };
+  CHECK_FALSE(first.boot());
+  const auto bootClocks = first.getClockCount();
+  CHECK(bootClocks > 0);
+  CHECK_FALSE(first.boot());
+  CHECK_EQ(first.getClockCount(), bootClocks);
+
+  // Same as clocking the machine by hand.
+  Gameboy manual{ image };
+  for (unsigned long long i = 0; i != bootClocks; ++i) {
+    manual.machineClock();
+  }
+  CHECK(saveState(manual) == saveState(first));
+
+  // Next ones restore the state, but keep cartridge RAM.
+  Gameboy cached{ image };
+  Binary ram(0x2000, 0x5A);
+  cached.loadSave(ram);
+  CHECK(cached.boot());
+  CHECK_EQ(cached.getClockCount(), bootClocks);
+  CHECK(cached.getSave() == ram);
+  cached.loadSave(Binary(0x2000, 0));
+  CHECK(saveState(cached) == saveState(first));
+
+  // Machines go on the same way.
+  runFrames(first, 30);
+  runFrames(cached, 30);
+  CHECK(saveState(cached) == saveState(first));
+
+  // Buttons set before booting stay this machine's own.
+  constexpr word held{ 0b01110111 };
+  Gameboy heldManual{ image };
+  heldManual.setJoypad(held);
+  for (unsigned long long i = 0; i != bootClocks; ++i) {
+    heldManual.machineClock();
+  }
+  Gameboy heldCached{ image };
+  heldCached.setJoypad(held);
+  CHECK(heldCached.boot());
+  CHECK(saveState(heldCached) == saveState(heldManual));
+
+  // ROMs that only differ in their global checksum boot the same way, but
+  // their states do not load on each other.
+  rom[0x14E] ^= 0xFF;
+  const auto otherImage = ROMImage::fromBinary(rom);
+  Gameboy other{ otherImage };
+  other.setJoypad(held);
+  CHECK_FALSE(other.boot());
+  CHECK_EQ(other.getClockCount(), bootClocks);
+
+  // Buttons held by the machine that filled the cache are not held by the
+  // next ones.
+  Gameboy otherManual{ otherImage };
+  for (unsigned long long i = 0; i != bootClocks; ++i) {
+    otherManual.machineClock();
+  }
+  Gameboy otherCached{ otherImage };
+  CHECK(otherCached.boot());
+  CHECK(saveState(otherCached) == saveState(otherManual));
+
+  // Boot ROM hangs on invalid headers.
+  Gameboy invalid{ Binary(0x8000, 0) };
+  CHECK_THROWS(invalid.boot());
+}
+
+TEST_CASE("Gameboy Hard Reset") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+
+  Gameboy gameboy{ image };
+  gameboy.setRenderingEnabled(false);
+  runFrames(gameboy, 200);
+  gameboy.setJoypad(0b01111111);
+  gameboy.setRenderingEnabled(true);
+  runFrames(gameboy, 30);
+  gameboy.serialBuffer = "Serial output";
+
+  // Same as a new machine.
+  gameboy.hardReset();
+  Gameboy fresh{ image };
+  CHECK_EQ(gameboy.getClockCount(), 0);
+  CHECK(saveState(gameboy) == saveState(fresh));
+  CHECK_EQ(gameboy.stateHash(), fresh.stateHash());
+  CHECK(gameboy.screenBuffer == fresh.screenBuffer);
+  CHECK(gameboy.serialBuffer.empty());
+  CHECK_EQ(gameboy.getFramesDrawn(), 0);
+  // Settings are kept.
+  CHECK(gameboy.isRenderingEnabled());
+
+  SUBCASE("Machines go on the same way") {
+    runFrames(gameboy, 300);
+    runFrames(fresh, 300);
+    CHECK(saveState(gameboy) == saveState(fresh));
+    CHECK(gameboy.screenBuffer == fresh.screenBuffer);
+  }
+
+  SUBCASE("Boot after reset") {
+    gameboy.boot();
+    fresh.boot();
+    CHECK(saveState(gameboy) == saveState(fresh));
+  }
+
+  SUBCASE("Threaded rendering") {
+    gameboy.setThreadedRendering(true);
+    runFrames(gameboy, 60);
+    gameboy.hardReset();
+    runFrames(gameboy, 300);
+    gameboy.waitForRenderer();
+    runFrames(fresh, 300);
+    CHECK(gameboy.screenBuffer == fresh.screenBuffer);
+  }
+}
@@ -0,0 +1,157 @@
+#include "movie.hpp"
+#include "gameboy.hpp"
+#include "save-state.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include "doctest.h"
+#include "test-helpers.hpp"
+
+using namespace gb;
+
+TEST_CASE("Movie Recording and Playback") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+  const std::string path{ "movie-test.gbmv" };
+  constexpr int frames{ 300 };
+
+  // Record a run with inputs at odd clocks, keeping the state at the start
+  // of each frame.
+  std::vector<Binary> states;
+  {
+    Gameboy gameboy{ image };
+    runClocks(gameboy, 100 * cyclesPerFrame + 1234);
+    MovieRecorder recorder{ path, gameboy, 60 };
+
+    for (int frame = 0; frame != frames; ++frame) {
+      states.push_back(saveState(gameboy));
+      runClocks(gameboy, 777 + frame);
+      // Press start every now and then, and move around.
+      if (frame % 40 == 0) {
+        recorder.setJoypad(gameboy, 0b01111111);
+      } else if (frame % 40 == 5) {
+        recorder.setJoypad(gameboy, frame % 80 == 5 ? 0b11111110 : 0b11111101);
+      } else if (frame % 40 == 10) {
+        recorder.setJoypad(gameboy, 0b11111111);
+      }
+      runClocks(gameboy, cyclesPerFrame - 777 - frame);
+      recorder.update(gameboy);
+    }
+    states.push_back(saveState(gameboy));
+    recorder.finish(gameboy);
+  }
+
+  SUBCASE("Playback is exact") {
+    Gameboy gameboy{ image };
+    MoviePlayer player{ path };
+    CHECK_EQ(player.getFrameCount(), frames);
+    CHECK_EQ(player.getKeyframeInterval(), 60);
+
+    player.start(gameboy);
+    CHECK_EQ(player.getFrame(gameboy), 0);
+    bool statesMatch{ saveState(gameboy) == states[0] };
+    for (int frame = 0; frame != frames; ++frame) {
+      CHECK_FALSE(player.isFinished(gameboy));
+      player.runFrames(gameboy);
+      statesMatch = statesMatch && saveState(gameboy) == states[frame + 1];
+    }
+    CHECK(statesMatch);
+    CHECK(player.isFinished(gameboy));
+    CHECK_EQ(player.getFrame(gameboy), frames);
+  }
+
+  SUBCASE("Playback one clock at a time") {
+    Gameboy gameboy{ image };
+    MoviePlayer player{ path };
+    player.start(gameboy);
+    while (!player.isFinished(gameboy)) {
+      player.apply(gameboy);
+      gameboy.machineClock();
+    }
+    CHECK(saveState(gameboy) == states[frames]);
+  }
+
+  SUBCASE("Seeking") {
+    Gameboy gameboy{ image };
+    MoviePlayer player{ path };
+
+    // Forwards, backwards, on keyframes and between them.
+    for (const unsigned long frame : { 250ul, 7ul, 120ul, 121ul, 59ul, 0ul, 300ul }) {
+      player.seek(gameboy, frame);
+      CHECK_EQ(player.getFrame(gameboy), frame);
+      CHECK(saveState(gameboy) == states[frame]);
+    }
+
+    // Playback goes on from where it was sought to.
+    player.seek(gameboy, 195);
+    player.runFrames(gameboy, 10);
+    CHECK(saveState(gameboy) == states[205]);
+
+    // Past the end
+    player.seek(gameboy, 1000);
+    CHECK(saveState(gameboy) == states[frames]);
+  }
+
+  SUBCASE("Segments") {
+    const MoviePlayer player{ path };
+    // The movie stopped right on a keyframe boundary.
+    CHECK_EQ(player.getKeyframeCount(), 6);
+    CHECK_EQ(player.getKeyframeFrame(2), 120);
+
+    // Segments can be played at the same time, on different machines.
+    const auto playSegments = [&](std::size_t first, std::vector<bool>& results) {
+      Gameboy gameboy{ image };
+      for (std::size_t i = first; i + 1 < player.getKeyframeCount(); i += 2) {
+        player.playSegment(gameboy, i);
+        const auto state = saveState(gameboy);
+        results[i] = state::hash(state.data(), state.size()) == player.getKeyframeHash(i + 1)
+                  && state == states[player.getKeyframeFrame(i + 1)];
+      }
+    };
+    std::vector<bool> even(player.getKeyframeCount() - 1);
+    std::vector<bool> odd(player.getKeyframeCount() - 1);
+    std::thread other{ playSegments, 1, std::ref(odd) };
+    playSegments(0, even);
+    other.join();
+    for (std::size_t i = 0; i + 1 < player.getKeyframeCount(); ++i) {
+      CHECK((i % 2 == 0 ? even[i] : odd[i]));
+    }
+
+    // Last segment goes to the end of the movie.
+    Gameboy gameboy{ image };
+    player.playSegment(gameboy, player.getKeyframeCount() - 1);
+    CHECK(saveState(gameboy) == states[frames]);
+  }
+
+  SUBCASE("Invalid movies") {
+    CHECK_THROWS(MoviePlayer{ "nonexistent.gbmv" });
+
+    Binary data;
+    {
+      std::ifstream input{ path, std::ios_base::binary };
+      data = Binary{ std::istreambuf_iterator<char>(input), {} };
+    }
+    const auto writeMovie = [&](const Binary& movie) {
+      std::ofstream output{ path, std::ios_base::binary | std::ios_base::trunc };
+      output.write(reinterpret_cast<const char*>(movie.data()), static_cast<std::streamsize>(movie.size()));
+    };
+
+    Binary corrupted{ data };
+    corrupted[0] = 'X';
+    writeMovie(corrupted);
+    CHECK_THROWS(MoviePlayer{ path });
+
+    // Cut in the middle of the first keyframe
+    writeMovie(Binary(data.begin(), data.begin() + 100));
+    CHECK_THROWS(MoviePlayer{ path });
+
+    // Movie of a different game
+    writeMovie(data);
+    MoviePlayer player{ path };
+    Gameboy other{ Binary(0x8000, 0) };
+    CHECK_THROWS(player.start(other));
+  }
+
+  std::remove(path.c_str());
+}
@@ -71,4 +71,34 @@ TEST_CASE("PPU Machine Clock") {
   }
 }
 
-// TODO More PPU testing should be done by using test ROMs
\ No newline at end of file
+// TODO More PPU testing should be done by using test ROMs
+TEST_CASE("PPU Palettes") {
+  Gameboy gameboy{ std::vector<word>(0x8000, 0) };
+  AddressBus bus{ &gameboy };
+  PPU ppu{ &gameboy, &bus };
+
+  SUBCASE("Palettes are latched when a line is drawn") {
+    // Reverse the order of the colors
+    bus.write(REG_BGP, 0b00011011);
+    bus.write(REG_OBP0, 0b11100100);
+    bus.write(REG_OBP1, 0b11111111);
+
+    // Nothing has been drawn yet, so palettes still map everything to 0
+    CHECK_EQ(ppu.applyPaletteBG(3), 0);
+
+    // Line is drawn right after OAM scan
+    for (int i = 0; i != 21; ++i) {
+      ppu.machineClock();
+    }
+
+    CHECK_EQ(ppu.applyPaletteBG(0), 3);
+    CHECK_EQ(ppu.applyPaletteBG(1), 2);
+    CHECK_EQ(ppu.applyPaletteBG(2), 1);
+    CHECK_EQ(ppu.applyPaletteBG(3), 0);
+    CHECK_EQ(ppu.applyPalette0(0), 0);
+    CHECK_EQ(ppu.applyPalette0(1), 1);
+    CHECK_EQ(ppu.applyPalette0(2), 2);
+    CHECK_EQ(ppu.applyPalette0(3), 3);
+    CHECK_EQ(ppu.applyPalette1(1), 3);
+  }
+}
@@ -0,0 +1,81 @@
+#include "rewind-buffer.hpp"
+#include "gameboy.hpp"
+#include <vector>
+#include "doctest.h"
+#include "test-helpers.hpp"
+
+using namespace gb;
+
+TEST_CASE("Rewind Buffer") {
+  Gameboy gameboy{ ROMImage::fromFile("tetris.gb") };
+  const std::size_t stateSize = gameboy.stateSize();
+
+  SUBCASE("Invalid configuration") {
+    CHECK_THROWS(RewindBuffer(stateSize, stateSize));
+    CHECK_THROWS(RewindBuffer(stateSize, 64 * stateSize, 0));
+  }
+
+  SUBCASE("Steps back to the exact states that were pushed") {
+    RewindBuffer rewind{ stateSize, 64 * stateSize, 10 };
+    CHECK_EQ(rewind.stepBack(gameboy), 0);
+
+    std::vector<Binary> states;
+    for (int frame = 0; frame != 100; ++frame) {
+      runFrames(gameboy, 1);
+      rewind.push(gameboy);
+      states.push_back(saveState(gameboy));
+    }
+    CHECK_EQ(rewind.framesAvailable(), 99);
+    // Deltas are much smaller than full states.
+    CHECK(rewind.memoryUsed() < 20 * stateSize);
+
+    // One frame at a time
+    bool statesMatch{ true };
+    for (int frame = 98; frame != 80; --frame) {
+      CHECK_EQ(rewind.stepBack(gameboy), 1);
+      statesMatch = statesMatch && saveState(gameboy) == states[frame];
+    }
+    CHECK(statesMatch);
+
+    // Many frames at once (starting from a keyframe)
+    CHECK_EQ(rewind.stepBack(gameboy, 36), 36);
+    CHECK(saveState(gameboy) == states[45]);
+
+    // Pushing again after rewinding
+    runFrames(gameboy, 1);
+    rewind.push(gameboy);
+    const auto branched = saveState(gameboy);
+    runFrames(gameboy, 1);
+    rewind.push(gameboy);
+    CHECK_EQ(rewind.stepBack(gameboy), 1);
+    CHECK(saveState(gameboy) == branched);
+    CHECK_EQ(rewind.stepBack(gameboy), 1);
+    CHECK(saveState(gameboy) == states[45]);
+
+    // Can not go further than the first frame.
+    CHECK_EQ(rewind.stepBack(gameboy, 1000), 45);
+    CHECK(saveState(gameboy) == states[0]);
+    CHECK_EQ(rewind.framesAvailable(), 0);
+  }
+
+  SUBCASE("Memory is bounded") {
+    const std::size_t limit = 16 * stateSize;
+    // Keyframes alone would not fit.
+    RewindBuffer rewind{ stateSize, limit, 10 };
+
+    std::vector<Binary> states;
+    for (int frame = 0; frame != 300; ++frame) {
+      runFrames(gameboy, 1);
+      rewind.push(gameboy);
+      states.push_back(saveState(gameboy));
+      REQUIRE(rewind.memoryUsed() <= limit);
+    }
+
+    // Oldest frames were dropped, the remaining ones are intact.
+    const std::size_t available = rewind.framesAvailable();
+    CHECK(available > 0);
+    CHECK(available < 299);
+    CHECK_EQ(rewind.stepBack(gameboy, available), available);
+    CHECK(saveState(gameboy) == states[299 - available]);
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include "gameboy.hpp"
+#include "types.hpp"
+
+// Helpers shared by the tests that run whole machines.
+
+// Machine clocks in a frame (see PPU).
+constexpr int cyclesPerFrame{ 17556 };
+
+inline void runClocks(gb::Gameboy& gameboy, const int clocks) {
+  for (int i = 0; i != clocks; ++i) {
+    gameboy.machineClock();
+  }
+}
+
+inline void runFrames(gb::Gameboy& gameboy, const int frames) {
+  runClocks(gameboy, frames * cyclesPerFrame);
+}
+
+inline gb::Binary saveState(const gb::Gameboy& gameboy) {
+  gb::Binary state(gameboy.stateSize());
+  gameboy.saveState(state.data(), state.size());
+  return state;
+}
+
+#endif  // TEST_HELPERS_H
@@ -142,4 +142,94 @@ TEST_CASE("TimerController Edge Cases") {
     bus.write(0xFF04, 0x42);
     CHECK_EQ(bus.read(0xFF04), 0x00);
   }
-}
\ No newline at end of file
+}
+TEST_CASE("TimerController Falling Edges") {
+  Gameboy gameboy{ std::vector<word>(0x8000, 0) };
+  AddressBus bus{ &gameboy };
+  TimerController timer{ &gameboy, &bus };
+
+  // TIMA increments when the selected divider bit goes from 1 to 0. With rate 01
+  // (once every 4 cycles), that is bit 3 of the divider, which counts 4 times per cycle.
+  bus.write(0xFF07, 0b101);
+
+  SUBCASE("Resetting DIV can increment TIMA") {
+    // Bit 3 is set after two cycles
+    for (int i = 0; i < 2; i++) {
+      timer.machineClock();
+    }
+    bus.write(0xFF04, 0);
+    CHECK_EQ(bus.read(0xFF05), 1);
+
+    // And a full period is needed for the next one
+    for (int i = 0; i < 3; i++) {
+      timer.machineClock();
+    }
+    CHECK_EQ(bus.read(0xFF05), 1);
+    timer.machineClock();
+    CHECK_EQ(bus.read(0xFF05), 2);
+  }
+
+  SUBCASE("Resetting DIV when bit is low does nothing") {
+    timer.machineClock();
+    bus.write(0xFF04, 0);
+    CHECK_EQ(bus.read(0xFF05), 0);
+  }
+
+  SUBCASE("Disabling timer can increment TIMA") {
+    for (int i = 0; i < 2; i++) {
+      timer.machineClock();
+    }
+    bus.write(0xFF07, 0b001);
+    CHECK_EQ(bus.read(0xFF05), 1);
+
+    // Timer is disabled now
+    for (int i = 0; i < 64; i++) {
+      timer.machineClock();
+    }
+    CHECK_EQ(bus.read(0xFF05), 1);
+  }
+
+  SUBCASE("Overflow through DIV reset reloads TIMA") {
+    bus.write(0xFF05, 0xFF);
+    bus.write(0xFF06, 0x42);
+    for (int i = 0; i < 2; i++) {
+      timer.machineClock();
+    }
+    bus.write(0xFF04, 0);
+    CHECK_EQ(bus.read(0xFF05), 0x42);
+  }
+
+  SUBCASE("Long runs") {
+    // Overflow after 5 increments, then 5 more.
+    bus.write(0xFF05, 0xFB);
+    bus.write(0xFF06, 0xF0);
+    for (int i = 0; i < 4 * 10; i++) {
+      timer.machineClock();
+    }
+    CHECK_EQ(bus.read(0xFF05), 0xF5);
+
+    // Slowest rate
+    bus.write(0xFF05, 0);
+    bus.write(0xFF07, 0b100);
+    for (int i = 0; i < 1000; i++) {
+      timer.machineClock();
+    }
+    CHECK_EQ(bus.read(0xFF05), (1000 + 40) / 256);
+    CHECK_EQ(bus.read(0xFF04), (1000 + 40) / 64);
+  }
+}
+
+TEST_CASE("TimerController Forced Writes") {
+  Gameboy gameboy{ std::vector<word>(0x8000, 0) };
+  AddressBus bus{ &gameboy };
+  TimerController timer{ &gameboy, &bus };
+
+  // Gameboy can set DIV to any value (e.g. when skipping boot ROM).
+  bus.write(0xFF04, 0x18, AddressBus::GB);
+  CHECK_EQ(bus.read(0xFF04), 0x18);
+
+  for (int i = 0; i < 64; i++) {
+    timer.machineClock();
+  }
+  CHECK_EQ(bus.read(0xFF04), 0x19);
+}
@@ -0,0 +1,89 @@
+#include "vec-env.hpp"
+#include "gameboy.hpp"
+#include <algorithm>
+#include <vector>
+#include "doctest.h"
+
+using namespace gb;
+
+TEST_CASE("Vectorised Environment") {
+  const auto image = ROMImage::fromFile("tetris.gb");
+  constexpr std::size_t count{ 5 };
+  constexpr int frameskip{ 4 };
+  // DIV register and a variable in work RAM.
+  const std::vector<GameboyVecEnv::RewardTerm> rewards{ { 0xFF04, 1, 1.f }, { 0xC0A0, 2, 0.5f } };
+
+  GameboyVecEnv env{ image, count, rewards, 3 };
+  CHECK_EQ(env.size(), count);
+  CHECK_EQ(env.getThreadCount(), 3);
+
+  const auto readReward = [&](const Gameboy& gameboy) {
+    return gameboy.readMemory(0xFF04) + 0.5 * (gameboy.readMemory(0xC0A0) | gameboy.readMemory(0xC0A1) << 8);
+  };
+
+  std::vector<word> observations(count * GameboyVecEnv::OBSERVATION_SIZE);
+  std::vector<float> stepRewards(count);
+  // All machines start from the same screen.
+  env.reset(observations.data());
+  for (std::size_t i = 1; i != count; ++i) {
+    CHECK(std::equal(observations.begin(), observations.begin() + GameboyVecEnv::OBSERVATION_SIZE,
+                     observations.begin() + i * GameboyVecEnv::OBSERVATION_SIZE));
+  }
+  // Machines start right at the beginning of VBlank, on its first line.
+  const int vblankLine{ PPU::HEIGHT };
+  CHECK_EQ(env.getInstance(0).readMemory(REG_LY), vblankLine);
+
+  // Reference machines, stepped by hand on this thread. They draw all
+  // frames, so at the beginning of VBlank their screen holds a whole frame.
+  std::vector<std::unique_ptr<Gameboy>> reference;
+  for (std::size_t i = 0; i != count; ++i) {
+    reference.push_back(env.getInstance(i).clone());
+    reference.back()->setRenderingEnabled(true);
+  }
+
+  SUBCASE("Steps match single machines") {
+    for (int step = 0; step != 40; ++step) {
+      // START pressed on some machines, some of the time.
+      std::vector<word> actions(count);
+      for (std::size_t i = 0; i != count; ++i) {
+        actions[i] = (step + i) % 7 == 0 ? 0b01111111 : 0b11111111;
+      }
+      env.step(actions.data(), frameskip, observations.data(), stepRewards.data());
+
+      for (std::size_t i = 0; i != count; ++i) {
+        Gameboy& gameboy = *reference[i];
+        const double before = readReward(gameboy);
+        gameboy.setJoypad(actions[i]);
+        for (int clock = 0; clock != frameskip * GameboyVecEnv::CLOCKS_PER_FRAME; ++clock) {
+          gameboy.machineClock();
+        }
+        CHECK_EQ(stepRewards[i], doctest::Approx(readReward(gameboy) - before));
+        CHECK_EQ(env.getInstance(i).stateHash(), gameboy.stateHash());
+        CHECK_EQ(gameboy.readMemory(REG_LY), vblankLine);
+
+        // Only the last frame of each step is drawn, and it is whole.
+        CHECK(std::equal(gameboy.screenBuffer.begin(), gameboy.screenBuffer.end(),
+                         observations.begin() + i * GameboyVecEnv::OBSERVATION_SIZE));
+      }
+    }
+  }
+
+  SUBCASE("Reset") {
+    const std::uint64_t start = env.getInstance(2).stateHash();
+    const std::vector<word> actions(count, 0b11111111);
+    env.step(actions.data(), frameskip, nullptr, nullptr);
+    CHECK_NE(env.getInstance(2).stateHash(), start);
+
+    env.reset(2);
+    CHECK_EQ(env.getInstance(2).stateHash(), start);
+    env.reset();
+    for (std::size_t i = 0; i != count; ++i) {
+      CHECK_EQ(env.getInstance(i).stateHash(), start);
+    }
+    CHECK_THROWS(env.getInstance(count));
+    CHECK_THROWS(env.step(actions.data(), 0, nullptr, nullptr));
+  }
+
+  CHECK_THROWS(GameboyVecEnv(image, 0));
+  CHECK_THROWS(GameboyVecEnv(image, 1, { { 0xC000, 5, 1.f } }));
+}